@@ -137,6 +137,8 @@ int main(int argc, char *argv[]) {
             /* Sample K points at distance r */
             int K = 100;
 
+            double px[100], py[100], pz[100], d[100];
+
             /* For each point */
             for (int k=0; k<K; k++) {
                 /* Generate a random point on the unit sphere using Gaussians */
@@ -153,15 +155,17 @@ int main(int argc, char *argv[]) {
                 }
 
                 /* The point in question */
-                double px = cx + r * nx;
-                double py = cy + r * ny;
-                double pz = cz + r * nz;
+                px[k] = cx + r * nx;
+                py[k] = cy + r * ny;
+                pz[k] = cz + r * nz;
+            }
 
-                /* Fetch the overdensity at this point */
-                double d = gridCIC(box, box_N, boxlen, px, py, pz);
+            /* Fetch the overdensity at these points */
+            gridCIC_batch(box, box_N, boxlen, K, px, py, pz, d);
 
-                /* Add the density */
-                profiles[i * num_bins + j] += d/K;
+            /* Add the density */
+            for (int k=0; k<K; k++) {
+                profiles[i * num_bins + j] += d[k]/K;
             }
 
         }
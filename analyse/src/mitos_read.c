@@ -108,8 +108,14 @@ int main(int argc, char *argv[]) {
     /* The size of the density grid that we will create */
     const int N = pars.GridSize;
 
-    /* Allocate grids */
-    double *box = fftw_alloc_real(N * N * N);
+    /* Allocate a distributed grid, each rank holding a slice of rows */
+    struct distributed_grid grid;
+    alloc_local_grid(&grid, N, boxlen[0], MPI_COMM_WORLD);
+
+    /* Reset the grid */
+    for (long int i = 0; i < 2 * grid.local_size; i++) {
+        grid.box[i] = 0.;
+    }
 
     /* Open the corresponding group */
     h_grp = H5Gopen(h_file, pars.ImportName, H5P_DEFAULT);
@@ -128,7 +134,6 @@ int main(int argc, char *argv[]) {
     hid_t Npart = dims[0];
     hid_t max_slab_size = pars.SlabSize;
     int slabs = Npart/max_slab_size;
-    hid_t counter = 0;
 
     /* Close the data and memory spaces */
     H5Sclose(h_space);
@@ -136,265 +141,151 @@ int main(int argc, char *argv[]) {
     /* Close the dataset */
     H5Dclose(h_dat);
 
+    /* Buffers for the particle data of one slab */
+    double *data = malloc(3 * max_slab_size * sizeof(double));
+    double *mass_data = malloc(max_slab_size * sizeof(double));
+
     double total_mass = 0; //for this particle type
 
-    int slab_counter = 0;
+    /* The deposition is collective, so every rank does the same number of
+     * iterations, reading nothing once it runs out of slabs */
+    int iterations = (slabs + MPI_Rank_Count) / MPI_Rank_Count;
+
+    for (int it=0; it<iterations; it++) {
+        int k = rank + it * MPI_Rank_Count;
 
-    for (int k=rank; k<slabs+1; k+=MPI_Rank_Count) {
         /* All slabs have the same number of particles, except possibly the last */
-        hid_t slab_size = fmin(Npart - k * max_slab_size, max_slab_size);
-        counter += slab_size; //the number of particles read
-
-        /* Define the hyperslab */
-        hsize_t slab_dims[2], start[2]; //for 3-vectors
-        hsize_t slab_dims_one[1], start_one[1]; //for scalars
+        hid_t slab_size = (k <= slabs) ? fmin(Npart - k * max_slab_size, max_slab_size) : 0;
 
-        /* Slab dimensions for 3-vectors */
-        slab_dims[0] = slab_size;
-        slab_dims[1] = 3; //(x,y,z)
-        start[0] = k * max_slab_size;
-        start[1] = 0; //start with x
-
-        /* Slab dimensions for scalars */
-        slab_dims_one[0] = slab_size;
-        start_one[0] = k * max_slab_size;
-
-        /* Open the coordinates dataset */
-        h_dat = H5Dopen(h_grp, "Coordinates", H5P_DEFAULT);
-
-        /* Find the dataspace (in the file) */
-        h_space = H5Dget_space (h_dat);
-
-        /* Select the hyperslab */
-        hid_t status = H5Sselect_hyperslab(h_space, H5S_SELECT_SET, start,
-                                           NULL, slab_dims, NULL);
-        assert(status >= 0);
-
-        /* Create a memory space */
-        hid_t h_mems = H5Screate_simple(2, slab_dims, NULL);
-
-        /* Create the data array */
-        double data[slab_size][3];
-
-        status = H5Dread(h_dat, H5T_NATIVE_DOUBLE, h_mems, h_space, H5P_DEFAULT,
-                         data);
-
-        /* Close the memory space */
-        H5Sclose(h_mems);
-
-        /* Close the data and memory spaces */
-        H5Sclose(h_space);
-
-        /* Close the dataset */
-        H5Dclose(h_dat);
-
-
-        /* Open the masses dataset */
-        h_dat = H5Dopen(h_grp, "Masses", H5P_DEFAULT);
-
-        /* Find the dataspace (in the file) */
-        h_space = H5Dget_space (h_dat);
-
-        /* Select the hyperslab */
-        status = H5Sselect_hyperslab(h_space, H5S_SELECT_SET, start_one, NULL,
-                                            slab_dims_one, NULL);
-
-        /* Create a memory space */
-        h_mems = H5Screate_simple(1, slab_dims_one, NULL);
-
-        /* Create the data array */
-        double mass_data[slab_size];
-
-        status = H5Dread(h_dat, H5T_NATIVE_DOUBLE, h_mems, h_space, H5P_DEFAULT,
-                         mass_data);
-
-        /* Close the memory space */
-        H5Sclose(h_mems);
-
-        /* Close the data and memory spaces */
-        H5Sclose(h_space);
-
-        /* Close the dataset */
-        H5Dclose(h_dat);
-
-
-        // /* Open the velocities dataset */
-        // h_dat = H5Dopen(h_grp, "Velocities", H5P_DEFAULT);
-        //
-        // /* Find the dataspace (in the file) */
-        // h_space = H5Dget_space (h_dat);
-        //
-        // /* Select the hyperslab */
-        // status = H5Sselect_hyperslab(h_space, H5S_SELECT_SET, start,
-        //                              NULL, slab_dims, NULL);
-        // assert(status >= 0);
-        //
-        // /* Create a memory space */
-        // h_mems = H5Screate_simple(2, slab_dims, NULL);
-        //
-        // /* Create the data array */
-        // double velocities_data[slab_size][3];
-        //
-        // status = H5Dread(h_dat, H5T_NATIVE_DOUBLE, h_mems, h_space, H5P_DEFAULT,
-        //                  velocities_data);
-        //
-        // /* Close the memory space */
-        // H5Sclose(h_mems);
-        //
-        // /* Close the data and memory spaces */
-        // H5Sclose(h_space);
-        //
-        // /* Close the dataset */
-        // H5Dclose(h_dat);
-
-        double grid_cell_vol = boxlen[0]*boxlen[1]*boxlen[2] / (N*N*N);
-
-        /* Assign the particles to the grid with CIC */
-        for (int l=0; l<slab_size; l++) {
-            double X = data[l][0] / (boxlen[0]/N);
-            double Y = data[l][1] / (boxlen[1]/N);
-            double Z = data[l][2] / (boxlen[2]/N);
-
-            // double V_X = velocities_data[l][0];
-            // double V_Y = velocities_data[l][1];
-            // double V_Z = velocities_data[l][2];
-            //
-            // /* Unused variables */
-            // (void) V_X;
-            // (void) V_Y;
-            // (void) V_Z;
-
-            double M = mass_data[l];
-            total_mass += M;
-
-            int iX = (int) floor(X);
-            int iY = (int) floor(Y);
-            int iZ = (int) floor(Z);
-
-            double shift = 0;
-
-            //The search window with respect to the top-left-upper corner
-    		int lookLftX = (int) floor((X-iX) - 1.5 + shift);
-    		int lookRgtX = (int) floor((X-iX) + 1.5 + shift);
-    		int lookLftY = (int) floor((Y-iY) - 1.5 + shift);
-    		int lookRgtY = (int) floor((Y-iY) + 1.5 + shift);
-    		int lookLftZ = (int) floor((Z-iZ) - 1.5 + shift);
-    		int lookRgtZ = (int) floor((Z-iZ) + 1.5 + shift);
-
-            //Do the mass assignment
-    		for (int x=lookLftX; x<=lookRgtX; x++) {
-    			for (int y=lookLftY; y<=lookRgtY; y++) {
-    				for (int z=lookLftZ; z<=lookRgtZ; z++) {
-                        double xx = fabs(X - (iX+x+shift));
-                        double yy = fabs(Y - (iY+y+shift));
-                        double zz = fabs(Z - (iZ+z+shift));
-
-                        double part_x = xx < 0.5 ? (0.75-xx*xx)
-                                                : (xx < 1.5 ? 0.5*(1.5-xx)*(1.5-xx) : 0);
-        				double part_y = yy < 0.5 ? (0.75-yy*yy)
-                                                : (yy < 1.5 ? 0.5*(1.5-yy)*(1.5-yy) : 0);
-        				double part_z = zz < 0.5 ? (0.75-zz*zz)
-                                                : (zz < 1.5 ? 0.5*(1.5-zz)*(1.5-zz) : 0);
-
-                        box[row_major(iX+x, iY+y, iZ+z, N)] += M/grid_cell_vol * (part_x*part_y*part_z);
-    				}
-    			}
-    		}
-        }
+        if (slab_size > 0) {
+            /* Define the hyperslab */
+            hsize_t slab_dims[2], start[2]; //for 3-vectors
+            hsize_t start_one[1]; //for scalars
 
-        printf("(%03d,%03d) Read %ld particles\n", rank, k, slab_size);
-        slab_counter++;
-    }
+            /* Slab dimensions for 3-vectors */
+            slab_dims[0] = slab_size;
+            slab_dims[1] = 3; //(x,y,z)
+            start[0] = k * max_slab_size;
+            start[1] = 0; //start with x
 
-    /* Close the group again */
-    H5Gclose(h_grp);
+            /* Slab dimensions for scalars */
+            start_one[0] = k * max_slab_size;
 
+            /* Open the coordinates dataset */
+            h_dat = H5Dopen(h_grp, "Coordinates", H5P_DEFAULT);
 
-    /* Reduce the grid */
-    if (rank == 0) {
-        MPI_Reduce(MPI_IN_PLACE, box, N * N * N, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-    } else {
-        MPI_Reduce(box, box, N * N * N, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-    }
+            /* Find the dataspace (in the file) */
+            h_space = H5Dget_space (h_dat);
 
-    /* Reduce the total mass */
-    if (rank == 0) {
-        MPI_Reduce(MPI_IN_PLACE, &total_mass, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-    } else {
-        MPI_Reduce(&total_mass, &total_mass, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-    }
+            /* Select the hyperslab */
+            hid_t status = H5Sselect_hyperslab(h_space, H5S_SELECT_SET, start,
+                                               NULL, slab_dims, NULL);
+            assert(status >= 0);
 
+            /* Create a memory space */
+            hid_t h_mems = H5Screate_simple(2, slab_dims, NULL);
 
-    if (rank == 0) {
+            status = H5Dread(h_dat, H5T_NATIVE_DOUBLE, h_mems, h_space, H5P_DEFAULT,
+                             data);
 
-        message(rank, "Total mass: %f\n", total_mass);
+            /* Close the memory space */
+            H5Sclose(h_mems);
 
-        /* The average density */
-        double avg_density = total_mass / (boxlen[0]*boxlen[1]*boxlen[2]);
+            /* Close the data and memory spaces */
+            H5Sclose(h_space);
 
-        message(rank, "Average density %f\n", avg_density);
+            /* Close the dataset */
+            H5Dclose(h_dat);
 
-        // if (strcmp(tp.Identifier, "ncdm") == 0) {
-        //     avg_density = 0.179075;
-        //     printf("Reset avg_density to %f\n", avg_density);
-        // }
 
-        /* Turn the density field into an overdensity field */
-        for (int x=0; x<N; x++) {
-            for (int y=0; y<N; y++) {
-                for (int z=0; z<N; z++) {
-                    int id = row_major(x, y, z, N);
-                    box[id] = (box[id] - avg_density)/avg_density;
-                }
+            /* Read the masses, from the MassTable if there is no Masses dataset */
+            int mass_err = readParticleMasses(h_file, pars.ImportName, start_one[0],
+                                              slab_size, mass_data);
+            if (mass_err > 0) {
+                MPI_Abort(MPI_COMM_WORLD, mass_err);
             }
+
+            for (int l=0; l<slab_size; l++) {
+                total_mass += mass_data[l];
+            }
+
+            printf("(%03d,%03d) Read %ld particles\n", rank, k, slab_size);
         }
 
-        /* Find a particle type with a matching ExportName */
-        struct particle_type *tp;
-        char found = 0;
-        for (int pti = 0; pti < pars.NumParticleTypes; pti++) {
-            struct particle_type *ptype = types + pti;
-            const char *ExportName = ptype->ExportName;
+        /* Assign the particles to the grid with TSC */
+        int err = massDepositTSC_dg(&grid, data, mass_data, slab_size);
+        if (err > 0) {
+            printf("Error with mass deposition.\n");
+            MPI_Abort(MPI_COMM_WORLD, err);
+        }
+    }
+
+    free(data);
+    free(mass_data);
+
+    /* Close the group again */
+    H5Gclose(h_grp);
+
+    /* Sum the total mass */
+    MPI_Allreduce(MPI_IN_PLACE, &total_mass, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+    message(rank, "Total mass: %f\n", total_mass);
+
+    /* The average density */
+    double avg_density = total_mass / (boxlen[0]*boxlen[1]*boxlen[2]);
+
+    message(rank, "Average density %f\n", avg_density);
 
-            if (strcmp(ExportName, pars.ImportName) == 0) {
-                tp = ptype;
-                found = 1;
+    /* Turn the density field into an overdensity field */
+    for (int x=grid.X0; x<grid.X0 + grid.NX; x++) {
+        for (int y=0; y<N; y++) {
+            for (int z=0; z<N; z++) {
+                int id = row_major_dg(x, y, z, &grid);
+                grid.box[id] = (grid.box[id] - avg_density)/avg_density;
             }
         }
+    }
+
+    /* Find a particle type with a matching ExportName */
+    struct particle_type *tp;
+    char found = 0;
+    for (int pti = 0; pti < pars.NumParticleTypes; pti++) {
+        struct particle_type *ptype = types + pti;
+        const char *ExportName = ptype->ExportName;
 
-        char box_fname[40];
-        if (!found) {
-            sprintf(box_fname, "density_%s.hdf5", pars.ImportName);
-        } else {
-            sprintf(box_fname, "density_%s.hdf5", tp->Identifier);
+        if (strcmp(ExportName, pars.ImportName) == 0) {
+            tp = ptype;
+            found = 1;
         }
-        writeFieldFile(box, N, boxlen[0], box_fname);
-        message(rank, "Density grid exported to %s.\n", box_fname);
     }
 
-    if (rank == 0) {
-        int bins = pars.PowerSpectrumBins;
-        double *k_in_bins = malloc(bins * sizeof(double));
-        double *power_in_bins = malloc(bins * sizeof(double));
-        int *obs_in_bins = calloc(bins, sizeof(int));
+    char box_fname[40];
+    if (!found) {
+        sprintf(box_fname, "density_%s.hdf5", pars.ImportName);
+    } else {
+        sprintf(box_fname, "density_%s.hdf5", tp->Identifier);
+    }
+    writeFieldFile_dg(&grid, box_fname);
+    message(rank, "Density grid exported to %s.\n", box_fname);
 
-        /* Transform to momentum space */
-        fftw_complex *fbox = (fftw_complex*) fftw_malloc(N*N*(N/2+1)*sizeof(fftw_complex));
-        fftw_plan r2c = fftw_plan_dft_r2c_3d(N, N, N, box, fbox, FFTW_ESTIMATE);
-        fftw_plan c2r = fftw_plan_dft_c2r_3d(N, N, N, fbox, box, FFTW_ESTIMATE);
-        fft_execute(r2c);
-    	fft_normalize_r2c(fbox,N,boxlen[0]);
+    int bins = pars.PowerSpectrumBins;
+    double *k_in_bins = malloc(bins * sizeof(double));
+    double *power_in_bins = malloc(bins * sizeof(double));
+    int *obs_in_bins = calloc(bins, sizeof(int));
 
-        /* Undo the TSC window function */
-        undoTSCWindow(fbox, N, boxlen[0]);
+    /* Transform to momentum space */
+    fft_r2c_dg(&grid);
 
-    // if (strcmp(tp.Identifier, "cdm") == 0) {
-    //     fbox_c = (fftw_complex*) fftw_malloc(N*N*(N/2+1)*sizeof(fftw_complex));
-    //     memcpy(fbox_c, fbox, N*N*(N/2+1)*sizeof(fftw_complex));
-    // }
+    /* Undo the TSC window function */
+    struct Hermite_kern_params Hkp;
+    Hkp.order = 3; //TSC
+    Hkp.N = N;
+    Hkp.boxlen = boxlen[0];
+    fft_apply_kernel_dg(&grid, &grid, kernel_undo_Hermite_window, &Hkp);
 
-        calc_cross_powerspec(N, boxlen[0], fbox, fbox, bins, k_in_bins, power_in_bins, obs_in_bins);
+    calc_cross_powerspec_dg(&grid, &grid, bins, k_in_bins, power_in_bins, obs_in_bins);
 
+    if (rank == 0) {
         /* Check that it is right */
         printf("\n");
         printf("Example power spectrum:\n");
@@ -410,63 +301,15 @@ int main(int argc, char *argv[]) {
             printf("%f %e %d\n", k, Pk, obs);
         }
 
-        fftw_destroy_plan(r2c);
-        fftw_destroy_plan(c2r);
-        fftw_free(fbox);
-
         printf("\n");
     }
-    //
-    //
-    // if (strcmp(tp.Identifier, "ncdm") == 0) {
-    //     /* Calculate the cross spectrum */
-    //     printf("Doing the (c,nu) cross spectrum.\n");
-    //
-    //     /* Reset the bins */
-    //     for (int i=0; i<bins; i++) {
-    //         k_in_bins[i] = 0;
-    //         power_in_bins[i] = 0;
-    //         obs_in_bins[i] = 0;
-    //     }
-    //
-    //     /* Cross spectrum of cdm and ncdm */
-    //     calc_cross_powerspec(N, boxlen[0], fbox_c, fbox, bins, k_in_bins, power_in_bins, obs_in_bins);
-    //
-    //     /* Print the results */
-    //     printf("k P_measured(k) observations\n");
-    //     for (int i=0; i<bins; i++) {
-    //         if (obs_in_bins[i] == 0) continue; //skip empty bins
-    //
-    //         /* The power we observe */
-    //         double k = k_in_bins[i];
-    //         double Pk = power_in_bins[i];
-    //         int obs = obs_in_bins[i];
-    //
-    //         printf("%f %e %d\n", k, Pk, obs);
-    //     }
-    //
-    //     printf("\n");
-    //
-    //     free(k_in_bins);
-    //     free(power_in_bins);
-    //     free(obs_in_bins);
-    // }
-
-
-    // /* Transform back */
-    // fft_execute(c2r);
-	// fft_normalize_c2r(box,N,boxlen[0]);
-    //
-    // /* Export the density box for testing purposes */
-    // char box_fname[40];
-    // sprintf(box_fname, "density_%s.hdf5", tp.Identifier);
-    // writeFieldFile(box, N, boxlen[0], box_fname);
-    // printf("Density grid exported to %s.\n", box_fname);
-    //
-    fftw_free(box);
-    // free(rho_interlaced_box);
-    // fftw_free(fbox);
-    // }
+
+    free(k_in_bins);
+    free(power_in_bins);
+    free(obs_in_bins);
+
+    /* Free the grid */
+    free_local_grid(&grid);
 
     /* Close the HDF5 file */
     H5Fclose(h_file);
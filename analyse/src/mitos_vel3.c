@@ -157,7 +157,7 @@ int main(int argc, char *argv[]) {
 
         /* Define the hyperslab */
         hsize_t slab_dims[2], start[2]; //for 3-vectors
-        hsize_t slab_dims_one[1], start_one[1]; //for scalars
+        hsize_t start_one[1]; //for scalars
 
         /* Slab dimensions for 3-vectors */
         slab_dims[0] = slab_size;
@@ -166,7 +166,6 @@ int main(int argc, char *argv[]) {
         start[1] = 0; //start with x
 
         /* Slab dimensions for scalars */
-        slab_dims_one[0] = slab_size;
         start_one[0] = k * max_slab_size;
 
         /* Open the coordinates dataset */
@@ -199,33 +198,13 @@ int main(int argc, char *argv[]) {
         H5Dclose(h_dat);
 
 
-        /* Open the masses dataset */
-        h_dat = H5Dopen(h_grp, "Masses", H5P_DEFAULT);
-
-        /* Find the dataspace (in the file) */
-        h_space = H5Dget_space (h_dat);
-
-        /* Select the hyperslab */
-        status = H5Sselect_hyperslab(h_space, H5S_SELECT_SET, start_one, NULL,
-                                            slab_dims_one, NULL);
-
-        /* Create a memory space */
-        h_mems = H5Screate_simple(1, slab_dims_one, NULL);
-
-        /* Create the data array */
+        /* Read the masses, from the MassTable if there is no Masses dataset */
         double mass_data[slab_size];
-
-        status = H5Dread(h_dat, H5T_NATIVE_DOUBLE, h_mems, h_space, H5P_DEFAULT,
-                         mass_data);
-
-        /* Close the memory space */
-        H5Sclose(h_mems);
-
-        /* Close the data and memory spaces */
-        H5Sclose(h_space);
-
-        /* Close the dataset */
-        H5Dclose(h_dat);
+        int mass_err = readParticleMasses(h_file, pars.ImportName, start_one[0],
+                                          slab_size, mass_data);
+        if (mass_err > 0) {
+            MPI_Abort(MPI_COMM_WORLD, mass_err);
+        }
 
 
          /* Open the velocities dataset */
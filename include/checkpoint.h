@@ -0,0 +1,66 @@
+/*******************************************************************************
+ * This file is part of Mitos.
+ * Copyright (c) 2020 Willem Elbers (whe@willemelbers.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <mpi.h>
+
+#include "input.h"
+#include "particle_types.h"
+
+/* The manifest of completed stages, in the output directory */
+#define CHECKPOINT_MANIFEST "checkpoint.ini"
+
+/* Sections of the manifest. The grids do not depend on the number of ranks,
+ * but the layout of the particle files does. */
+#define CHECKPOINT_GRIDS "Grids"
+#define CHECKPOINT_PARTICLES "Particles"
+
+/* Completed stages are recorded in an ini file, together with a hash of the
+ * parameter file. With Output:Restart, a new run with the same parameters
+ * skips the stages that were completed, after validating the files that
+ * were written. The functions below are collective over comm. */
+struct checkpoint {
+    /* The manifest file */
+    char fname[DEFAULT_STRING_LENGTH];
+    /* Hash of the parameter file (hexadecimal) */
+    char hash[17];
+    /* Whether completed stages of a previous run may be skipped */
+    char restart;
+    /* Dimensions of the Gaussian random field of the previous run */
+    int N;
+    double boxlen;
+    /* The communicator and the rank within it */
+    MPI_Comm comm;
+    int rank;
+};
+
+int initCheckpoint(struct checkpoint *cp, const struct params *pars,
+                   const char *param_fname, MPI_Comm comm);
+int markCheckpoint(const struct checkpoint *cp, const char *section, const char *key);
+int markGaussianField(struct checkpoint *cp, int N, double boxlen);
+
+/* Whether the stages can be skipped */
+int skipGaussianField(const struct checkpoint *cp, const struct params *pars);
+int skipPerturbationGrids(const struct checkpoint *cp, const struct params *pars,
+                          const struct particle_type *ptype);
+int skipParticleStage(const struct checkpoint *cp, const char *key);
+
+#endif
@@ -59,16 +59,40 @@ struct distributed_grid {
      */
 };
 
-struct left_right_slice {
-    double *left_slice;
-    double *local_slice;
-    double *right_slice;
-    int left_NX;
-    int left_X0;
-    int local_NX;
-    int local_X0;
-    int right_NX;
-    int right_X0;
+/* Number of periodically padded cells on either side of the Y and Z
+ * dimensions of a ghost slab. This must cover the reach of the widest
+ * interpolation stencil (PCS: -1 to +2 cells around the base cell). */
+#define GHOST_SLAB_PADDING 2
+
+/* When the grid is distributed over several MPI nodes, we may need to
+ * access cells that lie beyond the range of the current grid. A ghost slab
+ * stores the local slice, together with ghost rows on the left and right in
+ * the X-direction, in one contiguous array. The Y and Z dimensions are
+ * periodically padded, such that stencils can be read as plain offsets from
+ * the base pointer without any wrapping or bounds checks. */
+struct ghost_slab {
+    /* Global dimension of the grid */
+    int N;
+
+    /* The local slice corresponds to X0 <= X < X0 + NX */
+    int X0;
+    int NX;
+
+    /* Number of ghost rows on either side in the X-direction */
+    int ghost_NX;
+
+    /* Number of padded cells on either side in the Y and Z directions */
+    int pad;
+
+    /* Strides (in doubles) of the X and Y dimensions of the padded array */
+    long int stride_x;
+    long int stride_y;
+
+    /* The padded array (NX + 2 * ghost_NX) * (N + 2 * pad) * (N + 2 * pad) */
+    double *data;
+
+    /* Pointer to the cell with local coordinates (0, 0, 0) inside data */
+    double *base;
 };
 
 int alloc_local_grid(struct distributed_grid *dg, int N, double boxlen, MPI_Comm comm);
@@ -76,6 +100,10 @@ int free_local_grid(struct distributed_grid *dg);
 int free_local_real_grid(struct distributed_grid *dg);
 int free_local_complex_grid(struct distributed_grid *dg);
 
+int alloc_ghost_slab(struct ghost_slab *gs, int N, int X0, int NX, int ghost_NX);
+int free_ghost_slab(struct ghost_slab *gs);
+int fill_ghost_slab_padding(struct ghost_slab *gs);
+
 static inline int row_major_dg(int i, int j, int k, const struct distributed_grid *dg) {
     /* Wrap global coordinates */
     i = wrap(i,dg->N);
@@ -20,23 +20,71 @@
 #ifndef FIREBOLT_INTERFACE_H
 #define FIREBOLT_INTERFACE_H
 
+#include <mpi.h>
 #include <fftw3.h>
 #include <firebolt_nano.h>
 #include "input.h"
 #include "perturb_data.h"
 
+/* Number of parameters that determine a Firebolt solution (see fireboltKey) */
+#define FIREBOLT_KEY_LENGTH 27
+
+/* The state of the Firebolt Boltzmann code for one neutrino species. After
+ * initFirebolt, it is only read, so fireboltDensity can be called from
+ * multiple threads at once. The grids can be shared by the ranks on a node
+ * with allocFireboltGrids_MPI and shareFireboltGrids_MPI. */
 struct firebolt_interface {
-    struct grids *grids_ref;
+    /* Multipoles in the Legendre and monomial bases, and gauge transforms
+     * (only used during initFirebolt) */
+    struct multipoles mL;
+    struct multipoles mmono;
+    struct multipoles mgauge;
+    /* Grids of the monomial multipoles for each momentum bin */
+    struct grids grs;
+    int N;
+    int l_size;
+    double boxlen;
+    /* Shared memory window holding the grids, if shared_grids is set */
+    MPI_Win grids_win;
+    char shared_grids;
+    /* The momentum range */
     int q_size;
     double log_q_min;
     double log_q_max;
+    /* The parameters that determined this solution */
+    double key[FIREBOLT_KEY_LENGTH];
 };
 
+int fireboltGridSize(const struct params *pars);
+void fireboltKey(const struct params *pars, const struct cosmology *cosmo,
+                 const struct perturb_data *ptdat, double M_nu_eV,
+                 double T_nu_eV, const double *field, long int field_size,
+                 double *key);
+int fireboltKeyMatches(const struct firebolt_interface *firebolt,
+                       const double *key);
+
 int initFirebolt(const struct params *pars, const struct cosmology *cosmo,
                  const struct units *us, const struct perturb_data *ptdat,
                  const struct perturb_spline *spline,
                  struct firebolt_interface *firebolt, const fftw_complex *grf,
-                 double M_nu_eV, double T_nu_eV);
-int cleanFirebolt(void);
+                 double M_nu_eV, double T_nu_eV, const double *key);
+int allocFireboltGrids_MPI(struct firebolt_interface *firebolt,
+                           const struct params *pars, int root, MPI_Comm comm);
+int shareFireboltGrids_MPI(struct firebolt_interface *firebolt, int root,
+                           MPI_Comm comm);
+int cleanFirebolt(struct firebolt_interface *firebolt);
+int writeFireboltCache(const struct firebolt_interface *firebolt,
+                       const char *fname);
+int readFireboltCache(const struct params *pars, const double *key,
+                      struct firebolt_interface *firebolt, const char *fname);
+
+/* The phase space density perturbation at position (x,y,z), direction
+ * (nx,ny,nz), and momentum q, using perturbations up to the given order */
+static inline double fireboltDensity(const struct firebolt_interface *firebolt,
+                                     double x, double y, double z, double nx,
+                                     double ny, double nz, double q, int mode) {
+    return evalDensity(&firebolt->grs, firebolt->q_size, firebolt->log_q_min,
+                       firebolt->log_q_max, x, y, z, nx, ny, nz, q, mode);
+}
 
 #endif
@@ -23,6 +23,11 @@
 #include "fft.h"
 #include "distributed_grid.h"
 
+/* Number of particles per block in the batched interpolation methods. The
+ * blocks are processed with AVX-512 or AVX2 gathers if available at compile
+ * time (e.g. with -march=native) and with a scalar loop otherwise. */
+#define INTERP_BATCH 8
+
 /* Interpolation methods for contiguous arrays */
 double gridNGP(const double *box, int N, double boxlen, double x, double y, double z);
 double gridCIC(const double *box, int N, double boxlen, double x, double y, double z);
@@ -30,11 +35,30 @@ double gridTSC(const double *box, int N, double boxlen, double x, double y, doub
 double gridPCS(const double *box, int N, double boxlen, double x, double y, double z);
 
 /* Interpolation methods for distributed grids */
-double access_grid(struct left_right_slice *lrs, int iX, int iY, int iZ, int N);
-double gridNGP_dg(struct left_right_slice *lrs, double x, double y, double z, double boxlen, int N);
-double gridCIC_dg(struct left_right_slice *lrs, double x, double y, double z, double boxlen, int N);
-double gridTSC_dg(struct left_right_slice *lrs, double x, double y, double z, double boxlen, int N);
-double gridPCS_dg(struct left_right_slice *lrs, double x, double y, double z, double boxlen, int N);
+double gridNGP_dg(const struct ghost_slab *gs, double x, double y, double z, double boxlen);
+double gridCIC_dg(const struct ghost_slab *gs, double x, double y, double z, double boxlen);
+double gridTSC_dg(const struct ghost_slab *gs, double x, double y, double z, double boxlen);
+double gridPCS_dg(const struct ghost_slab *gs, double x, double y, double z, double boxlen);
+
+/* Batched interpolation methods for n particles at (x[i], y[i], z[i]) */
+void gridCIC_batch(const double *box, int N, double boxlen, int n,
+                   const double *x, const double *y, const double *z,
+                   double *out);
+void gridTSC_batch(const double *box, int N, double boxlen, int n,
+                   const double *x, const double *y, const double *z,
+                   double *out);
+void gridPCS_batch(const double *box, int N, double boxlen, int n,
+                   const double *x, const double *y, const double *z,
+                   double *out);
+void gridCIC_dg_batch(const struct ghost_slab *gs, double boxlen, int n,
+                      const double *x, const double *y, const double *z,
+                      double *out);
+void gridTSC_dg_batch(const struct ghost_slab *gs, double boxlen, int n,
+                      const double *x, const double *y, const double *z,
+                      double *out);
+void gridPCS_dg_batch(const struct ghost_slab *gs, double boxlen, int n,
+                      const double *x, const double *y, const double *z,
+                      double *out);
 
 /* Apply Fourier kernels to undo the window functions */
 int undoNGPWindow(fftw_complex *farr, int N, double boxlen);
@@ -26,7 +26,7 @@
 
 int writeHeaderAttributes(struct params *pars, struct cosmology *cosmo,
                           struct units *us, struct particle_type **types,
-                          hid_t h_file);
+                          const long long int *file_counts, hid_t h_file);
 
 int writeSwiftParameterFile(struct params *pars, struct cosmology *cosmo,
                             struct units *us, struct particle_type **types,
@@ -20,6 +20,8 @@
 #ifndef INPUT_H
 #define INPUT_H
 
+#include <string.h>
+
 #define DEFAULT_STRING_LENGTH 150
 
 #define KM_METRES 1000
@@ -33,6 +35,8 @@
 
 /* The .ini parser library is minIni */
 #include "../parser/minIni.h"
+/* Parameter files parsed once into a table */
+#include "../include/param_table.h"
 #include "../include/output.h"
 
 struct params {
@@ -46,6 +50,11 @@ struct params {
     int Splits; //for folding & position dependent power spectra
     /* Number of neighbour rows held by each MPI rank for CIC, TSC, ... */
     int NeighbourSliverSize;
+    /* Sort particles by grid cell before interpolating velocities */
+    char SortParticlesByCell;
+    /* Memory per MPI rank for the particles and grids of the particle stage
+     * in MB (0 = no limit) */
+    long int ParticleMemoryMB;
 
     /* Simulation parameters */
     char *Name;
@@ -60,11 +69,36 @@ struct params {
     char *SecondPerturbFile;
     char GrowthFactorsFromSecondFile;
     char MergeDarkMatterBaryons;
+    /* Read only the needed transfer functions, optionally only at late times */
+    char SelectiveLoading;
+    char RestrictTimeRange;
 
     /* Output parameters */
     char *OutputDirectory;
     char *OutputFilename;
     char *SwiftParamFilename;
+    /* Summary of the stage timers (relative to the directory, empty = none) */
+    char *TimingsFilename;
+    /* Synchronize the ranks before communication to measure wait times */
+    char ProfileMPI;
+    /* Skip the stages that were completed by a previous run */
+    char Restart;
+    /* Store uniform particle masses in the MassTable instead of a dataset */
+    char UseMassTable;
+    /* Parallel I/O settings for the particle file (0 = library default) */
+    char CollectiveIO;
+    int StripingFactor;
+    long int StripingUnit;
+    int CollectiveBufferingNodes;
+    long int CollectiveBufferSize;
+    long int Alignment;
+    /* Number of files over which the particle data are split */
+    int NumFilesPerSnapshot;
+    /* Deflate level (0 = no compression) and shuffle filter for the output */
+    int CompressionLevel;
+    char Shuffle;
+    /* Write particle data in a background thread, overlapping computation */
+    char AsyncWrite;
 
     /* Input parameters */
     char *InputFilename;
@@ -89,6 +123,7 @@ struct params {
     double MaxMomentum;
     double FireboltTolerance;
     short FireboltVerbose;
+    char *FireboltCacheFile;
 
     /* MPI rank (generated automatically) */
     int rank;
@@ -140,6 +175,8 @@ int cleanParams(struct params *parser);
 int readFieldFile(double **box, int *N, double *box_len, const char *fname);
 int readFieldFileInPlace(double *box, const char *fname);
 int readFieldDimensions(int *N, double *box_len, const char *fname);
+int readParticleMasses(hid_t h_file, const char *group_name, hsize_t start,
+                       hsize_t count, double *masses);
 
 static inline void generateFieldFilename(const struct params *pars, char *fname,
                                          const char *Identifier, const char *title,
@@ -148,5 +185,20 @@ static inline void generateFieldFilename(const struct params *pars, char *fname,
             Identifier, "hdf5");
 }
 
+/* Name of the particle output file with a given index. When the output is
+ * split over multiple files, these are numbered as name.i.hdf5 */
+static inline void generateOutputFilename(const struct params *pars, char *fname,
+                                          int file_id) {
+    strcpy(fname, pars->OutputFilename);
+    if (pars->NumFilesPerSnapshot > 1) {
+        char *extension = strrchr(fname, '.');
+        char *slash = strrchr(fname, '/');
+        if (extension != NULL && extension > slash && strcmp(extension, ".hdf5") == 0) {
+            *extension = '\0';
+        }
+        sprintf(fname + strlen(fname), ".%d.hdf5", file_id);
+    }
+}
+
 
 #endif
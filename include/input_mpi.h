@@ -21,9 +21,14 @@
 #define INPUT_MPI_H
 
 #include "../include/output_mpi.h"
+#include "../include/perturb_data.h"
 
 int readField_MPI(double *data, int N, int NX, int X0, MPI_Comm comm,
                   const char *fname);
 int readFieldFile_dg(struct distributed_grid *dg, const char *fname);
+int readGhostSlab_MPI(struct ghost_slab *gs, MPI_Comm comm, const char *fname);
+int broadcastPerturb_MPI(struct perturb_data *pt, int root, MPI_Comm comm);
+int readParamTable_MPI(struct param_table *pt, const char *fname, int root,
+                       MPI_Comm comm);
 
 #endif
@@ -0,0 +1,49 @@
+/*******************************************************************************
+ * This file is part of Mitos.
+ * Copyright (c) 2020 Willem Elbers (whe@willemelbers.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#ifndef LIBMITOS_H
+#define LIBMITOS_H
+
+#include <mpi.h>
+
+#include "particle.h"
+#include "particle_types.h"
+
+/* Receives a sub-chunk of the particles generated on this rank, with final
+ * positions and velocities in internal units. The particle data are freed
+ * after the call, so they must be copied if needed later. All ranks make the
+ * same number of calls for each particle type (some possibly with
+ * parts->num = 0), so the callback may use collective communication. A
+ * positive return value is an error, which stops runMitos on all ranks. */
+typedef int (*particle_callback)(const struct particle_data *parts,
+                                 const struct particle_type *ptype,
+                                 void *user_data);
+
+/* Generate initial conditions for a parameter file, distributed over the
+ * ranks of comm. MPI must be initialized by the caller, preferably with
+ * MPI_THREAD_SERIALIZED support for background writes. Without a callback,
+ * the particles are written to the output file, as done by the mitos
+ * executable. With a callback, the particles are handed to it instead and
+ * no particle file is written. Returns 0 on success. After an error on any
+ * rank, including an error returned by the callback, all ranks release what
+ * was allocated and return the largest error code. */
+int runMitos(const char *param_fname, MPI_Comm comm,
+             particle_callback callback, void *user_data);
+
+#endif
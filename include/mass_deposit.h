@@ -0,0 +1,38 @@
+/*******************************************************************************
+ * This file is part of Mitos.
+ * Copyright (c) 2020 Willem Elbers (whe@willemelbers.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#ifndef MASS_DEPOSIT_H
+#define MASS_DEPOSIT_H
+
+#include "distributed_grid.h"
+
+/* Number of rows beyond the local slice that are reached by the TSC kernel */
+#define MASS_DEPOSIT_GHOST_ROWS 2
+
+/* Add the mass densities of particles to a distributed grid with TSC. Each
+ * rank may pass any particles (positions as x,y,z triples). The particles
+ * are first sent to the rank whose slice contains them. Contributions to the
+ * rows of neighbouring slices are then sent to the ranks that own them.
+ * This is collective over the communicator of the grid. Since MPI counts are
+ * ints, an error is returned on all ranks if a rank passes or receives more
+ * than INT_MAX particles. */
+int massDepositTSC_dg(struct distributed_grid *dg, const double *pos,
+                      const double *mass, long long int num);
+
+#endif
@@ -43,14 +43,16 @@ static inline void message(int rank, const char *format, ...) {
     }
 }
 
-static inline void catch_error(int err, const char *format, ...) {
+/* Print the message if err > 0 and pass on the error code */
+static inline int catch_error(int err, const char *format, ...) {
     if (err > 0) {
         va_list args;
         va_start(args, format);
         vprintf(format, args);
         va_end(args);
-        exit(err);
     }
+
+    return err;
 }
 
 
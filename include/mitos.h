@@ -21,12 +21,14 @@
 #define MITOS_H
 
 
+#include "param_table.h"
 #include "input.h"
 #include "output.h"
 #include "input_mpi.h"
 #include "output_mpi.h"
 #include "distributed_grid.h"
 #include "header.h"
+#include "timers.h"
 #include "random.h"
 #include "fft.h"
 #include "grf.h"
@@ -34,7 +36,9 @@
 #include "particle_types.h"
 #include "titles.h"
 #include "particle.h"
+#include "particle_output.h"
 #include "calc_powerspec.h"
+#include "mass_deposit.h"
 #include "primordial.h"
 #include "generate_grids.h"
 #include "shrink_grids.h"
@@ -46,6 +50,8 @@
 #include "grids_interp.h"
 #include "perturb_data.h"
 #include "perturb_spline.h"
+#include "checkpoint.h"
+#include "libmitos.h"
 
 #include "message.h"
 
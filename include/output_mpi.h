@@ -21,16 +21,35 @@
 #define OUTPUT_MPI_H
 
 #define HDF5_PARALLEL_IO_MAX_BYTES 2000000000LL
+#define HDF5_PARTICLE_CHUNK_ROWS 1048576
 
 #include <mpi.h>
 #include <hdf5.h>
 
 #include "distributed_grid.h"
+#include "input.h"
 
 /* General methods */
 hid_t openFile_MPI(MPI_Comm comm, const char *fname);
 hid_t createFile_MPI(MPI_Comm comm, const char *fname);
 
+/* Methods for writing large files with tuned MPI-IO settings */
+MPI_Info createIOHints_MPI(const struct params *pars);
+hid_t createFileTuned_MPI(MPI_Comm comm, const char *fname, const struct params *pars);
+hid_t createTransferList_MPI(const struct params *pars);
+int writeDatasetTimed_MPI(hid_t h_data, hid_t mem_type, hid_t h_mspace,
+                          hid_t h_fspace, hid_t h_xfer, const void *buf,
+                          double *seconds, long long int *bytes);
+void reportIOThroughput_MPI(MPI_Comm comm, const char *name, double seconds,
+                            long long int bytes);
+
+/* Methods for chunked and compressed datasets */
+void setOutputFilters_MPI(const struct params *pars);
+hid_t createDatasetList_MPI(int rank, const hsize_t *dims, hsize_t chunk_rows);
+int writeRows_MPI(MPI_Comm comm, hid_t h_data, hid_t mem_type, hid_t h_xfer,
+                  hsize_t first_row, hsize_t num_rows, const void *buf,
+                  double *seconds, long long int *bytes);
+
 /* Methods for distributed grids (analogous to non-MPI versions in output.h) */
 int createFieldGroup_dg(int N, int NX, hid_t h_file);
 int writeFieldData_dg(struct distributed_grid *dg, hid_t h_file);
@@ -0,0 +1,69 @@
+/*******************************************************************************
+ * This file is part of Mitos.
+ * Copyright (c) 2020 Willem Elbers (whe@willemelbers.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#ifndef PARAM_TABLE_H
+#define PARAM_TABLE_H
+
+/* Key-value pair of a parameter file. The strings point into the buffer of
+ * the table. */
+struct param_entry {
+    const char *section;
+    const char *key;
+    const char *value;
+    /* Next entry in the same hash bucket (-1 = none) */
+    int next;
+};
+
+/* The parameters of an .ini file, parsed once and stored in a hash table.
+ * Lookups follow the rules of minIni: section and key names are case
+ * insensitive, only the first occurrence of a section and of a key counts,
+ * and comments and surrounding quotes are removed from the values. */
+struct param_table {
+    /* The parameter file */
+    char *fname;
+    /* Contents of the file, split into the strings of the entries */
+    char *buffer;
+    /* The entries and the first entry of each hash bucket (-1 = none) */
+    struct param_entry *entries;
+    int num_entries;
+    int *buckets;
+    int num_buckets;
+};
+
+int readParamFile(const char *fname, char **buffer, long int *size);
+int parseParamTable(struct param_table *pt, const char *fname, char *buffer);
+int readParamTable(struct param_table *pt, const char *fname);
+int cleanParamTable(struct param_table *pt);
+const char *paramTableLookup(const struct param_table *pt, const char *section,
+                             const char *key);
+
+/* Readers of a parameter file use the table for that file, if one has been
+ * set, and otherwise read the file with minIni (pt may be NULL) */
+void setParamTable(const struct param_table *pt);
+
+int paramGets(const char *section, const char *key, const char *def,
+              char *buffer, int size, const char *fname);
+long int paramGetl(const char *section, const char *key, long int def,
+                   const char *fname);
+double paramGetd(const char *section, const char *key, double def,
+                 const char *fname);
+int paramGetbool(const char *section, const char *key, int def,
+                 const char *fname);
+
+#endif
@@ -22,26 +22,56 @@
 
 #include "mitos.h"
 
-struct particle {
-    float X,Y,Z;
-    float v_X, v_Y, v_Z;
-    float mass;
-    long long int id;
-};
+/* Precision of the particle positions. In single precision, positions near
+ * the edge of a 1 Gpc box are only resolved to ~60 pc. Compile with
+ * -DSINGLE_PRECISION_POSITIONS to halve the memory used for positions. */
+#ifdef SINGLE_PRECISION_POSITIONS
+typedef float pos_t;
+#define H5T_NATIVE_POS H5T_NATIVE_FLOAT
+#else
+typedef double pos_t;
+#define H5T_NATIVE_POS H5T_NATIVE_DOUBLE
+#endif
 
-int allocParticles(struct particle **particles, const struct params *pars,
-                   const struct particle_type *ptype);
+/* Particle data stored as a structure of arrays. Vector quantities are
+ * stored as contiguous num x 3 arrays, matching the layout of the datasets
+ * in the output file, such that they can be written without copying. The
+ * masses are the same for all particles of a given type and not stored. */
+struct particle_data {
+    long long int num;
+    pos_t *pos;
+    float *vel;
+    long long int *id;
+};
 
-int cleanParticles(struct particle **particles, const struct params *pars,
-                   const struct particle_type *ptype);
+int allocParticles(struct particle_data *parts, long long int num);
+int cleanParticles(struct particle_data *parts);
 
-int genParticles_FromGrid(struct particle **particles, const struct params *pars,
+int genParticles_FromGrid(struct particle_data *parts, const struct params *pars,
                           const struct units *us, const struct cosmology *cosmo,
                           const struct particle_type *ptype, int chunk,
                           long long int id_first_particle);
 
-int genParticlesFromGrid_local(struct particle **particles, const struct params *pars,
+int genParticlesFromGrid_local(struct particle_data *parts, const struct params *pars,
                                const struct units *us, const struct cosmology *cosmo,
                                const struct particle_type *ptype, int MX, int X_min,
                                int offset, long long int id_first_particle);
+
+int genParticlesFromGrid_range(struct particle_data *parts, const struct params *pars,
+                               const struct particle_type *ptype, long long int first,
+                               long long int id_first_particle);
+
+size_t particleStageBytes(char sort);
+
+long long int localParticleNumber(const struct particle_type *ptype, int N,
+                                  int X0, int NX);
+void particleGridRows(const struct particle_type *ptype, int N,
+                      long long int first, long long int num, int *X0, int *NX);
+int maxParticleGridRows(const struct particle_type *ptype, int N,
+                        long long int num);
+
+int sortParticlesByCell(struct particle_data *parts, long long int *order,
+                        int N, double boxlen, int X0, int NX, int ghost_NX);
+
+int unsortParticles(struct particle_data *parts, const long long int *order);
 #endif
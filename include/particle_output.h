@@ -0,0 +1,73 @@
+/*******************************************************************************
+ * This file is part of Mitos.
+ * Copyright (c) 2020 Willem Elbers (whe@willemelbers.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#ifndef PARTICLE_OUTPUT_H
+#define PARTICLE_OUTPUT_H
+
+/* Number of particles per sub-chunk in the particle stage, unless limited
+ * by ParticleMemoryMB or the ChunkSize of the particle type */
+#define DEFAULT_PARTICLE_SUBCHUNK_SIZE 16777216
+
+#include <pthread.h>
+#include <mpi.h>
+#include <hdf5.h>
+
+struct particle_data;
+
+/* The particle datasets, in the order used for the timings */
+enum particle_dataset {
+    DATASET_COORDINATES,
+    DATASET_VELOCITIES,
+    DATASET_IDS,
+    DATASET_MASSES,
+    NUM_PARTICLE_DATASETS
+};
+
+/* A write of a sub-chunk of particles to an export group. The write is
+ * collective over comm and can run in a background thread, provided that
+ * no other thread makes HDF5 or MPI calls until it has been finished. */
+struct particle_write {
+    /* The export group, transfer property list, and writer communicator */
+    hid_t h_grp;
+    hid_t h_xfer;
+    MPI_Comm comm;
+    /* The particles and the row of the first particle in the group */
+    struct particle_data *parts;
+    hsize_t first_row;
+    /* The uniform mass, written unless the group has no Masses dataset */
+    double mass;
+
+    /* Time spent and bytes written for each dataset (accumulated) */
+    double seconds[NUM_PARTICLE_DATASETS];
+    long long int bytes[NUM_PARTICLE_DATASETS];
+
+    /* State of the background thread */
+    pthread_t thread;
+    char running;
+    int err;
+};
+
+extern const char *particle_dataset_names[NUM_PARTICLE_DATASETS];
+
+int createParticleDatasets(hid_t h_grp, hsize_t num, char with_masses);
+int writeParticles_MPI(struct particle_write *pw);
+int startParticleWrite_MPI(struct particle_write *pw, char async);
+int finishParticleWrite_MPI(struct particle_write *pw);
+
+#endif
@@ -31,7 +31,7 @@ struct particle_type {
     long long int TotalNumber;
     int CubeRootNumber;
     int Chunks;
-    int ChunkSize; //except possibly the last chunk
+    long long int ChunkSize; //except possibly the last chunk
     int CyclesOfMongeAmpere;
     int CyclesOfSPT;
     int Run2LPT;
@@ -73,5 +73,9 @@ int retrieveMicroMasses(struct params *pars, struct cosmology *cosmo,
 
 int fillExportGroups(struct params *pars, struct particle_type **tps, struct export_group **grps);
 int cleanExportGroups(struct params *pars, struct export_group **grps);
+char exportGroupUniformMass(const struct params *pars, struct particle_type **tps,
+                            const char *ExportName, double *mass);
+int requiredTransferTitles(const struct params *pars, struct particle_type **tps,
+                           char ***titles, int *n_titles);
 
 #endif
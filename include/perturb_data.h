@@ -22,6 +22,9 @@
 
 #include "input.h"
 
+/* Number of time steps retained before the start of a restricted window */
+#define PERTURB_TIME_WINDOW_MARGIN 4
+
 /* Data structure containing all cosmological perturbation transfer functions
  * T(k, log_tau) as a function of wavenumber and logarithm of conformal time.
  */
@@ -72,6 +75,11 @@ struct perturb_params {
 int readPerturb(const struct params *pars, const struct units *us,
                 struct perturb_data *pt, char *fname);
 
+/* Read selected transfer functions, optionally only at times after z_max */
+int readPerturbSelection(const struct params *pars, const struct units *us,
+                         struct perturb_data *pt, char *fname,
+                         char **select_titles, int n_select, double z_max);
+
 /* Clean up the memory */
 int cleanPerturb(struct perturb_data *pt);
 
@@ -29,10 +29,24 @@ struct perturb_spline {
     const struct perturb_data *ptdat;
 
     /* Search table for interpolation acceleration in the k direction */
-    double *k_acc_table;
+    int *k_acc_table;
 
     /* Size of the k acceleration table */
     int k_acc_table_size;
+
+    /* Whether the table is uniform in log(k) or in k */
+    char k_acc_log;
+
+    /* Left edge and inverse cell width of the table in log(k) or k */
+    double k_acc_min;
+    double k_acc_inv_width;
+};
+
+/* Last-hit indices for a sequence of lookups at nearby points. Zero-initialize
+ * before use. The spline itself is read-only, so each thread needs its own. */
+struct perturb_spline_cursor {
+    int tau_index;
+    int k_index;
 };
 
 /* Initialize the perturbation spline */
@@ -51,6 +65,16 @@ int perturbSplineFindTau(const struct perturb_spline *spline, double log_tau,
 int perturbSplineFindK(const struct perturb_spline *spline, double k, int *index,
                        double *u);
 
+/* Find index along the time direction, trying the last hit first */
+int perturbSplineFindTauCursor(const struct perturb_spline *spline,
+                               struct perturb_spline_cursor *cursor,
+                               double log_tau, int *index, double *u);
+
+/* Find index along the k direction, trying the last hit first */
+int perturbSplineFindKCursor(const struct perturb_spline *spline,
+                             struct perturb_spline_cursor *cursor, double k,
+                             int *index, double *u);
+
 /* Bilinear interpolation of the desired transfer function */
 double perturbSplineInterp(const struct perturb_spline *spline, int k_index,
                            int tau_index, double u_k, double u_tau,
@@ -60,6 +84,11 @@ double perturbSplineInterp(const struct perturb_spline *spline, int k_index,
 double perturbSplineInterp0(const struct perturb_spline *spline, double k,
                             double log_tau, int index_src);
 
+/* Bilinear interpolation, using a cursor for a sequence of nearby points */
+double perturbSplineInterpCursor(const struct perturb_spline *spline,
+                                 struct perturb_spline_cursor *cursor, double k,
+                                 double log_tau, int index_src);
+
 /* Linear interpolation of the redshift vector */
 double perturbRedshiftAtLogTau(const struct perturb_spline *spline, double log_tau);
 
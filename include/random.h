@@ -32,9 +32,20 @@ static inline rng_state rand_uint64_init(uint64_t seed) {
     return xoshiro256ss_init(seed);
 }
 
+/* Initialize an independent random stream identified by a key (e.g. a
+ * particle id), such that the numbers drawn do not depend on the order in
+ * which the streams are used, or by which thread or rank */
+static inline rng_state rand_uint64_init_stream(uint64_t seed, uint64_t key) {
+    struct splitmix64_state smstate = {key};
+    return xoshiro256ss_init(seed ^ splitmix64(&smstate));
+}
+
 #define SEARCH_TABLE_LENGTH 1000
 #define NUMERICAL_CDF_SAMPLES 1000
 
+#define INVERSE_CDF_TABLE_LENGTH 16384
+#define INVERSE_CDF_PDF_SAMPLES 262144
+
 #define THERMAL_MIN_MOMENTUM 1e-10 //don't use exactly zero
 #define THERMAL_MAX_MOMENTUM 15.0
 #define FERMION_TYPE "fermion"
@@ -80,6 +91,18 @@ struct sampler {
     double *index;
 };
 
+/* A sampler based on a tabulated inverse cdf, F^-1(i / n) for i <= n */
+struct table_sampler {
+    /* The endpoints */
+    double xl, xr;
+
+    /* Number of intervals in the table */
+    int n;
+
+    /* The tabulated inverse cdf (n + 1 nodes) */
+    double *x;
+};
+
 /* Compare intervals by the value of the CDF at the left endpoint */
 static inline int compareByLeft(const void *a, const void *b) {
     struct interval *ia = (struct interval*) a;
@@ -108,4 +131,17 @@ int splitInterval(struct sampler *s, int current_interval_id);
 int cleanSampler(struct sampler *s);
 double samplerCustom(struct sampler *s, rng_state *state);
 
+/* Methods for the inverse cdf table sampler */
+int initTableSampler(struct table_sampler *ts, pdf f, double xl, double xr,
+                     void *params);
+int cleanTableSampler(struct table_sampler *ts);
+
+/* Sample from the inverse cdf table with linear interpolation */
+static inline double sampleTable(const struct table_sampler *ts, rng_state *state) {
+    const double u = (rand_uint64(state) >> 11) * 0x1.0p-53; //u in [0, 1)
+    const double t = u * ts->n;
+    const int i = (int) t;
+    return ts->x[i] + (t - i) * (ts->x[i + 1] - ts->x[i]);
+}
+
 #endif
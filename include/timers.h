@@ -0,0 +1,77 @@
+/*******************************************************************************
+ * This file is part of Mitos.
+ * Copyright (c) 2020 Willem Elbers (whe@willemelbers.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#ifndef TIMERS_H
+#define TIMERS_H
+
+#include <mpi.h>
+
+#define MAX_TIMERS 128
+#define MAX_TIMER_DEPTH 16
+#define TIMER_NAME_LENGTH 128
+
+/* Ranks whose work deviates more than this fraction from the mean are
+ * flagged in the load balance report */
+#define LOAD_BALANCE_TOLERANCE 0.1
+/* Maximum number of flagged ranks that are listed for each quantity */
+#define LOAD_BALANCE_MAX_LISTED 16
+
+/* Named wall-clock timers for the stages of a run. A timer started while
+ * another one is running is nested inside it, and its name is prefixed with
+ * that of its parent, e.g. "Perturbation grids/FFT". Times, byte counts, and
+ * calls are inclusive of nested timers. The timers are not thread-safe and
+ * should only be used by the main thread, outside parallel regions. */
+struct timer {
+    char name[TIMER_NAME_LENGTH];
+    double seconds;
+    long long int calls;
+    long long int bytes_read;
+    long long int bytes_written;
+    /* Bytes sent to or received from other ranks in MPI calls (estimate) */
+    long long int bytes_comm;
+    /* Peak resident memory of the process at the end of the stage (kB) */
+    long int peak_rss_kb;
+};
+
+void timerStart(const char *name);
+void timerStop(void);
+void timerAddBytes(long long int bytes_read, long long int bytes_written);
+long int peakMemoryKB(void);
+void resetTimers(void);
+
+/* Timers for MPI communication. The time between commStart and commStop is
+ * recorded in a nested timer with the given name. If profiling is enabled,
+ * the ranks first synchronize at a barrier, timed separately as "Wait", such
+ * that the time spent waiting for slower ranks is separated from the time
+ * of the communication itself. The profiling barriers are collective over
+ * comm, so all ranks in comm must make the same commStart calls. */
+void setProfileMPI(char enabled);
+void commStart(const char *name, MPI_Comm comm);
+void commStop(long long int bytes_exchanged);
+
+/* Compare the work (e.g. slab rows or particles) assigned to each rank and
+ * flag the ranks that deviate from the mean. The result is printed and also
+ * included in the report of reportTimers_MPI. */
+int reportLoadBalance_MPI(MPI_Comm comm, const char *name, double work);
+
+/* Print a summary of the timers, reduced over the ranks, and optionally
+ * write it to a JSON file (fname may be NULL) */
+int reportTimers_MPI(MPI_Comm comm, double total_seconds, const char *fname);
+
+#endif
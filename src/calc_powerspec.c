@@ -89,6 +89,77 @@ void calc_cross_powerspec(int N, double boxlen, const fftw_complex *box1,
 	}
 }
 
+/* Cross power spectrum of two distributed grids in momentum space. Each rank
+ * bins the modes in its own slice, after which the bins are summed across the
+ * communicator of the grids. The results are available on all ranks. */
+void calc_cross_powerspec_dg(const struct distributed_grid *dg1,
+                             const struct distributed_grid *dg2, int bins,
+                             double *k_in_bins, double *power_in_bins,
+                             int *obs_in_bins) {
+
+    const int N = dg1->N;
+    const double boxlen = dg1->boxlen;
+    const double boxvol = boxlen*boxlen*boxlen;
+    const double dk = 2*M_PI/boxlen;
+    const double max_k = sqrt(3)*dk*N/2;
+    const double min_k = dk;
+
+    const double log_max_k = log(max_k);
+    const double log_min_k = log(min_k);
+
+    /* Reset the bins */
+    for (int i=0; i<bins; i++) {
+        k_in_bins[i] = 0;
+        power_in_bins[i] = 0;
+        obs_in_bins[i] = 0;
+    }
+
+    /* Calculate the power spectrum in the local slice */
+    double kx,ky,kz,k;
+    for (int x=dg1->X0; x<dg1->X0 + dg1->NX; x++) {
+        for (int y=0; y<N; y++) {
+            for (int z=0; z<=N/2; z++) {
+                /* Calculate the wavevector */
+                fft_wavevector(x, y, z, N, dk, &kx, &ky, &kz, &k);
+
+                if (k==0) continue; //skip the DC mode
+
+                /* Compute the bin */
+                const float u = (log(k) - log_min_k) / (log_max_k - log_min_k);
+                const int bin = floor((bins - 1) * u);
+                const int id = row_major_half_dg(x, y, z, dg1);
+
+                assert(bin >= 0 && bin < bins);
+
+                /* Compute the power <X,Y> with X,Y complex */
+                double a1 = creal(dg1->fbox[id]), a2 = creal(dg2->fbox[id]);
+                double b1 = cimag(dg1->fbox[id]), b2 = cimag(dg2->fbox[id]);
+                double Power = a1*a2 + b1*b2;
+
+                /* All except the z=0 and the z=N/2 planes count double */
+                int multiplicity = (z==0 || z==N/2) ? 1 : 2;
+
+                /* Add to the tables */
+                k_in_bins[bin] += multiplicity * k;
+                power_in_bins[bin] += multiplicity * Power;
+                obs_in_bins[bin] += multiplicity;
+            }
+        }
+    }
+
+    /* Sum the bins of all ranks */
+    MPI_Allreduce(MPI_IN_PLACE, k_in_bins, bins, MPI_DOUBLE, MPI_SUM, dg1->comm);
+    MPI_Allreduce(MPI_IN_PLACE, power_in_bins, bins, MPI_DOUBLE, MPI_SUM, dg1->comm);
+    MPI_Allreduce(MPI_IN_PLACE, obs_in_bins, bins, MPI_INT, MPI_SUM, dg1->comm);
+
+    /* Divide to obtain averages */
+    for (int i=0; i<bins; i++) {
+        k_in_bins[i] /= obs_in_bins[i];
+        power_in_bins[i] /= obs_in_bins[i];
+        power_in_bins[i] /= boxvol;
+    }
+}
+
 void calc_cross_powerspec_2d(int N, double anglesize, const fftw_complex *box1,
                              const fftw_complex *box2, int bins, double *l_in_bins,
                              double *power_in_bins, int *obs_in_bins) {
@@ -0,0 +1,283 @@
+/*******************************************************************************
+ * This file is part of Mitos.
+ * Copyright (c) 2020 Willem Elbers (whe@willemelbers.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <math.h>
+#include <unistd.h>
+#include <hdf5.h>
+
+#include "../include/checkpoint.h"
+#include "../include/message.h"
+#include "../include/mitos.h"
+
+/* FNV-1a hash of the parameter file, ignoring the Restart setting such that
+ * a run can be restarted by only switching it on */
+static int hashParameterFile(const char *fname, char *hash) {
+    FILE *f = fopen(fname, "r");
+    if (f == NULL) {
+        printf("Error opening parameter file '%s'.\n", fname);
+        return 1;
+    }
+
+    uint64_t h = 14695981039346656037ULL;
+    char line[1024];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        /* Skip the Restart key */
+        const char *c = line;
+        while (isspace(*c)) c++;
+        if (strncmp(c, "Restart", 7) == 0 && (isspace(c[7]) || c[7] == '=')) continue;
+
+        for (c = line; *c; c++) {
+            h ^= (unsigned char) *c;
+            h *= 1099511628211ULL;
+        }
+    }
+    fclose(f);
+
+    sprintf(hash, "%016llx", (unsigned long long) h);
+
+    return 0;
+}
+
+/* Check that a field file exists and has the expected dimensions */
+static int fieldFileValid(const char *fname, int N, double boxlen) {
+    if (access(fname, R_OK) != 0) {
+        printf("Checkpoint file '%s' is missing.\n", fname);
+        return 0;
+    }
+
+    /* Suppress the HDF5 error messages for damaged files */
+    H5E_auto2_t err_func;
+    void *err_data;
+    H5Eget_auto2(H5E_DEFAULT, &err_func, &err_data);
+    H5Eset_auto2(H5E_DEFAULT, NULL, NULL);
+
+    int valid = 0;
+    hid_t h_file = H5Fopen(fname, H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (h_file >= 0) {
+        /* The size of the box */
+        double boxsize[3] = {0., 0., 0.};
+        hid_t h_attr = H5Aopen_by_name(h_file, "Header", "BoxSize", H5P_DEFAULT, H5P_DEFAULT);
+        if (h_attr >= 0) {
+            H5Aread(h_attr, H5T_NATIVE_DOUBLE, boxsize);
+            H5Aclose(h_attr);
+        }
+
+        /* The dimensions of the grid */
+        hsize_t dims[3] = {0, 0, 0};
+        hid_t h_data = H5Dopen2(h_file, "Field/Field", H5P_DEFAULT);
+        if (h_data >= 0) {
+            hid_t h_space = H5Dget_space(h_data);
+            if (H5Sget_simple_extent_ndims(h_space) == 3) {
+                H5Sget_simple_extent_dims(h_space, dims, NULL);
+            }
+            H5Sclose(h_space);
+            H5Dclose(h_data);
+        }
+
+        valid = (dims[0] == (hsize_t) N && dims[1] == (hsize_t) N && dims[2] == (hsize_t) N &&
+                 fabs(boxsize[0] - boxlen) <= 1e-10 * boxlen);
+
+        H5Fclose(h_file);
+    }
+
+    H5Eset_auto2(H5E_DEFAULT, err_func, err_data);
+
+    if (!valid) {
+        printf("Checkpoint file '%s' is invalid.\n", fname);
+    }
+
+    return valid;
+}
+
+/* Whether a stage was recorded in the manifest (only on the first rank) */
+static int stageDone(const struct checkpoint *cp, const char *section, const char *key) {
+    return cp->restart && ini_getl(section, key, 0, cp->fname) > 0;
+}
+
+/* Open the manifest. With restart, a manifest written for the same
+ * parameter file is reused. Otherwise, a new manifest is started. */
+int initCheckpoint(struct checkpoint *cp, const struct params *pars,
+                   const char *param_fname, MPI_Comm comm) {
+    int size;
+    MPI_Comm_rank(comm, &cp->rank);
+    MPI_Comm_size(comm, &size);
+    cp->comm = comm;
+    cp->restart = 0;
+    cp->N = 0;
+    cp->boxlen = 0.;
+    sprintf(cp->fname, "%s/%s", pars->OutputDirectory, CHECKPOINT_MANIFEST);
+
+    int err = 0;
+    if (cp->rank == 0) {
+        err = hashParameterFile(param_fname, cp->hash);
+
+        /* Compare with the previous run */
+        if (!err && pars->Restart) {
+            char previous_hash[17];
+            ini_gets("Run", "ParameterHash", "", previous_hash, sizeof(previous_hash), cp->fname);
+            if (strcmp(previous_hash, cp->hash) == 0) {
+                cp->restart = 1;
+                cp->N = ini_getl("Run", "GridSize", 0, cp->fname);
+                cp->boxlen = ini_getd("Run", "BoxLen", 0., cp->fname);
+                message(cp->rank, "Restarting from the checkpoints in '%s'.\n", cp->fname);
+
+                /* The particle files are split by rank, so completed particle
+                 * stages are only valid for the same number of ranks */
+                long int previous_ranks = ini_getl("Run", "Ranks", 0, cp->fname);
+                if (previous_ranks != size) {
+                    message(cp->rank, "The number of ranks has changed (%ld -> %d); the particle stages will be repeated.\n", previous_ranks, size);
+                    ini_puts(CHECKPOINT_PARTICLES, NULL, NULL, cp->fname);
+                    ini_putl("Run", "Ranks", size, cp->fname);
+                }
+            } else {
+                message(cp->rank, "No checkpoints found for these parameters in '%s'; starting from the beginning.\n", cp->fname);
+            }
+        }
+
+        /* Start a new manifest */
+        if (!err && !cp->restart) {
+            remove(cp->fname);
+            ini_puts("Run", "ParameterHash", cp->hash, cp->fname);
+            ini_putl("Run", "Seed", pars->Seed, cp->fname);
+            ini_putl("Run", "Ranks", size, cp->fname);
+        }
+    }
+
+    MPI_Bcast(&err, 1, MPI_INT, 0, comm);
+    MPI_Bcast(cp->hash, sizeof(cp->hash), MPI_CHAR, 0, comm);
+    MPI_Bcast(&cp->restart, 1, MPI_CHAR, 0, comm);
+    MPI_Bcast(&cp->N, 1, MPI_INT, 0, comm);
+    MPI_Bcast(&cp->boxlen, 1, MPI_DOUBLE, 0, comm);
+
+    return err;
+}
+
+/* Record a completed stage, after all ranks have completed it */
+int markCheckpoint(const struct checkpoint *cp, const char *section, const char *key) {
+    MPI_Barrier(cp->comm);
+
+    int err = 0;
+    if (cp->rank == 0) {
+        err = (ini_putl(section, key, 1, cp->fname) == 0);
+        if (err) {
+            printf("Error writing checkpoint manifest '%s'.\n", cp->fname);
+        }
+    }
+
+    MPI_Bcast(&err, 1, MPI_INT, 0, cp->comm);
+
+    return err;
+}
+
+/* Record that the Gaussian random field and its smaller copies are done */
+int markGaussianField(struct checkpoint *cp, int N, double boxlen) {
+    cp->N = N;
+    cp->boxlen = boxlen;
+
+    /* Store the box size at full precision */
+    if (cp->rank == 0) {
+        char boxlen_str[32];
+        sprintf(boxlen_str, "%.17g", boxlen);
+        ini_putl("Run", "GridSize", N, cp->fname);
+        ini_puts("Run", "BoxLen", boxlen_str, cp->fname);
+    }
+
+    return markCheckpoint(cp, CHECKPOINT_GRIDS, "GaussianField");
+}
+
+/* Can we read the Gaussian random field and its smaller copies? */
+int skipGaussianField(const struct checkpoint *cp, const struct params *pars) {
+    int skip = 0;
+
+    if (cp->rank == 0 && stageDone(cp, CHECKPOINT_GRIDS, "GaussianField")) {
+        char fname[DEFAULT_STRING_LENGTH];
+
+        sprintf(fname, "%s/%s%s", pars->OutputDirectory, GRID_NAME_GAUSSIAN, ".hdf5");
+        skip = fieldFileValid(fname, cp->N, cp->boxlen);
+
+        if (pars->SmallGridSize > 0) {
+            sprintf(fname, "%s/%s%s", pars->OutputDirectory, GRID_NAME_GAUSSIAN_SMALL, ".hdf5");
+            skip = skip && fieldFileValid(fname, pars->SmallGridSize, cp->boxlen);
+        }
+
+        if (pars->FireboltGridSize > 0) {
+            sprintf(fname, "%s/%s%s", pars->OutputDirectory, GRID_NAME_GAUSSIAN_FIREBOLT, ".hdf5");
+            skip = skip && fieldFileValid(fname, pars->FireboltGridSize, cp->boxlen);
+        }
+    }
+
+    MPI_Bcast(&skip, 1, MPI_INT, 0, cp->comm);
+
+    return skip;
+}
+
+/* Can we reuse the grids that are read in the particle stage? */
+int skipPerturbationGrids(const struct checkpoint *cp, const struct params *pars,
+                          const struct particle_type *ptype) {
+    const char *Identifier = ptype->Identifier;
+    const char *letter[] = {"x_", "y_", "z_"};
+    int skip = 0;
+
+    if (cp->rank == 0 && stageDone(cp, CHECKPOINT_GRIDS, Identifier)) {
+        char fname[DEFAULT_STRING_LENGTH];
+        skip = 1;
+
+        if (strcmp("", ptype->TransferFunctionDensity) != 0) {
+            /* The density grid is only exported if it was generated */
+            if (strcmp("", ptype->InputFilenameDensity) == 0) {
+                generateFieldFilename(pars, fname, Identifier, GRID_NAME_DENSITY, "");
+                skip = skip && fieldFileValid(fname, cp->N, cp->boxlen);
+            }
+
+            for (int i=0; i<3; i++) {
+                generateFieldFilename(pars, fname, Identifier, GRID_NAME_DISPLACEMENT, letter[i]);
+                skip = skip && fieldFileValid(fname, cp->N, cp->boxlen);
+            }
+        }
+
+        if (strcmp("", ptype->TransferFunctionVelocity) != 0) {
+            for (int i=0; i<3; i++) {
+                generateFieldFilename(pars, fname, Identifier, GRID_NAME_VELOCITY, letter[i]);
+                skip = skip && fieldFileValid(fname, cp->N, cp->boxlen);
+            }
+        }
+    }
+
+    MPI_Bcast(&skip, 1, MPI_INT, 0, cp->comm);
+
+    return skip;
+}
+
+/* Was the output file created or were the particles of this type written? */
+int skipParticleStage(const struct checkpoint *cp, const char *key) {
+    int skip = 0;
+
+    if (cp->rank == 0) {
+        skip = stageDone(cp, CHECKPOINT_PARTICLES, key);
+    }
+
+    MPI_Bcast(&skip, 1, MPI_INT, 0, cp->comm);
+
+    return skip;
+}
@@ -18,6 +18,7 @@
  ******************************************************************************/
 
 #include <stdlib.h>
+#include <string.h>
 #include "../include/distributed_grid.h"
 
 int alloc_local_grid(struct distributed_grid *dg, int N, double boxlen, MPI_Comm comm) {
@@ -49,10 +50,81 @@ int free_local_grid(struct distributed_grid *dg) {
 
 int free_local_real_grid(struct distributed_grid *dg) {
     fftw_free(dg->box);
+    dg->box = NULL;
     return 0;
 }
 
 int free_local_complex_grid(struct distributed_grid *dg) {
     fftw_free(dg->fbox);
+    dg->fbox = NULL;
+    return 0;
+}
+
+int alloc_ghost_slab(struct ghost_slab *gs, int N, int X0, int NX, int ghost_NX) {
+    /* The ghost rows must at least cover the interpolation stencils */
+    if (ghost_NX < GHOST_SLAB_PADDING) {
+        printf("Error: need at least %d ghost rows.\n", GHOST_SLAB_PADDING);
+        return 1;
+    }
+
+    /* Store basic attributes */
+    gs->N = N;
+    gs->X0 = X0;
+    gs->NX = NX;
+    gs->ghost_NX = ghost_NX;
+    gs->pad = GHOST_SLAB_PADDING;
+
+    /* Dimensions of the padded array */
+    const long int nx = NX + 2 * ghost_NX;
+    const long int ny = N + 2 * gs->pad;
+    const long int nz = N + 2 * gs->pad;
+    gs->stride_y = nz;
+    gs->stride_x = ny * nz;
+
+    /* Allocate memory for the padded array */
+    gs->data = fftw_alloc_real(nx * ny * nz);
+    if (gs->data == NULL) return 1;
+
+    /* The base pointer corresponds to local coordinates (0, 0, 0) */
+    gs->base = gs->data + ghost_NX * gs->stride_x + gs->pad * gs->stride_y + gs->pad;
+
+    return 0;
+}
+
+int free_ghost_slab(struct ghost_slab *gs) {
+    fftw_free(gs->data);
+    gs->data = NULL;
+    gs->base = NULL;
+    return 0;
+}
+
+/* Copy the periodic images into the padded cells in the Y and Z directions,
+ * assuming that the interior cells have already been filled */
+int fill_ghost_slab_padding(struct ghost_slab *gs) {
+    const int N = gs->N;
+    const int pad = gs->pad;
+    const long int sx = gs->stride_x;
+    const long int sy = gs->stride_y;
+
+    #pragma omp parallel for
+    for (int i = -gs->ghost_NX; i < gs->NX + gs->ghost_NX; i++) {
+        double *slice = gs->base + i * sx;
+
+        /* First pad the Z-direction of the interior rows */
+        for (int j = 0; j < N; j++) {
+            double *row = slice + j * sy;
+            for (int k = 1; k <= pad; k++) {
+                row[-k] = row[N - k];
+                row[N + k - 1] = row[k - 1];
+            }
+        }
+
+        /* Then copy entire (Z-padded) rows into the Y-padding */
+        for (int j = 1; j <= pad; j++) {
+            memcpy(slice - j * sy - pad, slice + (N - j) * sy - pad, sy * sizeof(double));
+            memcpy(slice + (N + j - 1) * sy - pad, slice + (j - 1) * sy - pad, sy * sizeof(double));
+        }
+    }
+
     return 0;
 }
@@ -23,6 +23,7 @@
 #include <string.h>
 
 #include "../include/fft.h"
+#include "../include/timers.h"
 #include "../include/output.h"
 
 /* Compute the 3D wavevector (kx,ky,kz) and its length k */
@@ -135,14 +136,26 @@ int fft_apply_kernel(fftw_complex *write, const fftw_complex *read, int N,
     return 0;
 }
 
+/* Estimate of the number of bytes sent to other ranks during the global
+ * transposes of a distributed r2c or c2r transform. FFTW transposes the
+ * complex slab twice, and all but 1/P of the local slab is sent. */
+static long long int transposeBytes(const struct distributed_grid *dg) {
+    const long long int local_bytes = (long long int) dg->NX * dg->N * (dg->N / 2 + 1) * sizeof(fftw_complex);
+    return 2 * local_bytes * (dg->N - dg->NX) / dg->N;
+}
+
 /* (Distributed grid version) Perform an r2c Fourier transform and normalize */
 int fft_r2c_dg(struct distributed_grid *dg) {
+    timerStart("FFT");
+
     /* Create MPI FFTW plan */
     fftw_plan r2c_mpi = fftw_mpi_plan_dft_r2c_3d(dg->N, dg->N, dg->N, dg->box,
                                                  dg->fbox, dg->comm, FFTW_ESTIMATE);
 
     /* Execute the Fourier transform and normalize */
+    commStart("Transform", dg->comm);
     fft_execute(r2c_mpi);
+    commStop(transposeBytes(dg));
     fft_normalize_r2c_dg(dg);
 
     /* Destroy the plan */
@@ -151,17 +164,23 @@ int fft_r2c_dg(struct distributed_grid *dg) {
     /* Flip the flag for bookkeeping */
     dg->momentum_space = 1;
 
+    timerStop();
+
     return 0;
 }
 
 /* (Distributed grid version) Perform a c2r Fourier transform and normalize */
 int fft_c2r_dg(struct distributed_grid *dg) {
+    timerStart("FFT");
+
     /* Create MPI FFTW plan */
     fftw_plan c2r_mpi = fftw_mpi_plan_dft_c2r_3d(dg->N, dg->N, dg->N, dg->fbox,
                                                  dg->box, dg->comm, FFTW_ESTIMATE);
 
     /* Execute the Fourier transform and normalize */
+    commStart("Transform", dg->comm);
     fft_execute(c2r_mpi);
+    commStop(transposeBytes(dg));
     fft_normalize_c2r_dg(dg);
 
     /* Destroy the plan */
@@ -170,6 +189,8 @@ int fft_c2r_dg(struct distributed_grid *dg) {
     /* Flip the trigger for bookkeeping */
     dg->momentum_space = 0;
 
+    timerStop();
+
     return 0;
 }
 
@@ -17,41 +17,154 @@
  *
  ******************************************************************************/
 
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <math.h>
+#include <stdint.h>
 #include <complex.h>
+#include <hdf5.h>
 #include "../include/perturb_spline.h"
 #include "../include/titles.h"
 #include "../include/firebolt_interface.h"
 
-/* Firebolt structures */
-struct multipoles firebolt_mL; //multipoles in standard Legendre basis
-struct multipoles firebolt_mmono; //multipoles in monomial basis
-struct multipoles firebolt_mgauge; //Legendre multipole gauge transformations
-struct grids firebolt_grs;
+/* The time-dependent sources h' and eta' tabulated on the wavenumbers of
+ * Firebolt, at the time steps of the perturbation data (tau_size * k_size).
+ * At fixed k, the bilinear interpolation of the perturbation spline reduces
+ * to a linear interpolation in log(tau) of these tables. */
+struct firebolt_sources {
+    const double *k;
+    int k_size;
+    int tau_size;
+    double *h_prime;
+    double *eta_prime;
+};
 
+/* The Firebolt source callbacks take no user data, so the perturbation data
+ * used by them is passed through this global. It is only used during
+ * initFirebolt, not by the sampler. */
 struct firebolt_helper {
     const struct perturb_spline *spline;
     int h_prime_index;
     int eta_prime_index;
     int delta_shift_index;
     int theta_shift_index;
+    struct firebolt_sources sources;
 };
 
 struct firebolt_helper helper;
 
+/* Last-hit indices of the source lookups, where k_index refers to the Firebolt
+ * wavenumbers. Firebolt evaluates the sources for all wavenumbers in turn at
+ * each time, so these almost always hit. */
+static struct perturb_spline_cursor source_cursor;
+#pragma omp threadprivate(source_cursor)
+
+/* Tabulate the time-dependent sources up to (and including) log_tau_max */
+static int initFireboltSources(struct firebolt_sources *src,
+                               const struct multipoles *m, double log_tau_max) {
+
+    const struct perturb_spline *spline = helper.spline;
+    const struct perturb_data *ptdat = spline->ptdat;
+
+    /* The number of time steps needed to bracket log_tau_max */
+    int tau_size = 1;
+    while (tau_size < ptdat->tau_size && ptdat->log_tau[tau_size - 1] < log_tau_max) {
+        tau_size++;
+    }
+    if (tau_size < 2) tau_size = 2;
+
+    src->k = m->k;
+    src->k_size = m->k_size;
+    src->tau_size = tau_size;
+    src->h_prime = malloc((long int) m->k_size * tau_size * sizeof(double));
+    src->eta_prime = malloc((long int) m->k_size * tau_size * sizeof(double));
+
+    if (src->h_prime == NULL || src->eta_prime == NULL) {
+        printf("Error allocating memory for the Firebolt source tables.\n");
+        return 1;
+    }
+
+    #pragma omp parallel for
+    for (int i=0; i<m->k_size; i++) {
+        int k_index;
+        double u_k;
+        perturbSplineFindK(spline, m->k[i], &k_index, &u_k);
+
+        for (int j=0; j<tau_size; j++) {
+            /* The last time step is the right edge of the last bin */
+            int tau_index = (j < ptdat->tau_size - 1) ? j : j - 1;
+            double u_tau = (tau_index == j) ? 0. : 1.;
+
+            long int id = (long int) j * m->k_size + i;
+            src->h_prime[id] = perturbSplineInterp(spline, k_index, tau_index, u_k, u_tau, helper.h_prime_index);
+            src->eta_prime[id] = perturbSplineInterp(spline, k_index, tau_index, u_k, u_tau, helper.eta_prime_index);
+        }
+    }
+
+    return 0;
+}
+
+static void cleanFireboltSources(struct firebolt_sources *src) {
+    free(src->h_prime);
+    free(src->eta_prime);
+    src->h_prime = NULL;
+    src->eta_prime = NULL;
+}
+
+/* Interpolate a tabulated source, falling back to the perturbation spline
+ * if k is not one of the Firebolt wavenumbers or log_tau is out of range */
+static double interpFireboltSource(const double *table, int index_src,
+                                   double k, double log_tau) {
+
+    const struct firebolt_sources *src = &helper.sources;
+
+    /* Find the tabulated wavenumber, trying the next and last one first */
+    int k_index = source_cursor.k_index + 1;
+    if (k_index >= src->k_size || src->k[k_index] != k) {
+        k_index = source_cursor.k_index;
+    }
+    if (k_index >= src->k_size || src->k[k_index] != k) {
+        /* Binary search (the wavenumbers are ascending) */
+        int lo = 0, hi = src->k_size - 1;
+        while (hi > lo) {
+            int mid = (lo + hi) / 2;
+            if (src->k[mid] < k) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        k_index = lo;
+    }
+
+    int tau_index;
+    double u_tau;
+    perturbSplineFindTauCursor(helper.spline, &source_cursor, log_tau, &tau_index, &u_tau);
+
+    if (table == NULL || src->k[k_index] != k || tau_index + 1 >= src->tau_size) {
+        return perturbSplineInterp0(helper.spline, k, log_tau, index_src);
+    }
+    source_cursor.k_index = k_index;
+
+    const double *row = table + (long int) tau_index * src->k_size + k_index;
+    return (1 - u_tau) * row[0] + u_tau * row[src->k_size];
+}
+
 /* Redshift as a function of the logarithm of conformal time */
 double redshift_func(double log_tau) {
     return perturbRedshiftAtLogTau(helper.spline, log_tau);
 }
 
 double h_prime_func(double k, double log_tau) {
-    return perturbSplineInterp0(helper.spline, k, log_tau, helper.h_prime_index);
+    return interpFireboltSource(helper.sources.h_prime, helper.h_prime_index, k, log_tau);
 }
 
 double eta_prime_func(double k, double log_tau) {
-    return perturbSplineInterp0(helper.spline, k, log_tau, helper.eta_prime_index);
+    return interpFireboltSource(helper.sources.eta_prime, helper.eta_prime_index, k, log_tau);
 }
 
+/* The gauge shifts are only needed at the final time, once per wavenumber */
 double delta_shift_func(double k, double log_tau) {
     return perturbSplineInterp0(helper.spline, k, log_tau, helper.delta_shift_index);
 }
@@ -60,11 +173,97 @@ double theta_shift_func(double k, double log_tau) {
     return perturbSplineInterp0(helper.spline, k, log_tau, helper.theta_shift_index);
 }
 
+/* The grid size used by Firebolt depends on user choice */
+int fireboltGridSize(const struct params *pars) {
+    if (pars->FireboltGridSize > 0) {
+        return pars->FireboltGridSize;
+    } else if (pars->SmallGridSize > 0) {
+        return pars->SmallGridSize;
+    } else {
+        return pars->GridSize;
+    }
+}
+
+/* FNV-1a hash of an array of doubles, continuing from the hash h */
+static uint64_t hashDoubles(uint64_t h, const double *data, long int n) {
+    const unsigned char *c = (const unsigned char *) data;
+    for (long int i=0; i<n * (long int) sizeof(double); i++) {
+        h ^= c[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/* Collect the parameters that determine the Firebolt solution. Two species
+ * with the same key have the same Firebolt grids. Besides the parameters,
+ * the key contains hashes of the perturbation tables and of the real
+ * Gaussian random field (field_size doubles) that is passed to Firebolt.
+ * The latter accounts for everything that produced the field, such as the
+ * seed, the number of ranks, or a field read from disk. */
+void fireboltKey(const struct params *pars, const struct cosmology *cosmo,
+                 const struct perturb_data *ptdat, double M_nu_eV,
+                 double T_nu_eV, const double *field, long int field_size,
+                 double *key) {
+    /* Hash the perturbation tables */
+    uint64_t h_ptdat = 14695981039346656037ULL;
+    h_ptdat = hashDoubles(h_ptdat, ptdat->k, ptdat->k_size);
+    h_ptdat = hashDoubles(h_ptdat, ptdat->log_tau, ptdat->tau_size);
+    h_ptdat = hashDoubles(h_ptdat, ptdat->delta, (long int) ptdat->k_size * ptdat->tau_size * ptdat->n_functions);
+
+    /* Hash the random field */
+    uint64_t h_field = hashDoubles(14695981039346656037ULL, field, field_size);
+
+    /* Split the hashes into 32-bit halves, which are exact as doubles */
+    const double values[FIREBOLT_KEY_LENGTH] = {
+        M_nu_eV, T_nu_eV, pars->Seed, fireboltGridSize(pars), pars->BoxLen,
+        cosmo->z_ini, pars->MaxMultipole, pars->MaxMultipoleConvert,
+        pars->NumberMomentumBins, pars->NumberWavenumbers,
+        pars->FireboltCutoffWavenumber, pars->MinMomentum, pars->MaxMomentum,
+        pars->FireboltTolerance, ptdat->k_size, ptdat->tau_size,
+        ptdat->log_tau[0], ptdat->log_tau[ptdat->tau_size - 1],
+        cosmo->h, cosmo->n_s, cosmo->A_s, cosmo->k_pivot, ptdat->n_functions,
+        h_ptdat >> 32, h_ptdat & 0xffffffff, h_field >> 32, h_field & 0xffffffff};
+
+    for (int i=0; i<FIREBOLT_KEY_LENGTH; i++) {
+        key[i] = values[i];
+    }
+}
+
+/* Check whether the Firebolt grids were computed for the given key */
+int fireboltKeyMatches(const struct firebolt_interface *firebolt,
+                       const double *key) {
+    for (int i=0; i<FIREBOLT_KEY_LENGTH; i++) {
+        if (firebolt->key[i] != key[i]) return 0;
+    }
+    return 1;
+}
+
+/* Let Firebolt's grids point to the shared memory window, if there is one,
+ * so that they are computed or read in place. The grids allocated by
+ * initGrids are freed before they are ever written. */
+static int useSharedGrids(struct firebolt_interface *firebolt, long int size) {
+    if (!firebolt->shared_grids) return 0;
+
+    MPI_Aint bytes;
+    int disp_unit;
+    double *shared;
+    MPI_Win_shared_query(firebolt->grids_win, 0, &bytes, &disp_unit, &shared);
+    if (bytes != (MPI_Aint) (size * sizeof(double))) {
+        printf("Error: the Firebolt grids do not fit the shared memory window.\n");
+        return 1;
+    }
+
+    cleanGrids(&firebolt->grs);
+    firebolt->grs.grids = shared;
+
+    return 0;
+}
+
 int initFirebolt(const struct params *pars, const struct cosmology *cosmo,
                  const struct units *us, const struct perturb_data *ptdat,
                  const struct perturb_spline *spline,
                  struct firebolt_interface *firebolt, const fftw_complex *grf,
-                 double M_nu_eV, double T_nu_eV) {
+                 double M_nu_eV, double T_nu_eV, const double *key) {
 
     /* When is the simulation supposed to start? */
     double a_begin = 1.0 / (cosmo->z_ini + 1.0);
@@ -90,18 +289,9 @@ int initFirebolt(const struct params *pars, const struct cosmology *cosmo,
     }
 
     /* Dimensions of the gaussian random field */
-    int N;
+    int N = fireboltGridSize(pars);
     double boxlen = pars->BoxLen;
 
-    /* The grid size depends on user choice */
-    if (pars->FireboltGridSize > 0) {
-        N = pars->FireboltGridSize;
-    } else if (pars->SmallGridSize > 0) {
-        N = pars->SmallGridSize;
-    } else {
-        N = pars->GridSize;
-    }
-
     /* Determine the maximum and minimum wavenumbers */
     double dk = 2*M_PI/boxlen;
     double k_max = sqrt(3)*dk*N/2;
@@ -132,7 +322,12 @@ int initFirebolt(const struct params *pars, const struct cosmology *cosmo,
     double tol = pars->FireboltTolerance;
     short verbose = pars->FireboltVerbose;
 
-    /* Store the momentum range in the renderer struct for later use */
+    /* Store the key, and the momentum range for later use */
+    for (int i=0; i<FIREBOLT_KEY_LENGTH; i++) {
+        firebolt->key[i] = key[i];
+    }
+    firebolt->N = N;
+    firebolt->boxlen = boxlen;
     firebolt->q_size = q_steps;
     firebolt->log_q_min = log(q_min);
     firebolt->log_q_max = log(q_max);
@@ -151,47 +346,61 @@ int initFirebolt(const struct params *pars, const struct cosmology *cosmo,
     }
 
     /* Initialize the multipoles */
-    initMultipoles(&firebolt_mL, k_size, q_steps, l_max, q_min, q_max, k_min, k_max);
+    initMultipoles(&firebolt->mL, k_size, q_steps, l_max, q_min, q_max, k_min, k_max);
 
     /* Also initialize the multipoles in monomial basis (with much lower l_max) */
-    initMultipoles(&firebolt_mmono, k_size, q_steps, l_max_convert+1, q_min, q_max, k_min, k_max);
+    initMultipoles(&firebolt->mmono, k_size, q_steps, l_max_convert+1, q_min, q_max, k_min, k_max);
 
     /* Initialize gauge transforms (only Psi_0 and Psi_1 are gauge dependent) */
     int l_size_gauge = 2;
-    initMultipoles(&firebolt_mgauge, k_size, q_steps, l_size_gauge, q_min, q_max, k_min, k_max);
+    initMultipoles(&firebolt->mgauge, k_size, q_steps, l_size_gauge, q_min, q_max, k_min, k_max);
+
+    /* Tabulate the sources on the wavenumbers of the multipoles */
+    int err = initFireboltSources(&helper.sources, &firebolt->mL, log(tau_fin));
+    if (err > 0) return err;
+
+    if (verbose) {
+        printf("Tabulated the sources at %d wavenumbers and %d times.\n",
+               helper.sources.k_size, helper.sources.tau_size);
+    }
 
     /* Calculate the multipoles in Legendre basis */
-    evolveMultipoles(&firebolt_mL, tau_ini, tau_fin, tol, M, c_vel, redshift_func, h_prime_func, eta_prime_func, verbose);
+    evolveMultipoles(&firebolt->mL, tau_ini, tau_fin, tol, M, c_vel, redshift_func, h_prime_func, eta_prime_func, verbose);
+
+    /* The tabulated sources are no longer needed */
+    cleanFireboltSources(&helper.sources);
 
     /* Compute the gauge transforms in a separate struct (only Psi_0, Psi_1) */
-    convertMultipoleGauge_Nb(&firebolt_mgauge, log(tau_fin), a_fin, M, c_vel, delta_shift_func, theta_shift_func);
+    convertMultipoleGauge_Nb(&firebolt->mgauge, log(tau_fin), a_fin, M, c_vel, delta_shift_func, theta_shift_func);
 
     /* Convert from Legendre basis to monomial basis */
-    convertMultipoleBasis_L2m(&firebolt_mL, &firebolt_mmono, l_max_convert);
+    convertMultipoleBasis_L2m(&firebolt->mL, &firebolt->mmono, l_max_convert);
 
     /* Convert the gauge transformations to monomial base and add it on top */
-    convertMultipoleBasis_L2m(&firebolt_mgauge, &firebolt_mmono, 1);
+    convertMultipoleBasis_L2m(&firebolt->mgauge, &firebolt->mmono, 1);
 
     if (verbose) {
         printf("Done with integrating. Processing the moments.\n");
     }
 
     /* Initialize the multipole interpolation splines */
-    initMultipoleInterp(&firebolt_mmono);
+    initMultipoleInterp(&firebolt->mmono);
 
     /* Generate grids with the monomial multipoles */
-    initGrids(N, boxlen, &firebolt_mmono, &firebolt_grs, k_cutoff);
+    initGrids(N, boxlen, &firebolt->mmono, &firebolt->grs, k_cutoff);
+    firebolt->l_size = firebolt->mmono.l_size;
 
-    /* Store reference to the grids */
-    firebolt->grids_ref = &firebolt_grs;
+    /* Generate them in shared memory, if a window was allocated */
+    err = useSharedGrids(firebolt, (long int) firebolt->l_size * q_steps * N * N * N);
+    if (err > 0) return err;
 
-    generateGrids(&firebolt_mmono, grf, &firebolt_grs);
+    generateGrids(&firebolt->mmono, grf, &firebolt->grs);
 
     /* For each multipole/momentum bin pair, create the corresponding grid */
     if (verbose >= 10) {
-        for (int index_q=0; index_q<firebolt_mmono.q_size; index_q++) {
-            for (int index_l=0; index_l<firebolt_mmono.l_size; index_l++) {
-                double *box = firebolt_grs.grids + index_l * (N*N*N) * firebolt_mmono.q_size + index_q * (N*N*N);
+        for (int index_q=0; index_q<firebolt->q_size; index_q++) {
+            for (int index_l=0; index_l<firebolt->l_size; index_l++) {
+                double *box = firebolt->grs.grids + index_l * (N*N*N) * firebolt->q_size + index_q * (N*N*N);
 
                 /* Export the real box */
                 char dbox_fname[DEFAULT_STRING_LENGTH];
@@ -203,17 +412,252 @@ int initFirebolt(const struct params *pars, const struct cosmology *cosmo,
         }
     }
 
+    /* Only the grids are needed from here on, so free the multipoles */
+    cleanMultipoles(&firebolt->mmono);
+    cleanMultipoles(&firebolt->mL);
+    cleanMultipoles(&firebolt->mgauge);
+    cleanMultipoleInterp();
+
     return 0;
 }
 
-int cleanFirebolt(void) {
+/* Store the Firebolt grids and their key, so that later runs can reuse them */
+int writeFireboltCache(const struct firebolt_interface *firebolt,
+                       const char *fname) {
 
-    /* Clean up the Firebolt structures */
-    cleanMultipoles(&firebolt_mmono);
-    cleanMultipoles(&firebolt_mL);
-    cleanMultipoles(&firebolt_mgauge);
-    cleanMultipoleInterp();
-    cleanGrids(&firebolt_grs);
+    hid_t h_file = H5Fcreate(fname, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if (h_file < 0) {
+        printf("Error creating Firebolt cache file '%s'.\n", fname);
+        return 1;
+    }
+
+    /* The key as an attribute of the file */
+    const hsize_t key_dims[1] = {FIREBOLT_KEY_LENGTH};
+    hid_t h_aspace = H5Screate_simple(1, key_dims, NULL);
+    hid_t h_attr = H5Acreate(h_file, "Key", H5T_NATIVE_DOUBLE, h_aspace, H5P_DEFAULT, H5P_DEFAULT);
+    H5Awrite(h_attr, H5T_NATIVE_DOUBLE, firebolt->key);
+    H5Aclose(h_attr);
+    H5Sclose(h_aspace);
+
+    /* The grids for each multipole and momentum bin */
+    const long int N = firebolt->N;
+    const hsize_t dims[5] = {firebolt->l_size, firebolt->q_size, N, N, N};
+    hid_t h_space = H5Screate_simple(5, dims, NULL);
+    hid_t h_data = H5Dcreate(h_file, "Grids", H5T_NATIVE_DOUBLE, h_space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    herr_t h_err = H5Dwrite(h_data, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, firebolt->grs.grids);
+    H5Dclose(h_data);
+    H5Sclose(h_space);
+    H5Fclose(h_file);
+
+    if (h_err < 0) {
+        printf("Error writing Firebolt cache file '%s'.\n", fname);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Load the Firebolt grids from a cache file. Returns 0 on success and a
+ * positive value if the file does not exist or has a different key, in which
+ * case firebolt is left untouched. */
+int readFireboltCache(const struct params *pars, const double *key,
+                      struct firebolt_interface *firebolt, const char *fname) {
+
+    /* Check that the file exists, without HDF5 error messages */
+    FILE *f = fopen(fname, "r");
+    if (f == NULL) return 1;
+    fclose(f);
+
+    hid_t h_file = H5Fopen(fname, H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (h_file < 0) return 1;
+
+    /* Compare the key */
+    double file_key[FIREBOLT_KEY_LENGTH];
+    hid_t h_attr = H5Aopen(h_file, "Key", H5P_DEFAULT);
+    hid_t h_aspace = H5Aget_space(h_attr);
+    hssize_t key_length = H5Sget_simple_extent_npoints(h_aspace);
+    herr_t h_err = -1;
+    if (key_length == FIREBOLT_KEY_LENGTH) {
+        h_err = H5Aread(h_attr, H5T_NATIVE_DOUBLE, file_key);
+    }
+    H5Sclose(h_aspace);
+    H5Aclose(h_attr);
+
+    int match = (h_err >= 0);
+    for (int i=0; i<FIREBOLT_KEY_LENGTH && match; i++) {
+        if (file_key[i] != key[i]) match = 0;
+    }
+    if (!match) {
+        H5Fclose(h_file);
+        return 2;
+    }
+
+    /* Dimensions of the grids */
+    int N = fireboltGridSize(pars);
+    double boxlen = pars->BoxLen;
+    int q_steps = pars->NumberMomentumBins;
+
+    /* Let Firebolt allocate the grids, which requires the multipoles */
+    struct multipoles mmono;
+    double dk = 2*M_PI/boxlen;
+    double k_max = sqrt(3)*dk*N/2 * 1.5;
+    double k_min = dk / 1.5;
+    initMultipoles(&mmono, pars->NumberWavenumbers, q_steps, pars->MaxMultipoleConvert+1,
+                   pars->MinMomentum, pars->MaxMomentum, k_min, k_max);
+    initGrids(N, boxlen, &mmono, &firebolt->grs, pars->FireboltCutoffWavenumber);
+    firebolt->l_size = mmono.l_size;
+    cleanMultipoles(&mmono);
+
+    /* Read them into shared memory, if a window was allocated */
+    if (useSharedGrids(firebolt, (long int) firebolt->l_size * q_steps * N * N * N) > 0) {
+        cleanGrids(&firebolt->grs);
+        H5Fclose(h_file);
+        return 3;
+    }
+
+    /* Read the grids, provided that the dimensions match */
+    hid_t h_data = H5Dopen(h_file, "Grids", H5P_DEFAULT);
+    hid_t h_space = H5Dget_space(h_data);
+    hssize_t points = H5Sget_simple_extent_npoints(h_space);
+    h_err = -1;
+    if (points == (hssize_t) firebolt->l_size * q_steps * N * N * N) {
+        h_err = H5Dread(h_data, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, firebolt->grs.grids);
+    }
+    H5Sclose(h_space);
+    H5Dclose(h_data);
+    H5Fclose(h_file);
+
+    if (h_err < 0) {
+        if (!firebolt->shared_grids) cleanGrids(&firebolt->grs);
+        return 3;
+    }
+
+    /* Store the key, and the momentum range for later use */
+    for (int i=0; i<FIREBOLT_KEY_LENGTH; i++) {
+        firebolt->key[i] = key[i];
+    }
+    firebolt->N = N;
+    firebolt->boxlen = boxlen;
+    firebolt->q_size = q_steps;
+    firebolt->log_q_min = log(pars->MinMomentum);
+    firebolt->log_q_max = log(pars->MaxMomentum);
+
+    return 0;
+}
+
+/* Group the ranks of comm by node, with the root first on its node, and
+ * collect the first rank of each node in leader_comm (MPI_COMM_NULL on the
+ * other ranks) */
+static void splitNodes_MPI(int root, MPI_Comm comm, MPI_Comm *node_comm,
+                           MPI_Comm *leader_comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    const int order = (rank == root) ? -1 : rank;
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, order, MPI_INFO_NULL, node_comm);
+    int node_rank;
+    MPI_Comm_rank(*node_comm, &node_rank);
+    MPI_Comm_split(comm, node_rank == 0 ? 0 : MPI_UNDEFINED, order, leader_comm);
+}
+
+/* Allocate a shared memory window for the Firebolt grids on each node. This
+ * is collective over comm and must precede initFirebolt or readFireboltCache
+ * on the root, which then store the grids directly in the window of its
+ * node. The grids are afterwards sent to the other nodes with
+ * shareFireboltGrids_MPI. */
+int allocFireboltGrids_MPI(struct firebolt_interface *firebolt,
+                           const struct params *pars, int root, MPI_Comm comm) {
+    MPI_Comm node_comm, leader_comm;
+    splitNodes_MPI(root, comm, &node_comm, &leader_comm);
+    int node_rank;
+    MPI_Comm_rank(node_comm, &node_rank);
+
+    /* The dimensions of the grids, as in initFirebolt */
+    firebolt->N = fireboltGridSize(pars);
+    firebolt->l_size = pars->MaxMultipoleConvert + 1;
+    firebolt->q_size = pars->NumberMomentumBins;
+
+    /* The window is owned by the first rank on each node */
+    const long int N = firebolt->N;
+    const long int size = firebolt->l_size * firebolt->q_size * N * N * N;
+    const MPI_Aint bytes = (node_rank == 0) ? size * sizeof(double) : 0;
+    double *shared;
+    int err = MPI_Win_allocate_shared(bytes, sizeof(double), MPI_INFO_NULL,
+                                      node_comm, &shared, &firebolt->grids_win);
+    if (leader_comm != MPI_COMM_NULL) MPI_Comm_free(&leader_comm);
+    MPI_Comm_free(&node_comm);
+    if (err != MPI_SUCCESS) {
+        printf("Error allocating shared memory for the Firebolt grids.\n");
+        return 1;
+    }
+
+    firebolt->shared_grids = 1;
+
+    return 0;
+}
+
+/* Share the grids of the root rank with all ranks in comm. The grids are
+ * sent once to each node, where they are stored in the shared memory window
+ * from allocFireboltGrids_MPI, so that Firebolt only needs to run on the
+ * root rank and the memory use scales with the number of nodes rather than
+ * the number of ranks. */
+int shareFireboltGrids_MPI(struct firebolt_interface *firebolt, int root,
+                           MPI_Comm comm) {
+    if (!firebolt->shared_grids) {
+        printf("Error: no shared memory window for the Firebolt grids.\n");
+        return 1;
+    }
+
+    /* Broadcast the dimensions, momentum range, key, and the properties of
+     * the grids that are used by evalDensity. The pointer to the grids is
+     * local to each node. */
+    MPI_Bcast(&firebolt->N, 1, MPI_INT, root, comm);
+    MPI_Bcast(&firebolt->l_size, 1, MPI_INT, root, comm);
+    MPI_Bcast(&firebolt->q_size, 1, MPI_INT, root, comm);
+    MPI_Bcast(&firebolt->boxlen, 1, MPI_DOUBLE, root, comm);
+    MPI_Bcast(&firebolt->log_q_min, 1, MPI_DOUBLE, root, comm);
+    MPI_Bcast(&firebolt->log_q_max, 1, MPI_DOUBLE, root, comm);
+    MPI_Bcast(firebolt->key, FIREBOLT_KEY_LENGTH, MPI_DOUBLE, root, comm);
+    MPI_Bcast(&firebolt->grs.N, 1, MPI_INT, root, comm);
+    MPI_Bcast(&firebolt->grs.boxlen, 1, MPI_DOUBLE, root, comm);
+
+    MPI_Comm node_comm, leader_comm;
+    splitNodes_MPI(root, comm, &node_comm, &leader_comm);
+
+    MPI_Aint bytes;
+    int disp_unit;
+    double *shared;
+    MPI_Win_shared_query(firebolt->grids_win, 0, &bytes, &disp_unit, &shared);
+    const long int size = bytes / sizeof(double);
+
+    /* The root has already stored its grids in the window of its node. Send
+     * them to the other nodes, in blocks. */
+    MPI_Win_fence(0, firebolt->grids_win);
+    if (leader_comm != MPI_COMM_NULL) {
+        const long int block = 1 << 27;
+        for (long int i=0; i<size; i+=block) {
+            int count = (size - i < block) ? size - i : block;
+            MPI_Bcast(shared + i, count, MPI_DOUBLE, 0, leader_comm);
+        }
+        MPI_Comm_free(&leader_comm);
+    }
+    MPI_Win_fence(0, firebolt->grids_win);
+    MPI_Comm_free(&node_comm);
+
+    firebolt->grs.grids = shared;
+
+    return 0;
+}
+
+int cleanFirebolt(struct firebolt_interface *firebolt) {
+
+    /* Clean up the Firebolt grids (the multipoles are freed by initFirebolt).
+     * Shared grids are freed collectively. */
+    if (firebolt->shared_grids) {
+        MPI_Win_free(&firebolt->grids_win);
+    } else {
+        cleanGrids(&firebolt->grs);
+    }
 
     return 0;
 }
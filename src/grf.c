@@ -83,9 +83,11 @@ int enforce_hermiticity(struct distributed_grid *dg) {
     const int slice_size = NX * N;
     const int slice_offset = X0 * N;
 
+    timerStart("Hermiticity");
+
     /* Get the number of ranks */
     int MPI_Rank_Count;
-    MPI_Comm_size(MPI_COMM_WORLD, &MPI_Rank_Count);
+    MPI_Comm_size(dg->comm, &MPI_Rank_Count);
 
     /* Get the X-dimension locations (X0's) of the slices on each rank */
     int *slice_sizes = malloc(MPI_Rank_Count * sizeof(int));
@@ -111,8 +113,10 @@ int enforce_hermiticity(struct distributed_grid *dg) {
         }
 
         /* Gather all the slices on all the nodes */
+        commStart("Gather planes", dg->comm);
         MPI_Allgatherv(our_slice, NX * N, MPI_DOUBLE_COMPLEX, full_plane,
                        slice_sizes, slice_offsets, MPI_DOUBLE_COMPLEX, dg->comm);
+        commStop((long long int) (N - NX) * N * sizeof(fftw_complex));
 
         /* Enforce hermiticity: f(k) = f*(-k) */
         for (int x=X0; x<X0 + NX; x++) {
@@ -137,7 +141,9 @@ int enforce_hermiticity(struct distributed_grid *dg) {
         }
 
         /* Wait until all the ranks are finished */
+        commStart("Barrier", dg->comm);
         MPI_Barrier(dg->comm);
+        commStop(0);
     }
 
     /* Free the memory */
@@ -146,6 +152,8 @@ int enforce_hermiticity(struct distributed_grid *dg) {
     free(slice_sizes);
     free(slice_offsets);
 
+    timerStop();
+
     // fftw_complex *box = fftw_alloc_complex(N * N * (N/2+1));
     //
     // /* Gather all the slices on all the nodes */
@@ -18,10 +18,16 @@
  ******************************************************************************/
 
 #include <math.h>
+#include <string.h>
+#include <assert.h>
 #include "../include/grids_interp.h"
 #include "../include/fft.h"
 #include "../include/fft_kernels.h"
 
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 /* Nearest grid point interpolation */
 double gridNGP(const double *box, int N, double boxlen, double x, double y, double z) {
     /* Convert to float grid dimensions */
@@ -173,89 +179,72 @@ double gridPCS(const double *box, int N, double boxlen, double x, double y, doub
 }
 
 
-/* When the grid is distributed over several MPI nodes, we may need to
- * access cells that lie beyond the range of the current grid. We therefore
- * load slivers on the left and right of the local slice on each node.
- * This methods accesses the cell in the right sliver or slice. */
-double access_grid(struct left_right_slice *lrs, int iX, int iY, int iZ, int N) {
-
-    /* Make sure that the coordinates wrap around the box */
-    iX = wrap(iX, N);
-    iY = wrap(iY, N);
-    iZ = wrap(iZ, N); //we only want real data, so skip over the padded rows
-
-    /* The edges to be checked */
-    const int lX0 = lrs->left_X0;
-    const int cX0 = lrs->local_X0;
-    const int rX0 = lrs->right_X0;
-    const int lNX = lrs->left_NX;
-    const int cNX = lrs->local_NX;
-    const int rNX = lrs->right_NX;
-
-    /* Are we in the local slice or should we use the left/right slivers? */
-    if (iX >= cX0 && iX < cX0 + cNX) {
-        return lrs->local_slice[row_major_padded(iX - cX0, iY, iZ, N)];
-    } else if (iX >= lX0 && iX < lX0 + lNX) {
-        return lrs->left_slice[row_major_padded(iX - lX0, iY, iZ, N)];
-    } else if (iX >= rX0 && iX < rX0 + rNX) {
-        return lrs->right_slice[row_major_padded(iX - rX0, iY, iZ, N)];
-    } else {
-        printf("ERROR: outside of bounds %d %d %d.\n", iX, lX0, rX0 + rNX);
-    }
-
-    return 0;
-}
+/* Find the base cell of a particle in a ghost slab, where the base cell
+ * is either the nearest cell (shift = 0.5) or the cell on the left (shift = 0).
+ * Returns a pointer to the base cell and stores the offsets from it. */
+static inline const double *ghost_slab_locate(const struct ghost_slab *gs,
+                                              double x, double y, double z,
+                                              double boxlen, double shift,
+                                              double *dx, double *dy, double *dz) {
+    const int N = gs->N;
 
-/* (Distributed grid version) Nearest grid point interpolation */
-double gridNGP_dg(struct left_right_slice *lrs, double x, double y, double z, double boxlen, int N) {
     /* Convert to float grid dimensions */
     double X = x*N/boxlen;
     double Y = y*N/boxlen;
     double Z = z*N/boxlen;
 
     /* Integer grid position */
-    int iX = (int) floor(X);
-    int iY = (int) floor(Y);
-    int iZ = (int) floor(Z);
+    int iX = (int) floor(X + shift);
+    int iY = (int) floor(Y + shift);
+    int iZ = (int) floor(Z + shift);
+
+    /* Offsets from the base cell */
+    *dx = X - iX;
+    *dy = Y - iY;
+    *dz = Z - iZ;
+
+    /* Map to local coordinates in the ghost slab, using the periodic copy of
+     * the row that is nearest to the slab. This also works when the slab and
+     * its ghost rows cover the whole box. */
+    int lX = wrap(iX - gs->X0, N);
+    if (lX >= (gs->NX + N) / 2) lX -= N;
+    int lY = wrap(iY, N);
+    int lZ = wrap(iZ, N);
+
+    /* The stencils must not extend beyond the ghost rows */
+    assert(lX - 1 >= -gs->ghost_NX && lX + 2 < gs->NX + gs->ghost_NX);
+
+    return gs->base + lX * gs->stride_x + lY * gs->stride_y + lZ;
+}
+
+/* (Distributed grid version) Nearest grid point interpolation */
+double gridNGP_dg(const struct ghost_slab *gs, double x, double y, double z, double boxlen) {
+    double dx, dy, dz;
+    const double *cell = ghost_slab_locate(gs, x, y, z, boxlen, 0.0, &dx, &dy, &dz);
 
-    return access_grid(lrs, iX, iY, iZ, N);
+    return *cell;
 }
 
 /* (Distributed grid version) Cloud in cell interpolation */
-double gridCIC_dg(struct left_right_slice *lrs, double x, double y, double z, double boxlen, int N) {
-    /* Convert to float grid dimensions */
-    double X = x*N/boxlen;
-    double Y = y*N/boxlen;
-    double Z = z*N/boxlen;
-
-    /* Integer grid position */
-    int iX = (int) floor(X);
-    int iY = (int) floor(Y);
-    int iZ = (int) floor(Z);
+double gridCIC_dg(const struct ghost_slab *gs, double x, double y, double z, double boxlen) {
+    double dx, dy, dz;
+    const double *cell = ghost_slab_locate(gs, x, y, z, boxlen, 0.0, &dx, &dy, &dz);
+    const long int sx = gs->stride_x;
+    const long int sy = gs->stride_y;
 
-    /* Intepolate the necessary fields with CIC or TSC */
-    double lookLength = 1.0;
-    int lookLftX = (int) floor((X-iX) - lookLength);
-    int lookRgtX = (int) floor((X-iX) + lookLength);
-    int lookLftY = (int) floor((Y-iY) - lookLength);
-    int lookRgtY = (int) floor((Y-iY) + lookLength);
-    int lookLftZ = (int) floor((Z-iZ) - lookLength);
-    int lookRgtZ = (int) floor((Z-iZ) + lookLength);
+    /* One-dimensional weights for the cells at offsets 0 and +1 */
+    const double wx[2] = {1.0 - dx, dx};
+    const double wy[2] = {1.0 - dy, dy};
+    const double wz[2] = {1.0 - dz, dz};
 
     /* Accumulate */
     double sum = 0;
-    for (int i=lookLftX; i<=lookRgtX; i++) {
-        for (int j=lookLftY; j<=lookRgtY; j++) {
-            for (int k=lookLftZ; k<=lookRgtZ; k++) {
-                double xx = fabs(X - (iX+i));
-                double yy = fabs(Y - (iY+j));
-                double zz = fabs(Z - (iZ+k));
-
-                double part_x = xx <= 1 ? 1-xx : 0;
-                double part_y = yy <= 1 ? 1-yy : 0;
-                double part_z = zz <= 1 ? 1-zz : 0;
-
-                sum += access_grid(lrs, iX+i, iY+j, iZ+k, N) * (part_x*part_y*part_z);
+    for (int i=0; i<2; i++) {
+        for (int j=0; j<2; j++) {
+            const double *row = cell + i * sx + j * sy;
+            const double wxy = wx[i] * wy[j];
+            for (int k=0; k<2; k++) {
+                sum += row[k] * wxy * wz[k];
             }
         }
     }
@@ -264,43 +253,25 @@ double gridCIC_dg(struct left_right_slice *lrs, double x, double y, double z, do
 }
 
 /* (Distributed grid version) Triangular shaped cloud interpolation */
-double gridTSC_dg(struct left_right_slice *lrs, double x, double y, double z, double boxlen, int N) {
-    /* Convert to float grid dimensions */
-    double X = x*N/boxlen;
-    double Y = y*N/boxlen;
-    double Z = z*N/boxlen;
+double gridTSC_dg(const struct ghost_slab *gs, double x, double y, double z, double boxlen) {
+    double dx, dy, dz;
+    const double *cell = ghost_slab_locate(gs, x, y, z, boxlen, 0.5, &dx, &dy, &dz);
+    const long int sx = gs->stride_x;
+    const long int sy = gs->stride_y;
 
-    /* Integer grid position */
-    int iX = (int) floor(X);
-    int iY = (int) floor(Y);
-    int iZ = (int) floor(Z);
-
-    /* Intepolate the necessary fields with CIC or TSC */
-    double lookLength = 1.5;
-    int lookLftX = (int) floor((X-iX) - lookLength);
-    int lookRgtX = (int) floor((X-iX) + lookLength);
-    int lookLftY = (int) floor((Y-iY) - lookLength);
-    int lookRgtY = (int) floor((Y-iY) + lookLength);
-    int lookLftZ = (int) floor((Z-iZ) - lookLength);
-    int lookRgtZ = (int) floor((Z-iZ) + lookLength);
+    /* One-dimensional weights for the cells at offsets -1, 0, and +1 */
+    const double wx[3] = {0.5*(0.5-dx)*(0.5-dx), 0.75-dx*dx, 0.5*(0.5+dx)*(0.5+dx)};
+    const double wy[3] = {0.5*(0.5-dy)*(0.5-dy), 0.75-dy*dy, 0.5*(0.5+dy)*(0.5+dy)};
+    const double wz[3] = {0.5*(0.5-dz)*(0.5-dz), 0.75-dz*dz, 0.5*(0.5+dz)*(0.5+dz)};
 
     /* Accumulate */
     double sum = 0;
-    for (int i=lookLftX; i<=lookRgtX; i++) {
-        for (int j=lookLftY; j<=lookRgtY; j++) {
-            for (int k=lookLftZ; k<=lookRgtZ; k++) {
-                double xx = fabs(X - (iX+i));
-                double yy = fabs(Y - (iY+j));
-                double zz = fabs(Z - (iZ+k));
-
-                double part_x = xx < 0.5 ? (0.75-xx*xx)
-                                        : (xx < 1.5 ? 0.5*(1.5-xx)*(1.5-xx) : 0);
-				double part_y = yy < 0.5 ? (0.75-yy*yy)
-                                        : (yy < 1.5 ? 0.5*(1.5-yy)*(1.5-yy) : 0);
-				double part_z = zz < 0.5 ? (0.75-zz*zz)
-                                        : (zz < 1.5 ? 0.5*(1.5-zz)*(1.5-zz) : 0);
-
-                sum += access_grid(lrs, iX+i, iY+j, iZ+k, N) * (part_x*part_y*part_z);
+    for (int i=0; i<3; i++) {
+        for (int j=0; j<3; j++) {
+            const double *row = cell + (i-1) * sx + (j-1) * sy - 1;
+            const double wxy = wx[i] * wy[j];
+            for (int k=0; k<3; k++) {
+                sum += row[k] * wxy * wz[k];
             }
         }
     }
@@ -309,43 +280,29 @@ double gridTSC_dg(struct left_right_slice *lrs, double x, double y, double z, do
 }
 
 /* (Distributed grid version) Piecewise cubic spline interpolation */
-double gridPCS_dg(struct left_right_slice *lrs, double x, double y, double z, double boxlen, int N) {
-    /* Convert to float grid dimensions */
-    double X = x*N/boxlen;
-    double Y = y*N/boxlen;
-    double Z = z*N/boxlen;
-
-    /* Integer grid position */
-    int iX = (int) floor(X);
-    int iY = (int) floor(Y);
-    int iZ = (int) floor(Z);
-
-    /* Intepolate the necessary fields with QIP */
-    double lookLength = 2;
-    int lookLftX = (int) floor((X-iX) - lookLength);
-    int lookRgtX = (int) floor((X-iX) + lookLength);
-    int lookLftY = (int) floor((Y-iY) - lookLength);
-    int lookRgtY = (int) floor((Y-iY) + lookLength);
-    int lookLftZ = (int) floor((Z-iZ) - lookLength);
-    int lookRgtZ = (int) floor((Z-iZ) + lookLength);
+double gridPCS_dg(const struct ghost_slab *gs, double x, double y, double z, double boxlen) {
+    double dx, dy, dz;
+    const double *cell = ghost_slab_locate(gs, x, y, z, boxlen, 0.0, &dx, &dy, &dz);
+    const long int sx = gs->stride_x;
+    const long int sy = gs->stride_y;
+
+    /* One-dimensional weights for the cells at offsets -1, 0, +1, and +2 */
+    const double ex = 1.0 - dx, ey = 1.0 - dy, ez = 1.0 - dz;
+    const double wx[4] = {ex*ex*ex, 4. - 6.*dx*dx + 3.*dx*dx*dx,
+                          4. - 6.*ex*ex + 3.*ex*ex*ex, dx*dx*dx};
+    const double wy[4] = {ey*ey*ey, 4. - 6.*dy*dy + 3.*dy*dy*dy,
+                          4. - 6.*ey*ey + 3.*ey*ey*ey, dy*dy*dy};
+    const double wz[4] = {ez*ez*ez, 4. - 6.*dz*dz + 3.*dz*dz*dz,
+                          4. - 6.*ez*ez + 3.*ez*ez*ez, dz*dz*dz};
 
     /* Accumulate */
     double sum = 0;
-    for (int i=lookLftX; i<=lookRgtX; i++) {
-        for (int j=lookLftY; j<=lookRgtY; j++) {
-            for (int k=lookLftZ; k<=lookRgtZ; k++) {
-                double xx = fabs(X - (iX+i));
-                double yy = fabs(Y - (iY+j));
-                double zz = fabs(Z - (iZ+k));
-
-                double part_x = xx < 1.0 ? (4. - 6.*xx*xx + 3.*xx*xx*xx)
-                                        : (xx < 2.0 ? (2.-xx)*(2.-xx)*(2.-xx) : 0);
-				double part_y = yy < 1.0 ? (4. - 6.*yy*yy + 3.*yy*yy*yy)
-                                        : (yy < 2.0 ? (2.-yy)*(2.-yy)*(2.-yy) : 0);
-				double part_z = zz < 1.0 ? (4. - 6.*zz*zz + 3.*zz*zz*zz)
-                                        : (zz < 2.0 ? (2.-zz)*(2.-zz)*(2.-zz) : 0);
-
-                sum += access_grid(lrs, iX+i, iY+j, iZ+k, N) * (part_x*part_y*part_z);
+    for (int i=0; i<4; i++) {
+        for (int j=0; j<4; j++) {
+            const double *row = cell + (i-1) * sx + (j-1) * sy - 1;
+            const double wxy = wx[i] * wy[j];
+            for (int k=0; k<4; k++) {
+                sum += row[k] * wxy * wz[k];
             }
         }
     }
@@ -356,6 +313,260 @@ double gridPCS_dg(struct left_right_slice *lrs, double x, double y, double z, do
     return sum;
 }
 
+/* Offsets and weights of the stencil points for a block of particles. The
+ * arrays are stored lane-wise, such that the values for the same stencil
+ * point of consecutive particles are contiguous. The offsets in the three
+ * directions add up to the index of the stencil point in the grid. */
+struct stencil_block {
+    long long int ox[4][INTERP_BATCH];
+    long long int oy[4][INTERP_BATCH];
+    long long int oz[4][INTERP_BATCH];
+    double wx[4][INTERP_BATCH];
+    double wy[4][INTERP_BATCH];
+    double wz[4][INTERP_BATCH];
+};
+
+/* The stencil of a Hermite window of given order (2 = CIC, 3 = TSC,
+ * 4 = PCS) consists of order cells, starting at the base cell + first */
+static inline int stencil_first(int order) {
+    return (order == 2) ? 0 : -1;
+}
+
+/* The base cell is the nearest cell for TSC and the cell on the left
+ * otherwise */
+static inline double stencil_shift(int order) {
+    return (order == 3) ? 0.5 : 0.0;
+}
+
+/* One-dimensional weights of the stencil cells for a particle at a distance
+ * d from the base cell */
+static inline void stencil_weights(int order, double d, double *w) {
+    if (order == 2) {
+        w[0] = 1.0 - d;
+        w[1] = d;
+    } else if (order == 3) {
+        w[0] = 0.5 * (0.5 - d) * (0.5 - d);
+        w[1] = 0.75 - d * d;
+        w[2] = 0.5 * (0.5 + d) * (0.5 + d);
+    } else {
+        /* Includes the 1/6 factor of the Piecewise Cubic Spline */
+        const double e = 1.0 - d;
+        w[0] = e * e * e / 6.;
+        w[1] = (4. - 6. * d * d + 3. * d * d * d) / 6.;
+        w[2] = (4. - 6. * e * e + 3. * e * e * e) / 6.;
+        w[3] = d * d * d / 6.;
+    }
+}
+
+/* Prepare the stencils for a block of n <= INTERP_BATCH particles in a
+ * contiguous N^3 array. Unused lanes repeat the last particle. */
+static inline void stencil_setup_box(struct stencil_block *sb, int order,
+                                     int N, double boxlen, int n,
+                                     const double *x, const double *y,
+                                     const double *z) {
+    const int first = stencil_first(order);
+    const double shift = stencil_shift(order);
+    const long long int NN = (long long int) N * N;
+
+    for (int l=0; l<INTERP_BATCH; l++) {
+        const int p = (l < n) ? l : n - 1;
+
+        /* Convert to float grid dimensions */
+        double X = x[p]*N/boxlen;
+        double Y = y[p]*N/boxlen;
+        double Z = z[p]*N/boxlen;
+
+        /* Integer grid position of the base cell */
+        int iX = (int) floor(X + shift);
+        int iY = (int) floor(Y + shift);
+        int iZ = (int) floor(Z + shift);
+
+        /* Compute the weights */
+        double wx[4], wy[4], wz[4];
+        stencil_weights(order, X - iX, wx);
+        stencil_weights(order, Y - iY, wy);
+        stencil_weights(order, Z - iZ, wz);
+
+        /* Store the weights and wrapped offsets */
+        for (int s=0; s<order; s++) {
+            sb->ox[s][l] = wrap(iX + first + s, N) * NN;
+            sb->oy[s][l] = wrap(iY + first + s, N) * N;
+            sb->oz[s][l] = wrap(iZ + first + s, N);
+            sb->wx[s][l] = wx[s];
+            sb->wy[s][l] = wy[s];
+            sb->wz[s][l] = wz[s];
+        }
+    }
+}
+
+/* Prepare the stencils for a block of n <= INTERP_BATCH particles in a
+ * ghost slab. The offsets are relative to the base pointer of the slab. */
+static inline void stencil_setup_slab(struct stencil_block *sb, int order,
+                                      const struct ghost_slab *gs,
+                                      double boxlen, int n, const double *x,
+                                      const double *y, const double *z) {
+    const int first = stencil_first(order);
+    const double shift = stencil_shift(order);
+
+    for (int l=0; l<INTERP_BATCH; l++) {
+        const int p = (l < n) ? l : n - 1;
+
+        /* Locate the base cell and compute the weights */
+        double dx, dy, dz, wx[4], wy[4], wz[4];
+        const double *cell = ghost_slab_locate(gs, x[p], y[p], z[p], boxlen,
+                                               shift, &dx, &dy, &dz);
+        stencil_weights(order, dx, wx);
+        stencil_weights(order, dy, wy);
+        stencil_weights(order, dz, wz);
+
+        /* Decompose the offset of the base cell */
+        const long long int offset = cell - gs->base;
+        const long long int lX = (offset + gs->ghost_NX * gs->stride_x) / gs->stride_x - gs->ghost_NX;
+        const long long int lYZ = offset - lX * gs->stride_x;
+
+        /* Store the weights and plain offsets (no wrapping needed) */
+        for (int s=0; s<order; s++) {
+            sb->ox[s][l] = (lX + first + s) * gs->stride_x;
+            sb->oy[s][l] = (first + s) * gs->stride_y;
+            sb->oz[s][l] = lYZ + first + s;
+            sb->wx[s][l] = wx[s];
+            sb->wy[s][l] = wy[s];
+            sb->wz[s][l] = wz[s];
+        }
+    }
+}
+
+/* Sum the weighted grid values over the stencils of a block of particles.
+ * With AVX-512 or AVX2, the particles are processed in parallel lanes and
+ * the grid values are fetched with gather instructions. */
+static inline void stencil_accumulate(const double *base,
+                                      const struct stencil_block *sb,
+                                      int order, double *out) {
+#if defined(__AVX512F__)
+    __m512d sum = _mm512_setzero_pd();
+    for (int i=0; i<order; i++) {
+        for (int j=0; j<order; j++) {
+            __m512i oxy = _mm512_add_epi64(_mm512_loadu_si512(sb->ox[i]),
+                                           _mm512_loadu_si512(sb->oy[j]));
+            __m512d wxy = _mm512_mul_pd(_mm512_loadu_pd(sb->wx[i]),
+                                        _mm512_loadu_pd(sb->wy[j]));
+            for (int k=0; k<order; k++) {
+                __m512i idx = _mm512_add_epi64(oxy, _mm512_loadu_si512(sb->oz[k]));
+                __m512d val = _mm512_i64gather_pd(idx, base, 8);
+                __m512d w = _mm512_mul_pd(wxy, _mm512_loadu_pd(sb->wz[k]));
+                sum = _mm512_fmadd_pd(val, w, sum);
+            }
+        }
+    }
+    _mm512_storeu_pd(out, sum);
+#elif defined(__AVX2__)
+    for (int h=0; h<INTERP_BATCH; h+=4) {
+        __m256d sum = _mm256_setzero_pd();
+        for (int i=0; i<order; i++) {
+            for (int j=0; j<order; j++) {
+                __m256i oxy = _mm256_add_epi64(_mm256_loadu_si256((const __m256i *) &sb->ox[i][h]),
+                                               _mm256_loadu_si256((const __m256i *) &sb->oy[j][h]));
+                __m256d wxy = _mm256_mul_pd(_mm256_loadu_pd(&sb->wx[i][h]),
+                                            _mm256_loadu_pd(&sb->wy[j][h]));
+                for (int k=0; k<order; k++) {
+                    __m256i idx = _mm256_add_epi64(oxy, _mm256_loadu_si256((const __m256i *) &sb->oz[k][h]));
+                    __m256d val = _mm256_i64gather_pd(base, idx, 8);
+                    __m256d w = _mm256_mul_pd(wxy, _mm256_loadu_pd(&sb->wz[k][h]));
+                    sum = _mm256_add_pd(sum, _mm256_mul_pd(val, w));
+                }
+            }
+        }
+        _mm256_storeu_pd(out + h, sum);
+    }
+#else
+    for (int l=0; l<INTERP_BATCH; l++) {
+        double sum = 0;
+        for (int i=0; i<order; i++) {
+            for (int j=0; j<order; j++) {
+                const double wxy = sb->wx[i][l] * sb->wy[j][l];
+                const long long int oxy = sb->ox[i][l] + sb->oy[j][l];
+                for (int k=0; k<order; k++) {
+                    sum += base[oxy + sb->oz[k][l]] * wxy * sb->wz[k][l];
+                }
+            }
+        }
+        out[l] = sum;
+    }
+#endif
+}
+
+/* Batched interpolation in a contiguous array with a window of given order */
+static void grid_batch(const double *box, int N, double boxlen, int order,
+                       int n, const double *x, const double *y,
+                       const double *z, double *out) {
+    struct stencil_block sb;
+    double block_out[INTERP_BATCH];
+
+    for (int b=0; b<n; b+=INTERP_BATCH) {
+        int m = (n - b < INTERP_BATCH) ? n - b : INTERP_BATCH;
+        stencil_setup_box(&sb, order, N, boxlen, m, x + b, y + b, z + b);
+        stencil_accumulate(box, &sb, order, block_out);
+        memcpy(out + b, block_out, m * sizeof(double));
+    }
+}
+
+/* Batched interpolation in a ghost slab with a window of given order */
+static void grid_dg_batch(const struct ghost_slab *gs, double boxlen,
+                          int order, int n, const double *x, const double *y,
+                          const double *z, double *out) {
+    struct stencil_block sb;
+    double block_out[INTERP_BATCH];
+
+    for (int b=0; b<n; b+=INTERP_BATCH) {
+        int m = (n - b < INTERP_BATCH) ? n - b : INTERP_BATCH;
+        stencil_setup_slab(&sb, order, gs, boxlen, m, x + b, y + b, z + b);
+        stencil_accumulate(gs->base, &sb, order, block_out);
+        memcpy(out + b, block_out, m * sizeof(double));
+    }
+}
+
+/* Batched cloud in cell interpolation */
+void gridCIC_batch(const double *box, int N, double boxlen, int n,
+                   const double *x, const double *y, const double *z,
+                   double *out) {
+    grid_batch(box, N, boxlen, 2, n, x, y, z, out);
+}
+
+/* Batched triangular shaped cloud interpolation */
+void gridTSC_batch(const double *box, int N, double boxlen, int n,
+                   const double *x, const double *y, const double *z,
+                   double *out) {
+    grid_batch(box, N, boxlen, 3, n, x, y, z, out);
+}
+
+/* Batched piecewise cubic spline interpolation */
+void gridPCS_batch(const double *box, int N, double boxlen, int n,
+                   const double *x, const double *y, const double *z,
+                   double *out) {
+    grid_batch(box, N, boxlen, 4, n, x, y, z, out);
+}
+
+/* (Distributed grid version) Batched cloud in cell interpolation */
+void gridCIC_dg_batch(const struct ghost_slab *gs, double boxlen, int n,
+                      const double *x, const double *y, const double *z,
+                      double *out) {
+    grid_dg_batch(gs, boxlen, 2, n, x, y, z, out);
+}
+
+/* (Distributed grid version) Batched triangular shaped cloud interpolation */
+void gridTSC_dg_batch(const struct ghost_slab *gs, double boxlen, int n,
+                      const double *x, const double *y, const double *z,
+                      double *out) {
+    grid_dg_batch(gs, boxlen, 3, n, x, y, z, out);
+}
+
+/* (Distributed grid version) Batched piecewise cubic spline interpolation */
+void gridPCS_dg_batch(const struct ghost_slab *gs, double boxlen, int n,
+                      const double *x, const double *y, const double *z,
+                      double *out) {
+    grid_dg_batch(gs, boxlen, 4, n, x, y, z, out);
+}
+
 /* Undo the Nearest grid point interpolation window function */
 int undoNGPWindow(fftw_complex *farr, int N, double boxlen) {
     /* Package the kernel parameter */
@@ -23,9 +23,12 @@
 #include "../include/header.h"
 #include "../include/mitos.h"
 
+/* Write the Header, Cosmology, and Units groups. The number of particles
+ * of each particle type that are stored in this file is given by file_counts
+ * (following the Gadget convention for snapshots split over multiple files). */
 int writeHeaderAttributes(struct params *pars, struct cosmology *cosmo,
                           struct units *us, struct particle_type **types,
-                          hid_t h_file) {
+                          const long long int *file_counts, hid_t h_file) {
 
     /* Create the Header group */
     hid_t h_grp = H5Gcreate(h_file, "/Header", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
@@ -64,7 +67,7 @@ int writeHeaderAttributes(struct params *pars, struct cosmology *cosmo,
     H5Aclose(h_attr);
 
     /* Create the NumFilesPerSnapshot attribute and write the data */
-    int num_files_per_snapshot = 1;
+    int num_files_per_snapshot = pars->NumFilesPerSnapshot;
     h_attr = H5Acreate1(h_grp, "NumFilesPerSnapshot", H5T_NATIVE_INT, h_aspace, H5P_DEFAULT);
     H5Awrite(h_attr, H5T_NATIVE_INT, &num_files_per_snapshot);
     H5Aclose(h_attr);
@@ -75,8 +78,9 @@ int writeHeaderAttributes(struct params *pars, struct cosmology *cosmo,
 
     /* Collect particle type attributes using the ExportNames */
     long long int numparts[7] = {0, 0, 0, 0, 0, 0, 0};
+    long long int numparts_this_file[7] = {0, 0, 0, 0, 0, 0, 0};
     long long int numparts_high_word[7] = {0, 0, 0, 0, 0, 0, 0}; //not used, so use zeros
-    double mass_table[7] = {0., 0., 0., 0., 0., 0., 0.}; //not used, so use zeros
+    double mass_table[7] = {0., 0., 0., 0., 0., 0., 0.}; //zero unless UseMassTable
     for (int i=0; i<7; i++) {
         char ptype_name[40];
         sprintf(ptype_name, "PartType%d", i);
@@ -86,10 +90,22 @@ int writeHeaderAttributes(struct params *pars, struct cosmology *cosmo,
             struct particle_type *ptype = *types + pti;
             if (strcmp(ptype->ExportName, ptype_name) == 0) {
                 numparts[i] += ptype->TotalNumber;
+                numparts_this_file[i] += file_counts[pti];
             }
         }
+
+        /* If requested, store uniform masses in the MassTable */
+        double mass;
+        if (pars->UseMassTable && exportGroupUniformMass(pars, types, ptype_name, &mass)) {
+            mass_table[i] = mass;
+        }
     }
 
+    /* Create the NumPart_ThisFile attribute and write the data */
+    h_attr = H5Acreate1(h_grp, "NumPart_ThisFile", H5T_NATIVE_LONG, h_aspace, H5P_DEFAULT);
+    H5Awrite(h_attr, H5T_NATIVE_LONG, numparts_this_file);
+    H5Aclose(h_attr);
+
     /* Create the NumPart_Total attribute and write the data */
     h_attr = H5Acreate1(h_grp, "NumPart_Total", H5T_NATIVE_LONG, h_aspace, H5P_DEFAULT);
     H5Awrite(h_attr, H5T_NATIVE_LONG, numparts);
@@ -293,7 +309,22 @@ int writeSwiftParameterFile(struct params *pars, struct cosmology *cosmo,
                                               : pars->GridSize;
 
     fprintf(f, "InitialConditions:\n");
-    fprintf(f, "  file_name:\t%s\n", pars->OutputFilename);
+    if (pars->NumFilesPerSnapshot > 1) {
+        /* SWIFT reads the initial conditions from a single file, so do not
+         * point it at one of the parts */
+        char first_fname[DEFAULT_STRING_LENGTH], last_fname[DEFAULT_STRING_LENGTH];
+        generateOutputFilename(pars, first_fname, 0);
+        generateOutputFilename(pars, last_fname, pars->NumFilesPerSnapshot - 1);
+        printf("Warning: the output is split over %d files, which have to be combined for SWIFT.\n",
+               pars->NumFilesPerSnapshot);
+
+        fprintf(f, "  # The particles are split over %d files (%s to %s).\n",
+                pars->NumFilesPerSnapshot, first_fname, last_fname);
+        fprintf(f, "  # Combine them into one file and set its name here.\n");
+        fprintf(f, "  # file_name:\t\n");
+    } else {
+        fprintf(f, "  file_name:\t%s\n", pars->OutputFilename);
+    }
     fprintf(f, "  periodic:\t%d\n", periodic);
     fprintf(f, "\n");
     fprintf(f, "Gravity:\n");
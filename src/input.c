@@ -26,24 +26,41 @@
 #include "../include/fft.h"
 
 int readParams(struct params *pars, const char *fname) {
-     pars->Seed = ini_getl("Random", "Seed", 1, fname);
+     pars->Seed = paramGetl("Random", "Seed", 1, fname);
 
-     pars->GridSize = ini_getl("Box", "GridSize", 64, fname);
-     pars->SmallGridSize = ini_getl("Box", "SmallGridSize", 0, fname);
-     pars->BoxLen = ini_getd("Box", "BoxLen", 1.0, fname);
-     pars->Splits = ini_getl("Box", "Splits", 1, fname);
-     pars->NeighbourSliverSize = ini_getl("Box", "NeighbourSliverSize", 6, fname);
+     pars->GridSize = paramGetl("Box", "GridSize", 64, fname);
+     pars->SmallGridSize = paramGetl("Box", "SmallGridSize", 0, fname);
+     pars->BoxLen = paramGetd("Box", "BoxLen", 1.0, fname);
+     pars->Splits = paramGetl("Box", "Splits", 1, fname);
+     pars->NeighbourSliverSize = paramGetl("Box", "NeighbourSliverSize", 6, fname);
+     pars->SortParticlesByCell = paramGetbool("Box", "SortParticlesByCell", 0, fname);
+     pars->ParticleMemoryMB = paramGetl("Box", "ParticleMemoryMB", 0, fname);
 
 
-     pars->MaxParticleTypes = ini_getl("Simulation", "MaxParticleTypes", 1, fname);
+     pars->MaxParticleTypes = paramGetl("Simulation", "MaxParticleTypes", 1, fname);
      pars->NumParticleTypes = 0; //should not be read, but inferred
-     pars->Homogeneous = ini_getbool("Simulation", "Homogeneous", 0, fname);
-     pars->MergeDarkMatterBaryons = ini_getbool("PerturbData", "MergeDarkMatterBaryons", 0, fname);
-     pars->GrowthFactorsFromSecondFile = ini_getbool("PerturbData", "GrowthFactorsFromSecondFile", 0, fname);
-     pars->SlabSize = ini_getl("Read", "SlabSize", 8000000, fname);
-     pars->HaloMinMass = ini_getd("Read", "HaloMinMass", 2.75e4, fname);
-     pars->HaloMaxMass = ini_getd("Read", "HaloMaxMass", 2.75e5, fname);
-     pars->PowerSpectrumBins = ini_getl("Read", "PowerSpectrumBins", 50, fname);
+     pars->Homogeneous = paramGetbool("Simulation", "Homogeneous", 0, fname);
+     pars->MergeDarkMatterBaryons = paramGetbool("PerturbData", "MergeDarkMatterBaryons", 0, fname);
+     pars->GrowthFactorsFromSecondFile = paramGetbool("PerturbData", "GrowthFactorsFromSecondFile", 0, fname);
+     pars->SelectiveLoading = paramGetbool("PerturbData", "SelectiveLoading", 1, fname);
+     pars->RestrictTimeRange = paramGetbool("PerturbData", "RestrictTimeRange", 0, fname);
+     pars->SlabSize = paramGetl("Read", "SlabSize", 8000000, fname);
+     pars->HaloMinMass = paramGetd("Read", "HaloMinMass", 2.75e4, fname);
+     pars->HaloMaxMass = paramGetd("Read", "HaloMaxMass", 2.75e5, fname);
+     pars->PowerSpectrumBins = paramGetl("Read", "PowerSpectrumBins", 50, fname);
+     pars->UseMassTable = paramGetbool("Output", "UseMassTable", 0, fname);
+     pars->CollectiveIO = paramGetbool("Output", "CollectiveIO", 1, fname);
+     pars->StripingFactor = paramGetl("Output", "StripingFactor", 0, fname);
+     pars->StripingUnit = paramGetl("Output", "StripingUnit", 0, fname);
+     pars->CollectiveBufferingNodes = paramGetl("Output", "CollectiveBufferingNodes", 0, fname);
+     pars->CollectiveBufferSize = paramGetl("Output", "CollectiveBufferSize", 0, fname);
+     pars->Alignment = paramGetl("Output", "Alignment", 0, fname);
+     pars->NumFilesPerSnapshot = paramGetl("Output", "NumFilesPerSnapshot", 1, fname);
+     pars->CompressionLevel = paramGetl("Output", "CompressionLevel", 0, fname);
+     pars->Shuffle = paramGetbool("Output", "Shuffle", 1, fname);
+     pars->AsyncWrite = paramGetbool("Output", "AsyncWrite", 1, fname);
+     pars->ProfileMPI = paramGetbool("Output", "ProfileMPI", 0, fname);
+     pars->Restart = paramGetbool("Output", "Restart", 0, fname);
 
      /* Read strings */
      int len = DEFAULT_STRING_LENGTH;
@@ -57,49 +74,53 @@ int readParams(struct params *pars, const char *fname) {
      pars->PerturbFile = malloc(len);
      pars->SecondPerturbFile = malloc(len);
      pars->SwiftParamFilename = malloc(len);
+     pars->TimingsFilename = malloc(len);
      pars->CrossSpectrumDensity1 = malloc(len);
      pars->CrossSpectrumDensity2 = malloc(len);
      pars->ReadGaussianFileName = malloc(len);
-     ini_gets("Output", "Directory", "./output", pars->OutputDirectory, len, fname);
-     ini_gets("Simulation", "Name", "No Name", pars->Name, len, fname);
-     ini_gets("Output", "Filename", "particles.hdf5", pars->OutputFilename, len, fname);
-     ini_gets("Output", "SwiftParamFilename", "swift_params.hdf5", pars->SwiftParamFilename, len, fname);
-     ini_gets("PerturbData", "File", "", pars->PerturbFile, len, fname);
-     ini_gets("PerturbData", "SecondFile", "", pars->SecondPerturbFile, len, fname);
-     ini_gets("Read", "Filename", "", pars->InputFilename, len, fname);
-     ini_gets("Read", "Filename2", "", pars->InputFilename2, len, fname);
-     ini_gets("Read", "ImportName", "", pars->ImportName, len, fname);
-     ini_gets("Read", "HaloFilename", "", pars->HaloInputFilename, len, fname);
-     ini_gets("Read", "CrossSpectrumDensity1", "", pars->CrossSpectrumDensity1, len, fname);
-     ini_gets("Read", "CrossSpectrumDensity2", "", pars->CrossSpectrumDensity2, len, fname);
-     ini_gets("Read", "ReadGaussianFileName", "", pars->ReadGaussianFileName, len, fname);
+     paramGets("Output", "Directory", "./output", pars->OutputDirectory, len, fname);
+     paramGets("Simulation", "Name", "No Name", pars->Name, len, fname);
+     paramGets("Output", "Filename", "particles.hdf5", pars->OutputFilename, len, fname);
+     paramGets("Output", "SwiftParamFilename", "swift_params.hdf5", pars->SwiftParamFilename, len, fname);
+     paramGets("Output", "TimingsFilename", "timings.json", pars->TimingsFilename, len, fname);
+     paramGets("PerturbData", "File", "", pars->PerturbFile, len, fname);
+     paramGets("PerturbData", "SecondFile", "", pars->SecondPerturbFile, len, fname);
+     paramGets("Read", "Filename", "", pars->InputFilename, len, fname);
+     paramGets("Read", "Filename2", "", pars->InputFilename2, len, fname);
+     paramGets("Read", "ImportName", "", pars->ImportName, len, fname);
+     paramGets("Read", "HaloFilename", "", pars->HaloInputFilename, len, fname);
+     paramGets("Read", "CrossSpectrumDensity1", "", pars->CrossSpectrumDensity1, len, fname);
+     paramGets("Read", "CrossSpectrumDensity2", "", pars->CrossSpectrumDensity2, len, fname);
+     paramGets("Read", "ReadGaussianFileName", "", pars->ReadGaussianFileName, len, fname);
 
      /* Read optional settings for the Firebolt Boltzmann solver */
-     pars->MaxMultipole = ini_getl("Firebolt", "MaxMultipole", 2000, fname);
-     pars->MaxMultipoleConvert = ini_getl("Firebolt", "MaxMultipoleConvert", 2, fname);
-     pars->NumberMomentumBins = ini_getl("Firebolt", "NumberMomentumBins", 10, fname);
-     pars->NumberWavenumbers = ini_getl("Firebolt", "NumberWavenumbers", 10, fname);
-     pars->FireboltCutoffWavenumber = ini_getd("Firebolt", "FireboltCutoffWavenumber", 1, fname);
-     pars->MinMomentum = ini_getd("Firebolt", "MinMomentum", 0.01, fname);
-     pars->MaxMomentum = ini_getd("Firebolt", "MaxMomentum", 15, fname);
-     pars->FireboltTolerance = ini_getd("Firebolt", "Tolerance", 1e-10, fname);
-     pars->FireboltVerbose = ini_getl("Firebolt", "Verbose", 0, fname);
-     pars->FireboltGridSize = ini_getl("Firebolt", "FireboltGridSize", 0, fname);
+     pars->MaxMultipole = paramGetl("Firebolt", "MaxMultipole", 2000, fname);
+     pars->MaxMultipoleConvert = paramGetl("Firebolt", "MaxMultipoleConvert", 2, fname);
+     pars->NumberMomentumBins = paramGetl("Firebolt", "NumberMomentumBins", 10, fname);
+     pars->NumberWavenumbers = paramGetl("Firebolt", "NumberWavenumbers", 10, fname);
+     pars->FireboltCutoffWavenumber = paramGetd("Firebolt", "FireboltCutoffWavenumber", 1, fname);
+     pars->MinMomentum = paramGetd("Firebolt", "MinMomentum", 0.01, fname);
+     pars->MaxMomentum = paramGetd("Firebolt", "MaxMomentum", 15, fname);
+     pars->FireboltTolerance = paramGetd("Firebolt", "Tolerance", 1e-10, fname);
+     pars->FireboltVerbose = paramGetl("Firebolt", "Verbose", 0, fname);
+     pars->FireboltGridSize = paramGetl("Firebolt", "FireboltGridSize", 0, fname);
+     pars->FireboltCacheFile = malloc(len);
+     paramGets("Firebolt", "CacheFile", "", pars->FireboltCacheFile, len, fname);
 
      return 0;
 }
 
 int readUnits(struct units *us, const char *fname) {
     /* Internal units */
-    us->UnitLengthMetres = ini_getd("Units", "UnitLengthMetres", 1.0, fname);
-    us->UnitTimeSeconds = ini_getd("Units", "UnitTimeSeconds", 1.0, fname);
-    us->UnitMassKilogram = ini_getd("Units", "UnitMassKilogram", 1.0, fname);
-    us->UnitTemperatureKelvin = ini_getd("Units", "UnitTemperatureKelvin", 1.0, fname);
-    us->UnitCurrentAmpere = ini_getd("Units", "UnitCurrentAmpere", 1.0, fname);
+    us->UnitLengthMetres = paramGetd("Units", "UnitLengthMetres", 1.0, fname);
+    us->UnitTimeSeconds = paramGetd("Units", "UnitTimeSeconds", 1.0, fname);
+    us->UnitMassKilogram = paramGetd("Units", "UnitMassKilogram", 1.0, fname);
+    us->UnitTemperatureKelvin = paramGetd("Units", "UnitTemperatureKelvin", 1.0, fname);
+    us->UnitCurrentAmpere = paramGetd("Units", "UnitCurrentAmpere", 1.0, fname);
 
     /* Get the transfer functions format */
     char format[DEFAULT_STRING_LENGTH];
-    ini_gets("TransferFunctions", "Format", "Plain", format, DEFAULT_STRING_LENGTH, fname);
+    paramGets("TransferFunctions", "Format", "Plain", format, DEFAULT_STRING_LENGTH, fname);
 
     /* Format of the transfer functions */
     int default_h_exponent;
@@ -114,10 +135,10 @@ int readUnits(struct units *us, const char *fname) {
         default_k_exponent = -2;
         default_sign = +1;
     }
-    us->TransferUnitLengthMetres = ini_getd("TransferFunctions", "UnitLengthMetres", MPC_METRES, fname);
-    us->Transfer_hExponent = ini_getl("TransferFunctions", "hExponent", default_h_exponent, fname);
-    us->Transfer_kExponent = ini_getl("TransferFunctions", "kExponent", default_k_exponent, fname);
-    us->Transfer_Sign = ini_getl("TransferFunctions", "Sign", default_sign, fname);
+    us->TransferUnitLengthMetres = paramGetd("TransferFunctions", "UnitLengthMetres", MPC_METRES, fname);
+    us->Transfer_hExponent = paramGetl("TransferFunctions", "hExponent", default_h_exponent, fname);
+    us->Transfer_kExponent = paramGetl("TransferFunctions", "kExponent", default_k_exponent, fname);
+    us->Transfer_Sign = paramGetl("TransferFunctions", "Sign", default_sign, fname);
 
     /* Some physical constants */
     us->SpeedOfLight = SPEED_OF_LIGHT_METRES_SECONDS * us->UnitTimeSeconds
@@ -138,14 +159,14 @@ int readUnits(struct units *us, const char *fname) {
 }
 
 int readCosmology(struct cosmology *cosmo, struct units *us, const char *fname) {
-     cosmo->h = ini_getd("Cosmology", "h", 0.70, fname);
-     cosmo->n_s = ini_getd("Cosmology", "n_s", 0.97, fname);
-     cosmo->A_s = ini_getd("Cosmology", "A_s", 2.215e-9, fname);
-     cosmo->k_pivot = ini_getd("Cosmology", "k_pivot", 0.05, fname);
-     cosmo->z_ini = ini_getd("Cosmology", "z_ini", 40.0, fname);
+     cosmo->h = paramGetd("Cosmology", "h", 0.70, fname);
+     cosmo->n_s = paramGetd("Cosmology", "n_s", 0.97, fname);
+     cosmo->A_s = paramGetd("Cosmology", "A_s", 2.215e-9, fname);
+     cosmo->k_pivot = paramGetd("Cosmology", "k_pivot", 0.05, fname);
+     cosmo->z_ini = paramGetd("Cosmology", "z_ini", 40.0, fname);
 
      /* Default value for z_source is z_ini */
-     cosmo->z_source = ini_getd("Cosmology", "z_source", cosmo->z_ini, fname);
+     cosmo->z_source = paramGetd("Cosmology", "z_source", cosmo->z_ini, fname);
 
      double H0 = 100 * cosmo->h * KM_METRES / MPC_METRES * us->UnitTimeSeconds;
      cosmo->rho_crit = 3 * H0 * H0 / (8 * M_PI * us->GravityG);
@@ -159,13 +180,16 @@ int cleanParams(struct params *pars) {
     free(pars->InputFilename);
     free(pars->InputFilename2);
     free(pars->HaloInputFilename);
+    free(pars->ImportName);
     free(pars->OutputFilename);
     free(pars->PerturbFile);
     free(pars->SecondPerturbFile);
     free(pars->SwiftParamFilename);
+    free(pars->TimingsFilename);
     free(pars->CrossSpectrumDensity1);
     free(pars->CrossSpectrumDensity2);
     free(pars->ReadGaussianFileName);
+    free(pars->FireboltCacheFile);
 
     return 0;
 }
@@ -373,3 +397,72 @@ int readFieldDimensions(int *N, double *box_len, const char *fname) {
 
     return 0;
 }
+
+/* Read the masses of a range of particles from a snapshot. If the group has
+ * no Masses dataset, the uniform mass is taken from the MassTable in the
+ * Header, as written with Output:UseMassTable. */
+int readParticleMasses(hid_t h_file, const char *group_name, hsize_t start,
+                       hsize_t count, double *masses) {
+    if (count == 0) return 0;
+
+    hid_t h_grp = H5Gopen(h_file, group_name, H5P_DEFAULT);
+    if (h_grp < 0) {
+        printf("Error opening group '%s'.\n", group_name);
+        return 1;
+    }
+
+    if (H5Lexists(h_grp, "Masses", H5P_DEFAULT) > 0) {
+        /* Open the masses dataset */
+        hid_t h_dat = H5Dopen(h_grp, "Masses", H5P_DEFAULT);
+
+        /* Select the hyperslab */
+        hid_t h_space = H5Dget_space(h_dat);
+        H5Sselect_hyperslab(h_space, H5S_SELECT_SET, &start, NULL, &count, NULL);
+
+        /* Create a memory space and read the data */
+        hid_t h_mems = H5Screate_simple(1, &count, NULL);
+        hid_t h_err = H5Dread(h_dat, H5T_NATIVE_DOUBLE, h_mems, h_space,
+                              H5P_DEFAULT, masses);
+
+        /* Close the spaces and the dataset */
+        H5Sclose(h_mems);
+        H5Sclose(h_space);
+        H5Dclose(h_dat);
+        H5Gclose(h_grp);
+
+        if (h_err < 0) {
+            printf("Error reading dataset 'Masses' of group '%s'.\n", group_name);
+            return 1;
+        }
+
+        return 0;
+    }
+
+    H5Gclose(h_grp);
+
+    /* The MassTable is indexed by the particle type number */
+    int type_number;
+    if (sscanf(group_name, "PartType%d", &type_number) != 1 || type_number < 0
+         || type_number > 6) {
+        printf("Error: group '%s' has no Masses and no MassTable entry.\n", group_name);
+        return 1;
+    }
+
+    double mass_table[7];
+    h_grp = H5Gopen(h_file, "Header", H5P_DEFAULT);
+    hid_t h_attr = H5Aopen(h_grp, "MassTable", H5P_DEFAULT);
+    hid_t h_err = (h_attr >= 0) ? H5Aread(h_attr, H5T_NATIVE_DOUBLE, mass_table) : -1;
+    if (h_attr >= 0) H5Aclose(h_attr);
+    H5Gclose(h_grp);
+
+    if (h_err < 0) {
+        printf("Error reading hdf5 attribute '%s'.\n", "MassTable");
+        return 1;
+    }
+
+    for (hsize_t i = 0; i < count; i++) {
+        masses[i] = mass_table[type_number];
+    }
+
+    return 0;
+}
@@ -24,6 +24,7 @@
 #include <mpi.h>
 #include <math.h>
 #include "../include/input_mpi.h"
+#include "../include/timers.h"
 
 int readField_MPI(double *data, int N, int NX, int X0, MPI_Comm comm,
                   const char *fname) {
@@ -71,6 +72,7 @@ int readField_MPI(double *data, int N, int NX, int X0, MPI_Comm comm,
 }
 
 int readFieldFile_dg(struct distributed_grid *dg, const char *fname) {
+    timerStart("Read fields");
 
     /* Open the hdf5 file */
     hid_t h_file = openFile_MPI(dg->comm, fname);
@@ -109,8 +111,10 @@ int readFieldFile_dg(struct distributed_grid *dg, const char *fname) {
     hid_t h_err = H5Dread(h_data, H5T_NATIVE_DOUBLE, h_memspace, h_space, H5P_DEFAULT, dg->box);
     if (h_err < 0) {
         printf("Error: reading chunk of hdf5 data.\n");
+        timerStop();
         return 1;
     }
+    timerAddBytes(chunk_dims[0] * chunk_dims[1] * chunk_dims[2] * sizeof(double), 0);
 
     /* Close the dataset, corresponding dataspace, and the Field group */
     H5Dclose(h_data);
@@ -124,5 +128,176 @@ int readFieldFile_dg(struct distributed_grid *dg, const char *fname) {
     /* We read a real box, so the distributed grid is in configuration space */
     dg->momentum_space = 0;
 
+    timerStop();
+
+    return 0;
+}
+
+/* Read the local slice and the ghost rows on either side into a ghost slab,
+ * wrapping around the box in the X-direction, and fill the padded cells */
+int readGhostSlab_MPI(struct ghost_slab *gs, MPI_Comm comm, const char *fname) {
+    timerStart("Read ghost slabs");
+
+    /* Open the hdf5 file */
+    hid_t h_file = openFile_MPI(comm, fname);
+
+    /* Open the Field group */
+    hid_t h_grp = H5Gopen(h_file, "Field", H5P_DEFAULT);
+
+    /* Open the Field dataset */
+    hid_t h_data = H5Dopen2(h_grp, "Field", H5P_DEFAULT);
+
+    /* Get the file dataspace */
+    hid_t h_space = H5Dget_space(h_data);
+
+    /* Dimensions of the padded array in memory */
+    const int N = gs->N;
+    const hsize_t mem_rank = 3;
+    const hsize_t mem_dims[3] = {gs->NX + 2 * gs->ghost_NX, N + 2 * gs->pad,
+                                 N + 2 * gs->pad};
+    hid_t h_memspace = H5Screate_simple(mem_rank, mem_dims, NULL);
+
+    /* Read the rows X0 - ghost_NX <= X < X0 + NX + ghost_NX, split into
+     * contiguous segments where the range wraps around the box */
+    int mem_row = 0;
+    int rows_left = mem_dims[0];
+    int err = 0;
+    while (rows_left > 0) {
+        int file_row = wrap(gs->X0 - gs->ghost_NX + mem_row, N);
+        int rows = (file_row + rows_left <= N) ? rows_left : N - file_row;
+
+        /* The segment in question (skipping any padding in the file) */
+        const hsize_t count[3] = {rows, N, N};
+        const hsize_t file_offset[3] = {file_row, 0, 0};
+        const hsize_t mem_offset[3] = {mem_row, gs->pad, gs->pad};
+
+        /* Select the corresponding hyperslabs */
+        H5Sselect_hyperslab(h_space, H5S_SELECT_SET, file_offset, NULL, count, NULL);
+        H5Sselect_hyperslab(h_memspace, H5S_SELECT_SET, mem_offset, NULL, count, NULL);
+
+        /* Read the data */
+        hid_t h_err = H5Dread(h_data, H5T_NATIVE_DOUBLE, h_memspace, h_space, H5P_DEFAULT, gs->data);
+        if (h_err < 0) {
+            printf("Error: reading chunk of hdf5 data.\n");
+            err = 1;
+            break;
+        }
+        timerAddBytes(count[0] * count[1] * count[2] * sizeof(double), 0);
+
+        mem_row += rows;
+        rows_left -= rows;
+    }
+
+    /* Close the dataset, corresponding dataspace, and the Field group */
+    H5Dclose(h_data);
+    H5Sclose(h_space);
+    H5Sclose(h_memspace);
+    H5Gclose(h_grp);
+
+    /* Close the file */
+    H5Fclose(h_file);
+
+    /* Copy the periodic images into the padded cells */
+    if (err == 0) {
+        err = fill_ghost_slab_padding(gs);
+    }
+
+    timerStop();
+
+    return err;
+}
+
+/* Broadcast perturbation data that were read on the root rank only */
+int broadcastPerturb_MPI(struct perturb_data *pt, int root, MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    /* Broadcast the dimensions */
+    int sizes[3] = {pt->k_size, pt->tau_size, pt->n_functions};
+    MPI_Bcast(sizes, 3, MPI_INT, root, comm);
+
+    const int k_size = sizes[0];
+    const int tau_size = sizes[1];
+    const int n_functions = sizes[2];
+    const long int delta_size = (long int) n_functions * k_size * tau_size;
+
+    /* Allocate memory on the other ranks */
+    if (rank != root) {
+        pt->k_size = k_size;
+        pt->tau_size = tau_size;
+        pt->n_functions = n_functions;
+        pt->k = malloc(k_size * sizeof(double));
+        pt->log_tau = malloc(tau_size * sizeof(double));
+        pt->redshift = malloc(tau_size * sizeof(double));
+        pt->D_growth = malloc(tau_size * sizeof(double));
+        pt->f_growth = malloc(tau_size * sizeof(double));
+        pt->H_Hubble = malloc(tau_size * sizeof(double));
+        pt->delta = malloc(delta_size * sizeof(double));
+        pt->Omega = malloc(n_functions * tau_size * sizeof(double));
+        pt->titles = malloc(n_functions * sizeof(char*));
+
+        /* Note that malloc(0) may return NULL, e.g. if no transfer functions
+         * were selected */
+        if ((k_size > 0 && pt->k == NULL) || (tau_size > 0 && pt->log_tau == NULL) ||
+            (delta_size > 0 && pt->delta == NULL) ||
+            (n_functions > 0 && tau_size > 0 && pt->Omega == NULL) ||
+            (n_functions > 0 && pt->titles == NULL)) {
+            printf("Error: unable to allocate memory for perturbation data.\n");
+            return 1;
+        }
+    }
+
+    /* Broadcast the vectors */
+    MPI_Bcast(pt->k, k_size, MPI_DOUBLE, root, comm);
+    MPI_Bcast(pt->log_tau, tau_size, MPI_DOUBLE, root, comm);
+    MPI_Bcast(pt->redshift, tau_size, MPI_DOUBLE, root, comm);
+    MPI_Bcast(pt->D_growth, tau_size, MPI_DOUBLE, root, comm);
+    MPI_Bcast(pt->f_growth, tau_size, MPI_DOUBLE, root, comm);
+    MPI_Bcast(pt->H_Hubble, tau_size, MPI_DOUBLE, root, comm);
+    MPI_Bcast(pt->Omega, n_functions * tau_size, MPI_DOUBLE, root, comm);
+
+    /* Broadcast the transfer functions in blocks that fit in an int */
+    const long int max_block = 1L << 30;
+    for (long int i = 0; i < delta_size; i += max_block) {
+        int count = (delta_size - i < max_block) ? delta_size - i : max_block;
+        MPI_Bcast(pt->delta + i, count, MPI_DOUBLE, root, comm);
+    }
+
+    /* Broadcast the titles */
+    for (int i = 0; i < n_functions; i++) {
+        int len = (rank == root) ? strlen(pt->titles[i]) + 1 : 0;
+        MPI_Bcast(&len, 1, MPI_INT, root, comm);
+        if (rank != root) {
+            pt->titles[i] = malloc(len);
+        }
+        MPI_Bcast(pt->titles[i], len, MPI_CHAR, root, comm);
+    }
+
     return 0;
 }
+
+/* Read a parameter file on the root rank only, broadcast its contents, and
+ * parse it into a table on every rank */
+int readParamTable_MPI(struct param_table *pt, const char *fname, int root,
+                       MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    /* Read the file on the root rank (size remains -1 on error) */
+    long int size = -1;
+    char *buffer = NULL;
+    if (rank == root) {
+        readParamFile(fname, &buffer, &size);
+    }
+
+    /* Broadcast the contents */
+    MPI_Bcast(&size, 1, MPI_LONG, root, comm);
+    if (size < 0) return 1;
+    if (rank != root) {
+        buffer = malloc(size + 1);
+    }
+    MPI_Bcast(buffer, size, MPI_CHAR, root, comm);
+    buffer[size] = '\0';
+
+    return parseParamTable(pt, fname, buffer);
+}
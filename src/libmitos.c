@@ -0,0 +1,1702 @@
+/*******************************************************************************
+ * This file is part of Mitos.
+ * Copyright (c) 2020 Willem Elbers (whe@willemelbers.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <assert.h>
+#include <complex.h>
+
+#include "../include/mitos.h"
+#include "../include/grf_ngeniclike.h"
+
+#define COMPILED_WITH_FIREBOLT 1
+#define FIREBOLT_EXPLICIT_CHECKS 1000
+
+#if(COMPILED_WITH_FIREBOLT)
+#include "../include/firebolt_interface.h"
+#endif
+
+/* The grids that are interpolated in the particle stage: the displacements
+ * and velocities in the x, y, and z directions and, for Firebolt, the
+ * density. Each is read as a ghost slab that covers the rows X0 <= X < X0 + NX
+ * and NeighbourSliverSize ghost rows on either side. */
+#define PARTICLE_GRID_DENSITY 6
+#define NUM_PARTICLE_GRIDS 7
+
+static int readParticleGrid(struct ghost_slab *gs, const struct params *pars,
+                            const struct particle_type *ptype, int grid,
+                            int N, int X0, int NX, MPI_Comm comm) {
+    const char letters[] = {'x', 'y', 'z'};
+    char fname[DEFAULT_STRING_LENGTH];
+    if (grid < 3) {
+        sprintf(fname, "%s/%s_%c_%s%s", pars->OutputDirectory, GRID_NAME_DISPLACEMENT, letters[grid], ptype->Identifier, ".hdf5");
+    } else if (grid < PARTICLE_GRID_DENSITY) {
+        sprintf(fname, "%s/%s_%c_%s%s", pars->OutputDirectory, GRID_NAME_VELOCITY, letters[grid - 3], ptype->Identifier, ".hdf5");
+    } else {
+        sprintf(fname, "%s/%s_%s%s", pars->OutputDirectory, GRID_NAME_DENSITY, ptype->Identifier, ".hdf5");
+    }
+
+    int err = alloc_ghost_slab(gs, N, X0, NX, pars->NeighbourSliverSize);
+    if (err > 0) {
+        printf("Error allocating ghost slab.\n");
+        return err;
+    }
+
+    err = readGhostSlab_MPI(gs, comm, fname);
+    if (err > 0) {
+        printf("Error reading '%s'.\n", fname);
+        free_ghost_slab(gs);
+        return err;
+    }
+
+    return 0;
+}
+
+/* Read the grids needed for a sub-chunk of particles. Only the rows that
+ * the particles can reach are read. */
+static int readParticleGrids(struct ghost_slab *grids, int num_grids,
+                             const struct params *pars,
+                             const struct particle_type *ptype, int N,
+                             long long int first, long long int num,
+                             int local_X0, MPI_Comm comm) {
+    int X0 = local_X0, NX = 0;
+    if (num > 0) {
+        particleGridRows(ptype, N, first, num, &X0, &NX);
+    }
+
+    for (int g=0; g<num_grids; g++) {
+        int err = readParticleGrid(&grids[g], pars, ptype, g, N, X0, NX, comm);
+        if (err > 0) return err;
+    }
+
+    return 0;
+}
+
+/* The largest error code over the ranks of comm */
+static int anyError_MPI(int err, MPI_Comm comm) {
+    MPI_Allreduce(MPI_IN_PLACE, &err, 1, MPI_INT, MPI_MAX, comm);
+    return err;
+}
+
+/* Print the message on the ranks where an error occurred and, if any rank
+ * failed, leave runMitos through the clean-up at its end. The error code is
+ * combined over all ranks, so the check must be reached by all ranks. */
+#define check_error(err, ...)                                           \
+    do {                                                                \
+        run_err = anyError_MPI(catch_error(err, __VA_ARGS__), comm);    \
+        if (run_err > 0) goto cleanup;                                  \
+    } while (0)
+
+int runMitos(const char *param_fname, MPI_Comm comm,
+             particle_callback callback, void *user_data) {
+    /* MPI is initialized by the caller. FFTW allows repeated initialization. */
+    fftw_mpi_init();
+
+    /* Particle data are written by a background thread, while the main
+     * thread waits to make any further MPI calls */
+    int thread_support;
+    MPI_Query_thread(&thread_support);
+
+    /* Get the dimensions of the cluster */
+    int rank, MPI_Rank_Count;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &MPI_Rank_Count);
+
+    /* Read options */
+    const char *fname = param_fname;
+    if (rank == 0) {
+        header(rank, "Mitos Initial Condition Generator");
+        message(rank, "The parameter file is '%s'\n", fname);
+    }
+
+    /* Timer */
+    struct timeval time_stop, time_start;
+    gettimeofday(&time_start, NULL);
+    resetTimers();
+    timerStart("Setup");
+
+    /* Without a callback, the particles are written to the output file */
+    const char write_particles = (callback == NULL);
+
+    /* The error code returned by runMitos */
+    int run_err = 0;
+
+    /* Mitos structuress. Everything that is allocated below is declared
+     * here, such that it can be released at the end, also after an error. */
+    struct params pars = {0};
+    struct units us;
+    struct particle_type *types = NULL;
+    struct export_group *export_groups = NULL;
+    struct cosmology cosmo;
+    struct perturb_data ptdat = {0};
+    struct perturb_data ptdat_alternative = {0};
+    struct perturb_spline spline = {0};
+    struct perturb_spline spline_alternative = {0};
+    struct perturb_params ptpars = {0};
+    struct param_table ptable = {0};
+
+    /* The titles of the transfer functions that are needed */
+    char **titles = NULL;
+    int n_titles = 0;
+
+    /* The Gaussian random field and the grids used to compute the perturbations */
+    struct distributed_grid grf = {0};
+    struct distributed_grid grid = {0};
+    struct distributed_grid potential = {0};
+    struct distributed_grid derivative = {0};
+
+    /* The output files, which are shared by the ranks of file_comm */
+    MPI_Comm file_comm = MPI_COMM_NULL;
+    long long int *file_counts = NULL;
+    long long int *rank_offsets = NULL;
+    long long int *file_positions = NULL;
+    hid_t h_out_file = -1;
+    hid_t h_xfer = -1;
+    hid_t h_grp = -1;
+
+    /* The state of the particle stage of the current particle type */
+    struct table_sampler thermal_sampler = {0};
+    struct ghost_slab grids[NUM_PARTICLE_GRIDS] = {0};
+    struct particle_data buffers[2] = {0};
+    struct particle_write pw = {0};
+    long long int *sort_order = NULL;
+
+    #if(COMPILED_WITH_FIREBOLT)
+    struct firebolt_interface firebolt;
+    /* Whether firebolt holds a solution, which can be reused by later types */
+    char firebolt_ready = 0;
+    /* Whether the (shared) grids of firebolt are allocated */
+    char firebolt_allocated = 0;
+    /* The Gaussian random field used by Firebolt, in real & Fourier space */
+    double *small_grid = NULL;
+    fftw_complex *small_grf = NULL;
+    #endif
+
+    /* Read the parameter file on the first rank only and broadcast it. The
+     * readers below look up their keys in the resulting table. */
+    int param_err = readParamTable_MPI(&ptable, fname, 0, comm);
+    check_error(param_err, "Error reading '%s'.\n", fname);
+    setParamTable(&ptable);
+
+    /* Read parameter file for parameters, units, and cosmological values */
+    readParams(&pars, fname);
+    readUnits(&us, fname);
+    readCosmology(&cosmo, &us, fname);
+
+    /* Optionally synchronize before communication to measure wait times */
+    setProfileMPI(pars.ProfileMPI);
+
+    /* Compression settings for the grids and particle data */
+    setOutputFilters_MPI(&pars);
+
+    /* Background writes require that MPI can be called from other threads */
+    if (pars.AsyncWrite && thread_support < MPI_THREAD_SERIALIZED) {
+        message(rank, "MPI does not support threads; writing particle data synchronously.\n");
+        pars.AsyncWrite = 0;
+    }
+
+    /* Store the MPI rank */
+    pars.rank = rank;
+
+    /* Open the manifest of completed stages, to restart a previous run */
+    struct checkpoint cp;
+    int cp_err = initCheckpoint(&cp, &pars, fname, comm);
+    check_error(cp_err, "Error opening the checkpoint manifest.\n");
+
+    message(rank, "The output directory is '%s'.\n", pars.OutputDirectory);
+    message(rank, "Creating initial conditions for '%s'.\n", pars.Name);
+
+    /* Read out particle types from the parameter file */
+    readTypes(&pars, &types, fname);
+
+    /* Match particle types with export groups */
+    fillExportGroups(&pars, &types, &export_groups);
+
+    /* Done with the parameter file */
+    cleanParamTable(&ptable);
+
+    /* Determine which transfer functions are needed (NULL = all) */
+    if (pars.SelectiveLoading) {
+        requiredTransferTitles(&pars, &types, &titles, &n_titles);
+    }
+
+    /* Optionally, discard the time steps before the start of the simulation.
+     * This is not possible with Firebolt, which integrates from early times. */
+    double z_max = 0.;
+    if (pars.RestrictTimeRange) {
+        char UseFirebolt = 0;
+        for (int pti = 0; pti < pars.NumParticleTypes; pti++) {
+            UseFirebolt |= types[pti].UseFirebolt;
+        }
+
+        if (UseFirebolt) {
+            message(rank, "Ignoring RestrictTimeRange, because Firebolt needs all time steps.\n");
+        } else {
+            z_max = fmax(cosmo.z_ini, cosmo.z_source);
+        }
+    }
+
+    /* Read the perturbation data file on the first rank and broadcast */
+    int perturb_err = 0;
+    if (rank == 0) {
+        perturb_err = readPerturbSelection(&pars, &us, &ptdat, pars.PerturbFile, titles, n_titles, z_max);
+    }
+    MPI_Bcast(&perturb_err, 1, MPI_INT, 0, comm);
+    check_error(perturb_err, "Error reading '%s'.\n", pars.PerturbFile);
+    perturb_err = broadcastPerturb_MPI(&ptdat, 0, comm);
+    check_error(perturb_err, "Error broadcasting perturbation data.\n");
+    readPerturbParams(&pars, &us, &ptpars, pars.PerturbFile);
+
+    /* Did the user requested a second alternative perturbation data file? */
+    if (strcmp(pars.SecondPerturbFile, "") != 0) {
+        message(pars.rank, "Opening another perturbation data file.\n");
+        if (rank == 0) {
+            perturb_err = readPerturbSelection(&pars, &us, &ptdat_alternative, pars.SecondPerturbFile, titles, n_titles, z_max);
+        }
+        MPI_Bcast(&perturb_err, 1, MPI_INT, 0, comm);
+        check_error(perturb_err, "Error reading '%s'.\n", pars.SecondPerturbFile);
+        perturb_err = broadcastPerturb_MPI(&ptdat_alternative, 0, comm);
+        check_error(perturb_err, "Error broadcasting perturbation data.\n");
+
+        /* Initialize the interpolation spline for the second data file */
+        initPerturbSpline(&spline_alternative, DEFAULT_K_ACC_TABLE_SIZE,
+                          &ptdat_alternative);
+    }
+
+    /* Do a sanity check */
+    if (fabs(cosmo.h - ptpars.h) / cosmo.h > 1e-5) {
+        check_error(1, "ERROR: h from parameter file does not match perturbation file.\n");
+    }
+
+    /* Merge cdm & baryons into one set of transfer functions (replacing cdm) */
+    if (pars.MergeDarkMatterBaryons) {
+        header(rank, "Merging cdm & baryon transfer functions, replacing cdm.");
+
+        /* The indices of the density transfer functions */
+        int index_cdm = findTitle(ptdat.titles, "d_cdm", ptdat.n_functions);
+        int index_b = findTitle(ptdat.titles, "d_b", ptdat.n_functions);
+
+        /* Find the present-day background densities */
+        int today_index = ptdat.tau_size - 1; // today corresponds to the last index
+        double Omega_cdm = ptdat.Omega[ptdat.tau_size * index_cdm + today_index];
+        double Omega_b = ptdat.Omega[ptdat.tau_size * index_b + today_index];
+
+        /* Do a sanity check */
+        assert(fabs(Omega_b - ptpars.Omega_b) / Omega_b < 1e-5);
+
+        /* Use the present-day densities as weights */
+        double weight_cdm = Omega_cdm / (Omega_cdm + Omega_b);
+        double weight_b = Omega_b / (Omega_cdm + Omega_b);
+
+        message(rank, "Using weights [w_cdm, w_b] = [%f, %f]\n", weight_cdm, weight_b);
+
+        /* Merge the density & velocity transfer runctions, replacing cdm */
+        mergeTransferFunctions(&ptdat, "d_cdm", "d_b", weight_cdm, weight_b);
+        mergeTransferFunctions(&ptdat, "t_cdm", "t_b", weight_cdm, weight_b);
+        /* Merge the background densities, replacing cdm */
+        mergeBackgroundDensities(&ptdat, "d_cdm", "d_b", 1.0, 1.0); //replace with sum
+    }
+
+    /* Initialize the interpolation spline for the perturbation data */
+    initPerturbSpline(&spline, DEFAULT_K_ACC_TABLE_SIZE, &ptdat);
+
+    /* Seed the random number generator */
+    rng_state seed = rand_uint64_init(pars.Seed + rank);
+
+    /* Determine the starting conformal time */
+    cosmo.log_tau_ini = perturbLogTauAtRedshift(&spline, cosmo.z_ini);
+    /* Determine the conformal time at the source redshift (usually z_ini) */
+    cosmo.log_tau_source = perturbLogTauAtRedshift(&spline, cosmo.z_source);
+
+    /* Should we use the primary perturbation data or the alternative data
+     * (if specified) for the growth factors? */
+     struct perturb_spline *growth_factors_spline;
+     if (pars.GrowthFactorsFromSecondFile) {
+         growth_factors_spline = &spline_alternative;
+         if (strcmp(pars.SecondPerturbFile, "") == 0) {
+             check_error(1, "Requested growth factors from second file without specifying second perturbation file.\n");
+         }
+     } else {
+         growth_factors_spline = &spline;
+     }
+
+    /* Compute the growth factors and rates (!! careful with log_taus from the alterative file !!)*/
+    const double log_tau_source = perturbLogTauAtRedshift(growth_factors_spline, cosmo.z_source);
+    const double log_tau_ini = perturbLogTauAtRedshift(growth_factors_spline, cosmo.z_ini);
+    const double a_source = 1.0 / (1.0 + cosmo.z_source);
+    const double a_ini = 1.0 / (1.0 + cosmo.z_ini);
+    const double D_source = perturbGrowthFactorAtLogTau(growth_factors_spline, log_tau_source);
+    const double D_ini = perturbGrowthFactorAtLogTau(growth_factors_spline, log_tau_ini);
+    const double f_source = perturbLogGrowthRateAtLogTau(growth_factors_spline, log_tau_source);
+    const double f_ini = perturbLogGrowthRateAtLogTau(growth_factors_spline, log_tau_ini);
+    const double H_source = perturbHubbleAtLogTau(growth_factors_spline, log_tau_source);
+    const double H_ini = perturbHubbleAtLogTau(growth_factors_spline, log_tau_ini);
+
+    /* Print some useful numbers */
+    if (rank == 0) {
+        header(rank, "Settings");
+        printf("Random numbers\t\t [seed] = [%ld]\n", pars.Seed);
+        printf("Starting time\t\t [z, tau] = [%.2f, %.2f U_T]\n", cosmo.z_ini, exp(cosmo.log_tau_ini));
+        printf("Source time\t\t [z, tau] = [%.2f, %.2f U_T]\n", cosmo.z_source, exp(cosmo.log_tau_source));
+        printf("Primordial power\t [A_s, n_s, k_pivot] = [%.4e, %.4f, %.4f U_L]\n\n", cosmo.A_s, cosmo.n_s, cosmo.k_pivot);
+
+        if (pars.GrowthFactorsFromSecondFile) {
+            printf("Using growth factors from second file: '%s'.\n", pars.SecondPerturbFile);
+        } else {
+            printf("Using growth factors from file: '%s'.\n", pars.PerturbFile);
+        }
+
+        printf("Growth factors\t\t [D_ini, D_source, ratio] = [%e, %e, %e]\n", D_ini, D_source, D_ini / D_source);
+        printf("Growth rates\t\t [f_ini, f_source, ratio] = [%e, %e, %e]\n", f_ini, f_source, f_ini / f_source);
+        printf("Hubble rates\t\t [H_ini, H_source, ratio] = [%e, %e, %e]\n", H_ini, H_source, H_ini / H_source);
+
+        header(rank, "Requested Particle Types");
+        for (int pti = 0; pti < pars.NumParticleTypes; pti++) {
+            /* The current particle type */
+            struct particle_type *ptype = types + pti;
+            printf("Particle type '%s' (N^3 = %d^3).\n", ptype->Identifier, ptype->CubeRootNumber);
+        }
+    }
+
+    timerStop();
+
+    /* Create or read a Gaussian random field */
+    timerStart("Random field");
+    int N;
+    double boxlen;
+
+    /* Generate a filename */
+    char grf_fname[DEFAULT_STRING_LENGTH];
+    sprintf(grf_fname, "%s/%s%s", pars.OutputDirectory, GRID_NAME_GAUSSIAN, ".hdf5");
+
+    /* Was the field already exported by a previous run? */
+    const int grf_checkpoint = skipGaussianField(&cp, &pars);
+    int err;
+
+    if (grf_checkpoint) {
+        /* Read the Gaussian random field from the checkpoint */
+        header(rank, "Reading Primordial Fluctuations");
+        message(rank, "Reading checkpoint '%s'.\n", grf_fname);
+        N = cp.N;
+        boxlen = cp.boxlen;
+
+        /* Allocate distributed memory arrays (one complex & one real) */
+        alloc_local_grid(&grf, N, boxlen, comm);
+
+        /* Read the real-space grid from the file */
+        err = readFieldFile_dg(&grf, grf_fname);
+        check_error(err, "Error while reading '%s'.\n", grf_fname);
+    } else if (strcmp(pars.ReadGaussianFileName, "") == 0) {
+        /* Create Gaussian random field */
+        N = pars.GridSize;
+        boxlen = pars.BoxLen;
+
+        /* Allocate distributed memory arrays (one complex & one real) */
+        alloc_local_grid(&grf, N, boxlen, comm);
+
+        /* Generate a complex Hermitian Gaussian random field */
+        header(rank, "Generating Primordial Fluctuations");
+        generate_complex_grf(&grf, &seed);
+        enforce_hermiticity(&grf);
+
+        /* Apply the bare power spectrum, without any transfer functions */
+        fft_apply_kernel_dg(&grf, &grf, kernel_power_no_transfer, &cosmo);
+
+        /* Execute the Fourier transform and normalize */
+        fft_c2r_dg(&grf);
+    } else {
+        /* Prepare to read the Gassian random field */
+        header(rank, "Reading Primordial Fluctuations");
+        message(rank, "Reading file '%s'.\n", pars.ReadGaussianFileName);
+
+        /* Read the field dimensions */
+        err = readFieldDimensions(&N, &boxlen, pars.ReadGaussianFileName);
+        check_error(err, "Error while reading '%s'.\n", pars.ReadGaussianFileName);
+
+        message(rank, "Read (N, BoxLen) = (%d, %.2f U_L)\n", N, boxlen);
+
+        /* Allocate distributed memory arrays (one complex & one real) */
+        alloc_local_grid(&grf, N, boxlen, comm);
+
+        /* Read the real-space grid from the file */
+        err = readFieldFile_dg(&grf, pars.ReadGaussianFileName);
+        check_error(err, "Error while reading '%s'.\n", pars.ReadGaussianFileName);
+    }
+
+    /* Compare the slab widths of the ranks */
+    reportLoadBalance_MPI(comm, "slab rows (NX)", grf.NX);
+
+    /* Export the Gaussian random field and its smaller copies, unless they
+     * were read from the checkpoint */
+    if (!grf_checkpoint) {
+        /* Export the real GRF */
+        err = writeFieldFile_dg(&grf, grf_fname);
+        check_error(err, "Error while writing '%s'.\n", grf_fname);
+        message(rank, "Pure Gaussian Random Field exported to '%s'.\n", grf_fname);
+
+        /* Create smaller (zoomed out) copies of the Gaussian random field */
+        for (int i=0; i<2; i++) {
+            /* Size of the smaller grid */
+            int M;
+
+            /* Generate a filename */
+            char small_fname[DEFAULT_STRING_LENGTH];
+
+            /* We do this twice, once if the user requests a SmallGridSize and
+             * another time if the user requests a FireboltGridSize. */
+            if (i == 0) {
+                M = pars.SmallGridSize;
+                sprintf(small_fname, "%s/%s%s", pars.OutputDirectory,  GRID_NAME_GAUSSIAN_SMALL, ".hdf5");
+            } else {
+                M = pars.FireboltGridSize;
+                sprintf(small_fname, "%s/%s%s", pars.OutputDirectory,  GRID_NAME_GAUSSIAN_FIREBOLT, ".hdf5");
+            }
+
+            if (M > 0) {
+                /* Allocate memory for the smaller grid on each node */
+                double *grf_small = fftw_alloc_real(M * M * M);
+
+                /* Shrink (our local slice of) the larger grf grid */
+                shrinkGrid_dg(grf_small, &grf, M, N);
+
+                /* Add the contributions from all nodes and send it to the root node */
+                commStart("Reduce small grid", comm);
+                if (rank == 0) {
+                    MPI_Reduce(MPI_IN_PLACE, grf_small, M * M * M, MPI_DOUBLE, MPI_SUM, 0, comm);
+                } else {
+                    MPI_Reduce(grf_small, grf_small, M * M * M, MPI_DOUBLE, MPI_SUM, 0, comm);
+                }
+                commStop((long long int) M * M * M * sizeof(double));
+
+                /* Export the assembled smaller copy on the root node */
+                if (rank == 0) {
+                    writeFieldFile(grf_small, M, boxlen, small_fname);
+                    message(rank, "Smaller copy of the Gaussian Random Field exported to '%s'.\n", small_fname);
+                }
+
+                /* Free the small grid */
+                fftw_free(grf_small);
+            }
+        }
+
+        /* Record the checkpoint */
+        err = markGaussianField(&cp, N, boxlen);
+        check_error(err, "Error writing checkpoint.\n");
+    }
+
+    /* Go back to momentum space */
+    fft_r2c_dg(&grf);
+    timerStop();
+
+    /* Retrieve background densities from the perturbations data file */
+    timerStart("Perturbation grids");
+    header(rank, "Fetching Background Densities");
+    retrieveDensities(&pars, &cosmo, &types, &ptdat);
+    retrieveMicroMasses(&pars, &cosmo, &types, &ptpars);
+
+    /* Allocate a second grid to compute densities */
+    alloc_local_grid(&grid, N, boxlen, comm);
+
+    /* Allocate a third grid to compute the potential */
+    alloc_local_grid(&potential, N, boxlen, comm);
+
+    /* Allocate a fourth grid to compute derivatives */
+    alloc_local_grid(&derivative, N, boxlen, comm);
+
+    /* Sanity check */
+    assert(grf.local_size == grid.local_size);
+    assert(grf.local_size == derivative.local_size);
+    assert(grf.X0 == grid.X0);
+    assert(grf.X0 == derivative.X0);
+
+
+    /* We calculate derivatives using FFT kernels */
+    const kernel_func derivative_kernels[] = {kernel_dx, kernel_dy, kernel_dz};
+    const char *letter[] = {"x_", "y_", "z_"};
+
+    header(rank, "Computing Perturbation Grids");
+
+    /* For each particle type, compute displacement & velocity grids */
+    for (int pti = 0; pti < pars.NumParticleTypes; pti++) {
+        struct particle_type *ptype = types + pti;
+        const char *Identifier = ptype->Identifier;
+        const char *density_title = ptype->TransferFunctionDensity;
+        const char *velocity_title = ptype->TransferFunctionVelocity;
+
+        /* Skip the grids that were exported by a previous run */
+        if (skipPerturbationGrids(&cp, &pars, ptype)) {
+            message(rank, "Reusing the checkpointed grids for '%s'.\n", Identifier);
+            continue;
+        }
+
+        /* Generate filenames for the grid exports */
+        char density_filename[DEFAULT_STRING_LENGTH];
+        char potential_filename[DEFAULT_STRING_LENGTH];
+        char velocity_filename[DEFAULT_STRING_LENGTH];
+        char velopot_filename[DEFAULT_STRING_LENGTH];
+        char derivative_filename[DEFAULT_STRING_LENGTH];
+
+        generateFieldFilename(&pars, density_filename, Identifier, GRID_NAME_DENSITY, "");
+        generateFieldFilename(&pars, potential_filename, Identifier, GRID_NAME_POTENTIAL, "");
+        generateFieldFilename(&pars, velocity_filename, Identifier, GRID_NAME_THETA, "");
+        generateFieldFilename(&pars, velopot_filename, Identifier, GRID_NAME_THETA_POTENTIAL, "");
+
+        /* Generate density field, compute the potential and its derivatives */
+        if (strcmp("", density_title) != 0) {
+
+            message(rank, "Computing density & displacement grids for '%s'.\n", Identifier);
+
+            /* If we are backscaling, multiply by the growth factor ratio */
+            double rescale_factor;
+            if (cosmo.z_ini != cosmo.z_source) {
+                rescale_factor = D_ini / D_source;
+            } else {
+                rescale_factor = 1.0;
+            }
+
+            /* Should we generate a density field or load it from the disk? */
+            if (strcmp(ptype->InputFilenameDensity, "") == 0) {
+              /* Generate density grid by applying the transfer function to the GRF */
+              err = generatePerturbationGrid(&cosmo, &spline, &grf, &grid, density_title, density_filename, rescale_factor);
+              check_error(err, "Error while generating '%s'.\n", density_filename);
+            } else {
+               /* Load input density field */
+               message(rank, "Loading density grid from '%s'.\n", ptype->InputFilenameDensity);
+               err = readFieldFile_dg(&grid, ptype->InputFilenameDensity);
+               check_error(err, "Error while loading '%s'.\n", ptype->InputFilenameDensity);
+            }
+
+            /* Fourier transform the density grid */
+            fft_r2c_dg(&grid);
+
+            /* Should we solve the Monge-Ampere equation or approximate with Zel'dovich? */
+            if (ptype->CyclesOfMongeAmpere > 0) {
+                /* Solve the Monge Ampere equation */
+                err = solveMongeAmpere(&potential, &grid, &derivative, ptype->CyclesOfMongeAmpere);
+            } else if (ptype->Run2LPT > 0) {
+                /* Solve for the 2LPT potential */
+                err = solve2LPT(&potential, &grid, &derivative, 1.0, -3./7.);
+            } else {
+                /* Approximate the potential with the Zel'dovich approximation */
+                fft_apply_kernel_dg(&potential, &grid, kernel_inv_poisson, NULL);
+            }
+
+            /* We now have the potential grid in momentum space */
+            assert(potential.momentum_space == 1);
+
+            /* Undo the TSC window function for later */
+            struct Hermite_kern_params Hkp;
+            Hkp.order = 3; //TSC
+            Hkp.N = N;
+            Hkp.boxlen = boxlen;
+
+            /* Apply the kernel */
+            fft_apply_kernel_dg(&potential, &potential, kernel_undo_Hermite_window, &Hkp);
+
+            /* Compute three derivatives of the potential grid */
+            for (int i=0; i<3; i++) {
+                /* Apply the derivative kernel */
+                fft_apply_kernel_dg(&derivative, &potential, derivative_kernels[i], NULL);
+
+                /* Fourier transform to get the real derivative grid */
+                fft_c2r_dg(&derivative);
+
+                /* Generate the appropriate filename */
+                generateFieldFilename(&pars, derivative_filename, Identifier, GRID_NAME_DISPLACEMENT, letter[i]);
+
+                /* Export the derivative grid */
+                writeFieldFile_dg(&derivative, derivative_filename);
+            }
+
+            /* Finally, Fourier transform the potential grid to configuration space */
+            fft_c2r_dg(&potential);
+
+            /* Export the potential grid */
+            writeFieldFile_dg(&potential, potential_filename);
+        }
+
+        /* Generate flux density field, flux potential, and its derivatives */
+        if (strcmp("", velocity_title) != 0) {
+
+            message(rank, "Computing flux density & velocity grids for '%s'.\n", Identifier);
+
+            /* If we are backscaling, multiply by the DaHf ratio */
+            double rescale_factor;
+            if (cosmo.z_ini != cosmo.z_source) {
+                rescale_factor = (a_ini * f_ini * H_ini) / (a_source * f_source * H_source);
+            } else {
+                rescale_factor = 1.0;
+            }
+
+            /* Should we generate a flux density field or load it from the disk? */
+            if (strcmp(ptype->InputFilenameVelocity, "") == 0) {
+              /* Generate flux grid by applying the transfer function to the GRF */
+              err = generatePerturbationGrid(&cosmo, &spline, &grf, &grid, velocity_title, velocity_filename, rescale_factor);
+              check_error(err, "Error while generating '%s'.\n", velocity_filename);
+            } else {
+               /* Load input flux density field */
+               message(rank, "Loading flux density grid from '%s'.\n", ptype->InputFilenameVelocity);
+               err = readFieldFile_dg(&grid, ptype->InputFilenameVelocity);
+               check_error(err, "Error while loading '%s'.\n", ptype->InputFilenameVelocity);
+            }
+
+            /* Fourier transform the flux density grid */
+            fft_r2c_dg(&grid);
+
+            if (ptype->Run2LPT > 0) {
+                /* Solve for the 2LPT potential */
+                err = solve2LPT(&potential, &grid, &derivative, -0.001147273637728, 3.19354920304769E-05);
+            } else {
+                /* Compute flux potential grid by applying the inverse Poisson kernel */
+                fft_apply_kernel_dg(&potential, &grid, kernel_inv_poisson, NULL);
+            }
+
+            /* Undo the TSC window function for later */
+            struct Hermite_kern_params Hkp;
+            Hkp.order = 3; //TSC
+            Hkp.N = N;
+            Hkp.boxlen = boxlen;
+
+            /* Apply the kernel */
+            fft_apply_kernel_dg(&potential, &potential, kernel_undo_Hermite_window, &Hkp);
+
+            /* Compute three derivatives of the flux potential grid */
+            for (int i=0; i<3; i++) {
+                /* Apply the derivative kernel */
+                fft_apply_kernel_dg(&derivative, &potential, derivative_kernels[i], NULL);
+
+                /* Fourier transform to get the real derivative grid */
+                fft_c2r_dg(&derivative);
+
+                /* Generate the appropriate filename */
+                generateFieldFilename(&pars, derivative_filename, Identifier, GRID_NAME_VELOCITY, letter[i]);
+
+                /* Export the derivative grid */
+                writeFieldFile_dg(&derivative, derivative_filename);
+            }
+
+            /* Finally, Fourier transform the flux potential grid to configuration space */
+            fft_c2r_dg(&potential);
+
+            /* Export the flux potential grid */
+            writeFieldFile_dg(&potential, velopot_filename);
+        }
+
+        /* Record the checkpoint */
+        err = markCheckpoint(&cp, CHECKPOINT_GRIDS, Identifier);
+        check_error(err, "Error writing checkpoint.\n");
+    }
+
+    /* We are done with the GRF, density, and derivative grids */
+    free_local_grid(&grid);
+    free_local_grid(&potential);
+    free_local_grid(&grf);
+    free_local_grid(&derivative);
+    timerStop();
+
+    // /* Compute SPT grids */
+    // header(rank, "Computing SPT Corrections");
+    // err = computePerturbedGrids(&pars, &us, &cosmo, types, GRID_NAME_DENSITY, GRID_NAME_THETA);
+    // if (err > 0) exit(1);
+
+
+
+    /* Create the beginning of a SWIFT parameter file */
+    timerStart("Output setup");
+    if (rank == 0) {
+        header(rank, "Creating SWIFT Parameter File");
+        char out_par_fname[DEFAULT_STRING_LENGTH];
+        sprintf(out_par_fname, "%s/%s", pars.OutputDirectory, pars.SwiftParamFilename);
+        printf("Creating output file '%s'.\n", out_par_fname);
+        writeSwiftParameterFile(&pars, &cosmo, &us, &types, &ptpars, out_par_fname);
+    }
+
+    /* The particle data can be split over multiple files, each of which
+     * is written by a contiguous group of ranks */
+    const int num_files = pars.NumFilesPerSnapshot;
+    check_error(num_files < 1 || num_files > MPI_Rank_Count,
+                "Error: NumFilesPerSnapshot = %d must be between 1 and the number of ranks (%d).\n", num_files, MPI_Rank_Count);
+
+    /* Since the slabs are assigned to the ranks in order, each file will
+     * contain a contiguous range of particles of each type */
+    const int file_id = (long int) rank * num_files / MPI_Rank_Count;
+    MPI_Comm_split(comm, file_id, rank, &file_comm);
+
+    /* Determine the number of particles of each type in this file, the
+     * offset of this rank within the file, and the position of the first
+     * particle of each type in its export group within the file */
+    file_counts = calloc(pars.NumParticleTypes, sizeof(long long int));
+    rank_offsets = calloc(pars.NumParticleTypes, sizeof(long long int));
+    file_positions = calloc(pars.NumParticleTypes, sizeof(long long int));
+    for (int pti = 0; pti < pars.NumParticleTypes; pti++) {
+        struct particle_type *ptype = types + pti;
+        long long int local_count = localParticleNumber(ptype, N, grf.X0, grf.NX);
+
+        MPI_Allreduce(&local_count, &file_counts[pti], 1, MPI_LONG_LONG, MPI_SUM, file_comm);
+        MPI_Exscan(&local_count, &rank_offsets[pti], 1, MPI_LONG_LONG, MPI_SUM, file_comm);
+
+        /* The result of MPI_Exscan is undefined on the first rank */
+        int file_rank;
+        MPI_Comm_rank(file_comm, &file_rank);
+        if (file_rank == 0) rank_offsets[pti] = 0;
+
+        /* Preceding particle types with the same ExportName come first */
+        for (int ptj = 0; ptj < pti; ptj++) {
+            if (strcmp(types[ptj].ExportName, ptype->ExportName) == 0) {
+                file_positions[pti] += file_counts[ptj];
+            }
+        }
+    }
+
+    /* The output file and the property list for the particle data transfers
+     * are not needed if the particles are handed to a callback */
+    if (write_particles) {
+        /* Name of the main output file containing the initial conditions. When
+         * the output is split, the files are numbered as name.i.hdf5 */
+        header(rank, "Initializing Output File");
+        char out_fname[DEFAULT_STRING_LENGTH];
+        sprintf(out_fname, "%s/", pars.OutputDirectory);
+        generateOutputFilename(&pars, out_fname + strlen(out_fname), file_id);
+        if (num_files > 1) {
+            message(rank, "Splitting the output over %d files.\n", num_files);
+        }
+
+        /* Reopen the output file if it was created by a previous run */
+        const int output_checkpoint = skipParticleStage(&cp, "OutputFile");
+        if (output_checkpoint) {
+            message(rank, "Reopening output file '%s'.\n", out_fname);
+            h_out_file = openFile_MPI(file_comm, out_fname);
+            check_error(h_out_file < 0, "Error: could not reopen '%s'. Set Restart = 0 to start over.\n", out_fname);
+        } else {
+            message(rank, "Creating output file '%s'.\n", out_fname);
+
+            /* Create the output file collectively within the file group, with the
+             * MPI-IO hints and dataset alignment from the parameter file */
+            h_out_file = createFileTuned_MPI(file_comm, out_fname, &pars);
+            check_error(h_out_file < 0, "Error: could not create '%s'.\n", out_fname);
+
+            /* Writing attributes into the Header & Cosmology groups */
+            err = writeHeaderAttributes(&pars, &cosmo, &us, &types, file_counts, h_out_file);
+            check_error(err, "Error writing the header of '%s'.\n", out_fname);
+
+            /* Create an HDF5 Group for each ExportName */
+            for (int i = 0; i < pars.NumExportGroups; i++) {
+                /* The current export group */
+                struct export_group *grp = export_groups + i;
+
+                /* The number of particles in this file that are mapped to this ExportName */
+                long long int partnum = 0;
+                for (int pti = 0; pti < pars.NumParticleTypes; pti++) {
+                    if (strcmp(types[pti].ExportName, grp->ExportName) == 0) {
+                        partnum += file_counts[pti];
+                    }
+                }
+
+                /* The ExportName */
+                const char *ExportName = grp->ExportName;
+
+                /* Create the particle group in the output file */
+                message(rank, "Creating Group '%s' with %lld particles.\n", ExportName, partnum);
+                h_grp = H5Gcreate(h_out_file, ExportName, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+
+                /* Create the datasets, with masses unless stored in the MassTable */
+                double mass;
+                const char with_masses = !pars.UseMassTable || !exportGroupUniformMass(&pars, &types, ExportName, &mass);
+                err = createParticleDatasets(h_grp, partnum, with_masses);
+                check_error(err, "Error creating the particle datasets.\n");
+
+                /* Close the group */
+                H5Gclose(h_grp);
+                h_grp = -1;
+            }
+
+            /* Make sure that the empty file is complete on disk */
+            H5Fflush(h_out_file, H5F_SCOPE_GLOBAL);
+            err = markCheckpoint(&cp, CHECKPOINT_PARTICLES, "OutputFile");
+            check_error(err, "Error writing checkpoint.\n");
+        }
+
+        /* Property list for the particle data transfers */
+        h_xfer = createTransferList_MPI(&pars);
+    } else {
+        message(rank, "Handing the particles to the caller instead of writing them.\n");
+    }
+    timerStop();
+
+    /* For each user-defined particle type */
+    for (int pti = 0; pti < pars.NumParticleTypes; pti++) {
+        /* The current particle type */
+        struct particle_type *ptype = types + pti;
+
+        char str[50];
+        sprintf(str, "Generating Particle Type '%s'.", ptype->Identifier);
+        header(rank, str);
+
+        /* Skip empty particle types */
+        if (ptype->TotalNumber <= 0) {
+            printf("No particles requested.\n");
+            continue;
+        }
+
+        /* Skip the particle types that were written by a previous run */
+        if (write_particles && skipParticleStage(&cp, ptype->Identifier)) {
+            message(rank, "The particles were written by a previous run.\n");
+            continue;
+        }
+
+        timerStart("Particles");
+
+        /* ID of the first particle of this type */
+        const long long int id_first_particle = ptype->FirstID;
+
+        /* For diagnostics, count how many draws are needed from the
+         * thermal distribution */
+        long long thermal_draws = 0;
+
+        /* For diagnostics, estimate the correlation between the 0th order
+         * phase space density perturbation Psi_0 & the configuration space
+         * density perturbation. (Should be order 1.)  */
+        double Psi_sum = 0.;
+        double Psi2_sum = 0.;
+        double d_sum = 0.;
+        double d2_sum = 0.;
+        double Psi_d_sum = 0.;
+
+        /* For diagnostics, estimate the ratio of particles whose 1st order
+         * phase space density perturbation Psi_1 is positive along the
+         * graviational flow speed direction. (Should be order 1.) */
+        long long int correctly_oriented = 0;
+        long long int explicit_Psi_checks = 0;
+
+        /* The number of invalid draws from the thermal distribution */
+        long long int invalid_draws = 0;
+
+        /* Microscopic mass in electronVolts */
+        double M_eV;
+        /* Convert the temperature to electronVolts */
+        double T_eV;
+        /* Chemical potential */
+        double mu_eV;
+
+        /* Initialize a random sampler if this particle type is thermal */
+        if (strcmp(ptype->ThermalMotionType, "") != 0) {
+            /* Check if the type of thermal motion is supported */
+            pdf function;
+            /* Domain of the probability function */
+            double xl, xr;
+
+            if (strcmp(ptype->ThermalMotionType, FERMION_TYPE) == 0) {
+                function = fd_pdf;
+                xl = THERMAL_MIN_MOMENTUM; //units of kb*T
+                xr = THERMAL_MAX_MOMENTUM; //units of kb*T
+            } else if (strcmp(ptype->ThermalMotionType, BOSON_TYPE) == 0) {
+                function = be_pdf;
+                xl = THERMAL_MIN_MOMENTUM; //units of kb*T
+                xr = THERMAL_MAX_MOMENTUM; //units of kb*T
+            } else {
+                check_error(1, "ERROR: unsupported ThermalMotionType '%s'.\n", ptype->ThermalMotionType);
+            }
+
+            /* Microscopic mass in electronVolts */
+            M_eV = ptype->MicroscopicMass_eV;
+            /* Convert the temperature to electronVolts */
+            T_eV = ptype->MicroscopyTemperature * us.kBoltzmann / us.ElectronVolt;
+            /* Chemical potential */
+            mu_eV = 0;
+
+            /* Rescale the domain */
+            xl *= T_eV;
+            xr *= T_eV;
+
+            /* Initialize the sampler */
+            double thermal_params[2] = {T_eV, mu_eV};
+
+            err = initTableSampler(&thermal_sampler, function, xl, xr, thermal_params);
+            check_error(err, "Error initializing the thermal motion sampler.\n");
+
+            message(rank, "Thermal motion: %s with [M, T] = [%e eV, %e eV].\n",
+                    ptype->ThermalMotionType, M_eV, T_eV);
+
+            /* Beyond the zeroth order Fermi-Dirac distribution, we can use the
+             * linear theory perturbation from a Boltzmann code. */
+
+            /* Use the Firebolt Boltzmann code */
+            #if(COMPILED_WITH_FIREBOLT)
+            if (ptype->UseFirebolt) {
+                timerStart("Firebolt");
+
+                /* Firebolt runs on the first rank only. Its grids are then
+                 * shared by the ranks on each node. First, load the correct
+                 * Gaussian random field, which is part of the key. */
+                int K = 0;
+                err = 0;
+                if (rank == 0) {
+                    char read_small_fname[DEFAULT_STRING_LENGTH];
+
+                    /* If the user specified a FireboltGridSize, use that grid */
+                    if (pars.FireboltGridSize > 0) {
+                        K = pars.FireboltGridSize;
+                        sprintf(read_small_fname, "%s/%s%s", pars.OutputDirectory, GRID_NAME_GAUSSIAN_FIREBOLT, ".hdf5");
+                    }
+                    /* Otherwise, if the SmallGridSize was specified, use that */
+                    else if (pars.SmallGridSize > 0) {
+                        K = pars.SmallGridSize;
+                        sprintf(read_small_fname, "%s/%s%s", pars.OutputDirectory, GRID_NAME_GAUSSIAN_SMALL, ".hdf5");
+                    }
+                    /* Otherwise, use the full Gaussian random field */
+                    else {
+                        K = N;
+                        sprintf(read_small_fname, "%s/%s%s", pars.OutputDirectory, GRID_NAME_GAUSSIAN, ".hdf5");
+                    }
+
+                    /* Read the real Gaussian field from disk */
+                    int read_N;
+                    double read_boxlen;
+                    err = readFieldFile(&small_grid, &read_N, &read_boxlen, read_small_fname);
+
+                    /* Check that the sizes match what we expect */
+                    if (err == 0 && (read_N != K || read_boxlen != boxlen)) {
+                        printf("Incorrect field dimensions in file (%d, %f) != (%d, %f)\n", read_N, read_boxlen, N, boxlen);
+                        err = 1;
+                    }
+                }
+                check_error(err, "Error while loading the Gaussian random field for Firebolt.\n");
+
+                /* The parameters that determine the Firebolt solution */
+                double firebolt_key[FIREBOLT_KEY_LENGTH];
+                if (rank == 0) {
+                    fireboltKey(&pars, &cosmo, &ptdat, M_eV, T_eV, small_grid, (long int) K * K * K, firebolt_key);
+                }
+                MPI_Bcast(firebolt_key, FIREBOLT_KEY_LENGTH, MPI_DOUBLE, 0, comm);
+
+                /* Reuse the solution of a previous type if possible */
+                const char firebolt_reuse = firebolt_ready && fireboltKeyMatches(&firebolt, firebolt_key);
+                if (firebolt_reuse) {
+                    message(rank, "Reusing the Firebolt solution of a previous particle type.\n");
+                } else if (firebolt_ready) {
+                    /* Discard a solution for different parameters */
+                    cleanFirebolt(&firebolt);
+                    firebolt_ready = 0;
+                    firebolt_allocated = 0;
+                }
+
+                /* Allocate shared memory for the grids, one copy per node */
+                if (!firebolt_reuse) {
+                    err = allocFireboltGrids_MPI(&firebolt, &pars, 0, comm);
+                    check_error(err, "Error allocating the Firebolt grids.\n");
+                    firebolt_allocated = 1;
+                }
+
+                /* Otherwise, try to load the solution from a previous run */
+                char firebolt_loaded = 0;
+                if (!firebolt_reuse && rank == 0 && strcmp(pars.FireboltCacheFile, "") != 0 &&
+                    readFireboltCache(&pars, firebolt_key, &firebolt, pars.FireboltCacheFile) == 0) {
+                    message(rank, "Read the Firebolt solution from '%s'.\n", pars.FireboltCacheFile);
+                    firebolt_loaded = 1;
+                }
+
+                if (!firebolt_reuse && rank == 0 && !firebolt_loaded) {
+                    /* Allocate small complex 3D array */
+                    small_grf = (fftw_complex*) malloc(K*K*(K/2+1)*sizeof(fftw_complex));
+
+                    /* Compute the Fourier transform */
+                    fftw_plan small_r2c = fftw_plan_dft_r2c_3d(K, K, K, small_grid, small_grf, FFTW_ESTIMATE);
+                    fft_execute(small_r2c);
+                    fft_normalize_r2c(small_grf, K, boxlen);
+                    fftw_destroy_plan(small_r2c);
+
+                    /* Free the real box, because we only need the complex grid */
+                    free(small_grid);
+                    small_grid = NULL;
+
+                    /* Initialize the Firebolt Boltzmann code */
+                    err = initFirebolt(&pars, &cosmo, &us, &ptdat, &spline, &firebolt, small_grf, M_eV, T_eV, firebolt_key);
+                    catch_error(err, "Error running Firebolt.\n");
+
+                    /* The random field is no longer needed */
+                    free(small_grf);
+                    small_grf = NULL;
+
+                    /* Store the solution for later runs */
+                    if (err == 0 && strcmp(pars.FireboltCacheFile, "") != 0) {
+                        err = writeFireboltCache(&firebolt, pars.FireboltCacheFile);
+                        catch_error(err, "Error writing the Firebolt cache file.\n");
+                        if (err == 0) {
+                            message(rank, "Stored the Firebolt solution in '%s'.\n", pars.FireboltCacheFile);
+                        }
+                    }
+                }
+
+                /* The real field is not needed if the solution was reused */
+                free(small_grid);
+                small_grid = NULL;
+
+                /* Firebolt runs on the first rank only, so share its errors */
+                run_err = anyError_MPI(err, comm);
+                if (run_err > 0) goto cleanup;
+
+                /* Send the grids to the other nodes */
+                if (!firebolt_reuse) {
+                    err = shareFireboltGrids_MPI(&firebolt, 0, comm);
+                    check_error(err, "Error sharing the Firebolt grids.\n");
+                    firebolt_ready = 1;
+                }
+
+                timerStop();
+            }
+            #endif
+        }
+
+        /* The particle group in the output file */
+        if (write_particles) {
+            h_grp = H5Gopen(h_out_file, ptype->ExportName, H5P_DEFAULT);
+        }
+
+        /* We read the displacement & velocity fields as distributed grids.
+         * Once again, the local slice will be of size NX * N * (N + 2),
+         * where the last two rows are padding and contain no useful info. */
+
+        /* The local slice runs from local_X0 <= X < local_X0 + local_NX */
+        int local_X0 = grf.X0;
+        int local_NX = grf.NX;
+
+        /* The particles are also generated from a grid with dimension M^3 */
+        int M = ptype->CubeRootNumber;
+
+        /* Determine what particles belong to this slice */
+        double fac = (double) M / N;
+        int X_min = ceil(local_X0 * fac);
+        int X_max = ceil((local_X0 + local_NX) * fac);
+        int MX = X_max - X_min;
+
+        /* The dimensions of this chunk of particles */
+        const hsize_t start = (hsize_t) X_min * M * M;
+        const hsize_t remaining = ptype->TotalNumber - start;
+        const hsize_t chunk_size = (hsize_t) MX * M * M;
+
+        /* Sanity check */
+        assert(chunk_size <= remaining); //not out of bounds
+        assert((local_X0 + local_NX) < N || chunk_size == remaining); //exhaustive
+        assert(chunk_size == localParticleNumber(ptype, N, local_X0, local_NX)); //matches the file layout
+
+        /* We will also read ghost rows of the grids on both the left and the right */
+        int extra_width = pars.NeighbourSliverSize;
+
+        printf("%03d: Local [%04d, %04d] ghost rows %d particles [%04d, %04d]\n", rank, local_X0, local_X0 + local_NX, extra_width, X_min, X_max);
+
+        /* Compare the numbers of particles of the ranks */
+        char balance_name[DEFAULT_STRING_LENGTH];
+        sprintf(balance_name, "particles of type '%s'", ptype->Identifier);
+        reportLoadBalance_MPI(comm, balance_name, chunk_size);
+
+        /* The grids are read separately for each sub-chunk, covering only the
+         * rows that its particles can reach. HDF5 calls must not overlap with
+         * a background write, so with AsyncWrite all grids of the next
+         * sub-chunk are read between two writes. Otherwise, the grids are read
+         * and freed one at a time, when needed. */
+        const char use_density = strcmp(ptype->ThermalMotionType, "") != 0 && ptype->UseFirebolt;
+        const int num_grids = use_density ? NUM_PARTICLE_GRIDS : PARTICLE_GRID_DENSITY;
+        const char prefetch_grids = write_particles && pars.AsyncWrite;
+        const int grids_held = prefetch_grids ? num_grids : 1;
+
+        /* The local particles are processed in sub-chunks. While one
+         * sub-chunk is written, the next one is generated. The size of the
+         * sub-chunks is limited by the ChunkSize of the particle type and by
+         * ParticleMemoryMB, which bounds the memory of the particles and of
+         * the grids held for a sub-chunk. */
+        long long int subchunk_size = DEFAULT_PARTICLE_SUBCHUNK_SIZE;
+        if (pars.ParticleMemoryMB > 0) {
+            const long long int max_bytes = pars.ParticleMemoryMB * 1000000LL;
+            const long long int particle_bytes = particleStageBytes(pars.SortParticlesByCell);
+            const long long int row_bytes = (long long int) (N + 2 * GHOST_SLAB_PADDING)
+                                          * (N + 2 * GHOST_SLAB_PADDING) * sizeof(double);
+
+            /* Find the largest sub-chunk that fits, by bisection */
+            long long int lo = 0, hi = (chunk_size > 0) ? chunk_size : 1;
+            long long int min_bytes = 0;
+            while (lo < hi) {
+                long long int mid = hi - (hi - lo) / 2;
+                long long int rows = maxParticleGridRows(ptype, N, mid) + 2 * extra_width;
+                long long int bytes = mid * particle_bytes + grids_held * rows * row_bytes;
+                if (bytes <= max_bytes) {
+                    lo = mid;
+                } else {
+                    hi = mid - 1;
+                    min_bytes = bytes;
+                }
+            }
+
+            check_error(lo < 1, "Error: ParticleMemoryMB = %ld is too small; a single particle requires %.1f MB.\n", pars.ParticleMemoryMB, min_bytes / 1e6);
+            subchunk_size = lo;
+        }
+        if (ptype->ChunkSize > 0 && ptype->ChunkSize < subchunk_size) {
+            subchunk_size = ptype->ChunkSize;
+        }
+
+        /* All ranks process the same number of (possibly empty) sub-chunks,
+         * such that the collective writes match up */
+        long long int num_subchunks = (chunk_size + subchunk_size - 1) / subchunk_size;
+        MPI_Allreduce(MPI_IN_PLACE, &num_subchunks, 1, MPI_LONG_LONG, MPI_MAX, comm);
+
+        message(rank, "Processing particles in %lld sub-chunks of up to %lld particles (%.1f MB).\n",
+                num_subchunks, subchunk_size, subchunk_size * particleStageBytes(pars.SortParticlesByCell) / 1e6);
+
+        /* Read the grids of the first sub-chunk */
+        if (prefetch_grids && num_subchunks > 0) {
+            const hsize_t first_size = (chunk_size < subchunk_size) ? chunk_size : subchunk_size;
+            err = readParticleGrids(grids, num_grids, &pars, ptype, N, start, first_size, local_X0, comm);
+            check_error(err, "Error reading the grids.\n");
+        }
+
+        /* The background writer, which writes into the space of this file. One
+         * of the two particle buffers is written while the other is generated. */
+        memset(&pw, 0, sizeof(pw));
+        pw.h_grp = h_grp;
+        pw.h_xfer = h_xfer;
+        pw.comm = file_comm;
+        pw.mass = ptype->Mass;
+
+        for (long long int sub=0; sub<num_subchunks; sub++) {
+            /* The position of this sub-chunk among the local particles */
+            const hsize_t sub_start = (sub * subchunk_size < chunk_size) ? sub * subchunk_size : chunk_size;
+            const hsize_t sub_size = (chunk_size - sub_start < subchunk_size) ? chunk_size - sub_start : subchunk_size;
+
+            /* The rows of the grids read for this sub-chunk */
+            int sub_X0 = local_X0, sub_NX = 0;
+            if (sub_size > 0) {
+                particleGridRows(ptype, N, start + sub_start, sub_size, &sub_X0, &sub_NX);
+            }
+
+            /* Allocate memory for this sub-chunk of particles */
+            timerStart("Generate");
+            struct particle_data *parts = &buffers[sub % 2];
+            err = allocParticles(parts, sub_size);
+            check_error(err, "Error allocating particles.\n");
+
+            /* Generate the particles */
+            err = genParticlesFromGrid_range(parts, &pars, ptype, start + sub_start,
+                                             id_first_particle);
+            check_error(err, "Error generating particles.\n");
+            timerStop();
+
+            /* Interpolating displacements at the pre-initial particle locations */
+            timerStart("Interpolation");
+            /* For x, y, and z */
+            for (int dir=0; dir<3; dir++) {
+                if (!prefetch_grids) {
+                    err = readParticleGrid(&grids[dir], &pars, ptype, dir, N, sub_X0, sub_NX, comm);
+                    check_error(err, "Error reading the grids.\n");
+                }
+
+                /* Displace the particles in this chunk, in blocks of INTERP_BATCH */
+                #pragma omp parallel for
+                for (long long int b=0; b<sub_size; b+=INTERP_BATCH) {
+                    int n = (sub_size - b < INTERP_BATCH) ? sub_size - b : INTERP_BATCH;
+
+                    /* Find the pre-initial (e.g. grid) locations */
+                    double x[INTERP_BATCH], y[INTERP_BATCH], z[INTERP_BATCH];
+                    for (int l=0; l<n; l++) {
+                        x[l] = parts->pos[3 * (b + l) + 0];
+                        y[l] = parts->pos[3 * (b + l) + 1];
+                        z[l] = parts->pos[3 * (b + l) + 2];
+                    }
+
+                    /* Find the displacements */
+                    double disp[INTERP_BATCH];
+                    gridTSC_dg_batch(&grids[dir], boxlen, n, x, y, z, disp);
+
+                    /* Displace the particles */
+                    for (int l=0; l<n; l++) {
+                        parts->pos[3 * (b + l) + dir] -= disp[l];
+                    }
+                }
+
+                if (!prefetch_grids) {
+                    free_ghost_slab(&grids[dir]);
+                }
+            }
+
+            /* Optionally, sort the particles by grid cell to improve the cache
+             * locality of the remaining interpolation passes */
+            if (pars.SortParticlesByCell) {
+                sort_order = malloc(sub_size * sizeof(long long int));
+                err = sortParticlesByCell(parts, sort_order, N, boxlen, sub_X0,
+                                          sub_NX, extra_width);
+                check_error(err, "Error sorting particles.\n");
+            }
+
+            /* Interpolating velocities at the displaced particle locations */
+            /* For x, y, and z */
+            for (int dir=0; dir<3; dir++) {
+                struct ghost_slab *vel_gs = &grids[3 + dir];
+                if (!prefetch_grids) {
+                    err = readParticleGrid(vel_gs, &pars, ptype, 3 + dir, N, sub_X0, sub_NX, comm);
+                    check_error(err, "Error reading the grids.\n");
+                }
+
+                /* Assign velocities to the particles in this chunk, in blocks of INTERP_BATCH */
+                #pragma omp parallel for
+                for (long long int b=0; b<sub_size; b+=INTERP_BATCH) {
+                    int n = (sub_size - b < INTERP_BATCH) ? sub_size - b : INTERP_BATCH;
+
+                    /* Skip thermal particles if we only need the Firebolt sampler */
+                    const long long int c = sub_start + b;
+                    if (ptype->UseFirebolt && (FIREBOLT_EXPLICIT_CHECKS == 0 ||
+                        (c % FIREBOLT_EXPLICIT_CHECKS != 0 &&
+                         c / FIREBOLT_EXPLICIT_CHECKS == (c + n - 1) / FIREBOLT_EXPLICIT_CHECKS))) continue;
+
+                    /* Find the displaced particle locations */
+                    double x[INTERP_BATCH], y[INTERP_BATCH], z[INTERP_BATCH];
+                    for (int l=0; l<n; l++) {
+                        x[l] = parts->pos[3 * (b + l) + 0];
+                        y[l] = parts->pos[3 * (b + l) + 1];
+                        z[l] = parts->pos[3 * (b + l) + 2];
+                    }
+
+                    /* Find the velocities in the given direction */
+                    double vel[INTERP_BATCH];
+                    gridTSC_dg_batch(vel_gs, boxlen, n, x, y, z, vel);
+
+                    /* Add the velocity components */
+                    for (int l=0; l<n; l++) {
+                        long long int i = b + l;
+                        if (ptype->UseFirebolt && (c + l) % FIREBOLT_EXPLICIT_CHECKS != 0) continue;
+
+                        parts->vel[3 * i + dir] = vel[l];
+                    }
+                }
+
+                if (!prefetch_grids) {
+                    free_ghost_slab(vel_gs);
+                }
+            }
+
+            timerStop();
+
+            /* Add thermal motion */
+            timerStart("Thermal");
+            struct ghost_slab *dens_gs = &grids[PARTICLE_GRID_DENSITY];
+            if (use_density && !prefetch_grids) {
+                err = readParticleGrid(dens_gs, &pars, ptype, PARTICLE_GRID_DENSITY, N, sub_X0, sub_NX, comm);
+                check_error(err, "Error reading the grids.\n");
+            }
+            if (strcmp(ptype->ThermalMotionType, "") != 0) {
+                /* Add thermal velocities to the particles in this chunk. Each
+                 * particle has its own random stream, determined by its id, so
+                 * the results are independent of the number of threads and ranks.
+                 * The Firebolt state is only read, so it can be shared by the threads. */
+                #pragma omp parallel for schedule(dynamic, 1024) \
+                    reduction(+:thermal_draws, Psi_sum, Psi2_sum, d_sum, d2_sum, Psi_d_sum, \
+                              correctly_oriented, explicit_Psi_checks, invalid_draws)
+                for (long long int i=0; i<sub_size; i++) {
+                    /* The random stream of this particle */
+                    rng_state particle_seed = rand_uint64_init_stream(pars.Seed, parts->id[i]);
+
+                    /* Resample as long necessary */
+                    char accept = 0;
+                    while (!accept) {
+                        /* Draw a momentum in eV from the thermal distribution */
+                        double p0_eV = sampleTable(&thermal_sampler, &particle_seed); //present-day momentum
+                        double p_eV = p0_eV / a_ini; //redshifted momentum
+                        thermal_draws++;
+
+                        if (isnan(p_eV) || p_eV <= 0) {
+                            printf("ERROR: invalid thermal momentum drawn: %e.\n", p_eV);
+                            invalid_draws++;
+                            break;
+                        }
+
+                        /* Convert to speed in internal units. Note that this is
+                         * the spatial part of the relativistic 4-velocity. */
+                        double V = p_eV / ptype->MicroscopicMass_eV * us.SpeedOfLight;
+
+                        /* Generate a random point on the unit sphere using Gaussians */
+                        double nx = sampleNorm(&particle_seed);
+                        double ny = sampleNorm(&particle_seed);
+                        double nz = sampleNorm(&particle_seed);
+
+                        /* And normalize */
+                        double length = hypot(nx, hypot(ny, nz));
+                        if (length > 0) {
+                            nx /= length;
+                            ny /= length;
+                            nz /= length;
+                        }
+
+                        if (isnan(nx) || isnan(ny) || isnan(nz)) {
+                            printf("ERROR: invalid random velocity v = [%e, %e, %e]\n", nx, ny, nz);
+                            invalid_draws++;
+                            break;
+                        }
+
+                        /* If desired, compute the linear theory perturbation */
+                        if (ptype->UseFirebolt) {
+                        #if(COMPILED_WITH_FIREBOLT)
+                            /* Find the displaceed particle location */
+                            double x = parts->pos[3 * i + 0];
+                            double y = parts->pos[3 * i + 1];
+                            double z = parts->pos[3 * i + 2];
+
+                            /* Compute the phase space density perturbation */
+                            int mode = 2; //use all available orders of perturbations
+                            double q = p0_eV / T_eV;
+                            double Psi = fireboltDensity(&firebolt, x, y, z, nx, ny, nz, q, mode);
+
+                            /* The configuration space density perturbation as determined from the hi-res grid */
+                            double density = gridTSC_dg(dens_gs, x, y, z, boxlen);
+
+                            if (isnan(Psi) || Psi <= -1) {
+                                printf("ERROR: invalid perturbation to the probability.\n");
+                                invalid_draws++;
+                                break;
+                            }
+
+                            if (isnan(density) || density <= -1) {
+                                printf("ERROR: invalid perturbation to the config space density.\n");
+                                invalid_draws++;
+                                break;
+                            }
+
+                            /* Rejection sampling, conditional on the configuration space density */
+                            double base_accept = 1.0 - ptype->FireboltMaxPerturbation;
+                            double p_accept = base_accept * (1 + Psi) / (1.0 + density);
+
+                            if (p_accept > 1) {
+                                printf("ERROR: rejection sampler encountered P(accept) > 1\t [q, Psi, P] = [%f, %e, %e].\n", q, Psi, p_accept);
+                                invalid_draws++;
+                                break;
+                            }
+
+                            /* Draw a uniform random number */
+                            double u = sampleUniform(&particle_seed);
+
+                            /* Do we accept? */
+                            if (u < p_accept) {
+                                accept = 1;
+                            }
+
+                            /* If we accept, finish the calculation */
+                            if (accept) {
+                                /* For diagonstics, compare with hi-res grids occasionally */
+                                if (FIREBOLT_EXPLICIT_CHECKS > 0 && (sub_start + i) % FIREBOLT_EXPLICIT_CHECKS == 0) {
+                                    /* The gravitational component of the velocity (hasn't been updated yet)*/
+                                    double vx_g = parts->vel[3 * i + 0];
+                                    double vy_g = parts->vel[3 * i + 1];
+                                    double vz_g = parts->vel[3 * i + 2];
+                                    double v_g = hypot(vx_g, hypot(vy_g, vz_g));
+
+                                    /* Compute the 0th order phase space density perturbation */
+                                    int mode_0 = 0; //use just the 0th order
+                                    double Psi_0 = fireboltDensity(&firebolt, x, y, z, nx, ny, nz, q, mode_0);
+
+                                    /* Compute up to the 1st order phase space density perturbation in the gravitational flow direction */
+                                    int mode_1 = 1; //use just the 1st order
+                                    double Psi_1_g = fireboltDensity(&firebolt, x, y, z, vx_g / v_g, vy_g / v_g, vz_g / v_g, q, mode_1);
+
+                                    /* Collect statistics to estimate corr(Psi, d) */
+                                    Psi_sum += Psi_0;
+                                    Psi2_sum += Psi_0 * Psi_0;
+                                    d_sum += density;
+                                    d2_sum += density * density;
+                                    Psi_d_sum += Psi_0 * density;
+
+                                    /* Determine whether the 1st order density perturbation makes sense */
+                                    if (Psi_1_g > 0)
+                                    correctly_oriented++;
+
+                                    /* Total number of checks */
+                                    explicit_Psi_checks++;
+                                }
+
+                                /* Set the velocity to be purely thermal. The gravitational flow
+                                 * speeds are already included in the acceptance probability. */
+                                 parts->vel[3 * i + 0] = nx * V;
+                                 parts->vel[3 * i + 1] = ny * V;
+                                 parts->vel[3 * i + 2] = nz * V;
+                            }
+                        #else
+                        printf("ERROR: not compiled with Firebolt.\n");
+                        invalid_draws++;
+                        break;
+                        #endif
+                        } else {
+                            /* Otherwise, always accept */
+                            accept = 1;
+
+                            /* And add the thermal velocities on top of the gravitational flow */
+                            parts->vel[3 * i + 0] += nx * V;
+                            parts->vel[3 * i + 1] += ny * V;
+                            parts->vel[3 * i + 2] += nz * V;
+                        }
+                    }
+                }
+            }
+            if (use_density && !prefetch_grids) {
+                free_ghost_slab(dens_gs);
+            }
+            check_error(invalid_draws > 0, "Error: %lld invalid draws from the thermal distribution.\n", invalid_draws);
+
+            timerStop();
+
+            /* Restore the original (lattice) order of the particles */
+            if (pars.SortParticlesByCell) {
+                err = unsortParticles(parts, sort_order);
+                check_error(err, "Error unsorting particles.\n");
+                free(sort_order);
+                sort_order = NULL;
+            }
+
+            /* Unit conversions */
+            /* (...) */
+
+            /* Make sure that particle coordinates wrap around */
+            #pragma omp parallel for
+            for (long long int i=0; i<3 * sub_size; i++) {
+                parts->pos[i] = fwrap(parts->pos[i], boxlen);
+            }
+
+            /* Hand the particles to the caller instead of writing them */
+            if (!write_particles) {
+                timerStart("Callback");
+                err = callback(parts, ptype, user_data);
+                timerStop();
+                check_error(err, "Error in the particle callback.\n");
+                cleanParticles(parts);
+                continue;
+            }
+
+            /* Wait until the previous sub-chunk has been written */
+            if (sub > 0) {
+                timerStart("Write wait");
+                err = finishParticleWrite_MPI(&pw);
+                timerStop();
+                check_error(err, "Error writing particle data.\n");
+                cleanParticles(&buffers[(sub - 1) % 2]);
+            }
+
+            /* No write is in progress, so read the grids of the next sub-chunk */
+            if (prefetch_grids) {
+                for (int g=0; g<num_grids; g++) {
+                    free_ghost_slab(&grids[g]);
+                }
+
+                if (sub + 1 < num_subchunks) {
+                    const hsize_t next_start = (sub_start + sub_size < chunk_size) ? sub_start + sub_size : chunk_size;
+                    const hsize_t next_size = (chunk_size - next_start < subchunk_size) ? chunk_size - next_start : subchunk_size;
+                    err = readParticleGrids(grids, num_grids, &pars, ptype, N, start + next_start, next_size, local_X0, comm);
+                    check_error(err, "Error reading the grids.\n");
+                }
+            }
+
+            /* Recall that multiple particle types can map into the same group.
+             * For each particle type, we have already recorded the position of
+             * its first particle in the group in this file at file_positions.
+             * The particles of this rank follow those of preceding ranks. */
+            pw.parts = parts;
+            pw.first_row = file_positions[pti] + rank_offsets[pti] + sub_start;
+
+            /* Start writing this sub-chunk, in the background if possible */
+            err = startParticleWrite_MPI(&pw, pars.AsyncWrite);
+            check_error(err, "Error writing particle data.\n");
+        }
+
+        if (write_particles) {
+            /* Wait until the last sub-chunk has been written */
+            timerStart("Write wait");
+            err = finishParticleWrite_MPI(&pw);
+            timerStop();
+            check_error(err, "Error writing particle data.\n");
+            cleanParticles(&buffers[(num_subchunks - 1) % 2]);
+
+            /* Report the I/O throughput for each dataset. The writes took place
+             * in the background, so the bytes are only now added to the timers. */
+            for (int d=0; d<NUM_PARTICLE_DATASETS; d++) {
+                if (d != DATASET_MASSES || H5Lexists(h_grp, "Masses", H5P_DEFAULT) > 0) {
+                    reportIOThroughput_MPI(comm, particle_dataset_names[d], pw.seconds[d], pw.bytes[d]);
+                }
+                timerAddBytes(0, pw.bytes[d]);
+            }
+        }
+
+        /* Clean up some data structures if this particle type is thermal */
+        if (strcmp(ptype->ThermalMotionType, "") != 0) {
+            /* Clean the random sampler */
+            cleanTableSampler(&thermal_sampler);
+
+            /* Just for Firebolt diagnostics, compute some summary statistics */
+            #if(COMPILED_WITH_FIREBOLT)
+            if (ptype->UseFirebolt) {
+                /* Sum the numer of thermal draws across all MPI ranks */
+                commStart("Reduce diagnostics", comm);
+                if (rank == 0) {
+                    MPI_Reduce(MPI_IN_PLACE, &thermal_draws, 1, MPI_LONG_LONG, MPI_SUM, 0, comm);
+                } else {
+                    MPI_Reduce(&thermal_draws, &thermal_draws, 1, MPI_LONG_LONG, MPI_SUM, 0, comm);
+                }
+                commStop(sizeof(thermal_draws));
+
+                /* Calculate the acceptance rate */
+                if (rank == 0) {
+                    double p_accept = (double) ptype->TotalNumber / thermal_draws;
+                    message(rank, "\n");
+                    message(rank, "Firebolt sampler acceptance rate: %.6f\n", p_accept);
+                }
+
+                /* Display other diagnostic summary statistics, computed for a
+                 * small subsample of particles */
+                if (FIREBOLT_EXPLICIT_CHECKS > 0) {
+                    long long int num_stats[2] = {explicit_Psi_checks, correctly_oriented};
+                    double Psi_d_stats[5] = {Psi_sum, Psi2_sum, d_sum, d2_sum, Psi_d_sum};
+
+                    commStart("Reduce diagnostics", comm);
+                    if (rank == 0) {
+                        MPI_Reduce(MPI_IN_PLACE, num_stats, 2, MPI_LONG_LONG, MPI_SUM, 0, comm);
+                        MPI_Reduce(MPI_IN_PLACE, Psi_d_stats, 5, MPI_DOUBLE, MPI_SUM, 0, comm);
+                    } else {
+                        MPI_Reduce(num_stats, num_stats, 2, MPI_LONG_LONG, MPI_SUM, 0, comm);
+                        MPI_Reduce(Psi_d_stats, Psi_d_stats, 5, MPI_DOUBLE, MPI_SUM, 0, comm);
+                    }
+                    commStop(sizeof(num_stats) + sizeof(Psi_d_stats));
+
+                    /* Calculate the desired summary statistics */
+                    if (rank == 0) {
+                        double N_psi = (double) num_stats[0];
+                        correctly_oriented = num_stats[1];
+
+                        Psi_sum = Psi_d_stats[0];
+                        Psi2_sum = Psi_d_stats[1];
+                        d_sum = Psi_d_stats[2];
+                        d2_sum = Psi_d_stats[3];
+                        Psi_d_sum = Psi_d_stats[4];
+
+                        double Psi_ss = N_psi * Psi2_sum - Psi_sum * Psi_sum;
+                        double d_ss = N_psi * d2_sum - d_sum * d_sum;
+                        double correlation = (N_psi * Psi_d_sum - Psi_sum * d_sum)
+                                           / sqrt(Psi_ss * d_ss);
+                        double p_oriented = correctly_oriented / N_psi;
+                        message(rank, "\n");
+                        message(rank, "Firebolt checks (number): N_checks = %e\n", N_psi);
+                        message(rank, "Firebolt checks (density): corr(Psi_0, delta_hires) = %.6f\n", correlation);
+                        message(rank, "Firebolt checks (velocity): P(Psi_1 > 0 along v_grav | theta_hires) = %.6f\n", p_oriented);
+                    }
+                }
+
+            }
+            #endif
+        }
+
+        /* Close the group in the output file */
+        if (write_particles) {
+            H5Gclose(h_grp);
+            h_grp = -1;
+        }
+        timerStop();
+
+        /* Make sure that the particles are on disk and record the checkpoint */
+        if (write_particles) {
+            H5Fflush(h_out_file, H5F_SCOPE_GLOBAL);
+            err = markCheckpoint(&cp, CHECKPOINT_PARTICLES, ptype->Identifier);
+            check_error(err, "Error writing checkpoint.\n");
+        }
+    }
+
+    /* Close the output file */
+    if (write_particles) {
+        H5Pclose(h_xfer);
+        H5Fclose(h_out_file);
+        h_xfer = -1;
+        h_out_file = -1;
+    }
+
+    /* Report the stage timers and the memory use */
+    gettimeofday(&time_stop, NULL);
+    double run_seconds = (time_stop.tv_sec - time_start.tv_sec)
+                       + (time_stop.tv_usec - time_start.tv_usec) / 1e6;
+    char timings_fname[DEFAULT_STRING_LENGTH];
+    sprintf(timings_fname, "%s/%s", pars.OutputDirectory, pars.TimingsFilename);
+    header(rank, "Timings");
+    err = reportTimers_MPI(comm, run_seconds,
+                           strcmp(pars.TimingsFilename, "") != 0 ? timings_fname : NULL);
+    check_error(err, "Error writing '%s'.\n", timings_fname);
+    if (strcmp(pars.TimingsFilename, "") != 0) {
+        message(rank, "Timings exported to '%s'.\n", timings_fname);
+    }
+
+cleanup:
+    /* Release what is still allocated, which after an error may include the
+     * state of an unfinished particle stage. Wait for a background write
+     * before freeing its particles and closing the file. */
+    finishParticleWrite_MPI(&pw);
+    cleanParticles(&buffers[0]);
+    cleanParticles(&buffers[1]);
+    free(sort_order);
+    for (int g=0; g<NUM_PARTICLE_GRIDS; g++) {
+        free_ghost_slab(&grids[g]);
+    }
+    cleanTableSampler(&thermal_sampler);
+
+    /* Clean the Firebolt Boltzmann code */
+    #if(COMPILED_WITH_FIREBOLT)
+    free(small_grid);
+    free(small_grf);
+    if (firebolt_allocated) {
+        cleanFirebolt(&firebolt);
+    }
+    #endif
+
+    /* Close the output file */
+    if (h_grp >= 0) H5Gclose(h_grp);
+    if (h_xfer >= 0) H5Pclose(h_xfer);
+    if (h_out_file >= 0) H5Fclose(h_out_file);
+    if (file_comm != MPI_COMM_NULL) MPI_Comm_free(&file_comm);
+    free(file_counts);
+    free(rank_offsets);
+    free(file_positions);
+
+    /* Free the grids, which were already freed unless an error occurred */
+    free_local_grid(&grf);
+    free_local_grid(&grid);
+    free_local_grid(&potential);
+    free_local_grid(&derivative);
+
+    /* Free the list of titles */
+    for (int i = 0; i < n_titles; i++) {
+        free(titles[i]);
+    }
+    free(titles);
+
+    /* Clean up the alternative perturbation file and associated spline */
+    cleanPerturb(&ptdat_alternative);
+    cleanPerturbSpline(&spline_alternative);
+
+    /* Clean up */
+    if (export_groups != NULL) cleanExportGroups(&pars, &export_groups);
+    if (types != NULL) cleanTypes(&pars, &types);
+    cleanParamTable(&ptable);
+    cleanParams(&pars);
+    cleanPerturb(&ptdat);
+    cleanPerturbParams(&ptpars);
+
+    /* Release the interpolation splines */
+    cleanPerturbSpline(&spline);
+
+    return run_err;
+}
@@ -0,0 +1,264 @@
+/*******************************************************************************
+ * This file is part of Mitos.
+ * Copyright (c) 2020 Willem Elbers (whe@willemelbers.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+
+#include "../include/mass_deposit.h"
+#include "../include/timers.h"
+
+/* The one-dimensional TSC weight at a distance d (in cells) */
+static inline double weightTSC(double d) {
+    d = fabs(d);
+    return d < 0.5 ? 0.75 - d * d : (d < 1.5 ? 0.5 * (1.5 - d) * (1.5 - d) : 0.);
+}
+
+/* Offsets from counts, returning the total */
+static long long int exclusiveSum(const int *counts, int *offsets, int n) {
+    long long int total = 0;
+    for (int i = 0; i < n; i++) {
+        offsets[i] = total;
+        total += counts[i];
+    }
+    return total;
+}
+
+int massDepositTSC_dg(struct distributed_grid *dg, const double *pos,
+                      const double *mass, long long int num) {
+    if (dg->momentum_space != 0) {
+        printf("Error: the grid is not in configuration space.\n");
+        return 1;
+    }
+
+    const int N = dg->N;
+    const long int NX = dg->NX;
+    const long int X0 = dg->X0;
+    const double boxlen = dg->boxlen;
+    const double cell_factor = N / boxlen;
+    const double cell_volume = pow(boxlen / N, 3);
+    const MPI_Comm comm = dg->comm;
+    const int G = MASS_DEPOSIT_GHOST_ROWS;
+    const long int row_size = (long int) N * N;
+
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    /* MPI counts and offsets are ints. The particles are therefore counted
+     * in units of (x, y, z, mass) and the ghost rows in units of rows. */
+    int err = (num > INT_MAX || row_size + 1 > INT_MAX);
+    MPI_Allreduce(MPI_IN_PLACE, &err, 1, MPI_INT, MPI_MAX, comm);
+    if (err > 0) {
+        printf("Error: too many particles or too large a grid for the mass deposition.\n");
+        return 1;
+    }
+
+    timerStart("Mass deposition");
+
+    /* Determine which rank owns each row of the grid */
+    long int *all_X0 = malloc(size * sizeof(long int));
+    long int *all_NX = malloc(size * sizeof(long int));
+    MPI_Allgather(&dg->X0, 1, MPI_LONG, all_X0, 1, MPI_LONG, comm);
+    MPI_Allgather(&dg->NX, 1, MPI_LONG, all_NX, 1, MPI_LONG, comm);
+    int *row_owner = malloc(N * sizeof(int));
+    for (int r = 0; r < size; r++) {
+        for (long int x = all_X0[r]; x < all_X0[r] + all_NX[r]; x++) {
+            row_owner[x] = r;
+        }
+    }
+    free(all_X0);
+    free(all_NX);
+
+    /* Send each particle (x, y, z, mass) to the owner of its base row */
+    int *send_counts = calloc(size, sizeof(int));
+    int *recv_counts = malloc(size * sizeof(int));
+    int *send_offsets = malloc(size * sizeof(int));
+    int *recv_offsets = malloc(size * sizeof(int));
+    int *dest = malloc(num * sizeof(int));
+    for (long long int i = 0; i < num; i++) {
+        int iX = wrap((int) floor(fwrap(pos[3 * i], boxlen) * cell_factor), N);
+        dest[i] = row_owner[iX];
+        send_counts[dest[i]]++;
+    }
+
+    MPI_Alltoall(send_counts, 1, MPI_INT, recv_counts, 1, MPI_INT, comm);
+    long long int total_send = exclusiveSum(send_counts, send_offsets, size);
+    long long int total_recv = exclusiveSum(recv_counts, recv_offsets, size);
+
+    /* The offsets of the received particles must also fit in an int */
+    err = (total_recv > INT_MAX);
+    MPI_Allreduce(MPI_IN_PLACE, &err, 1, MPI_INT, MPI_MAX, comm);
+    if (err > 0) {
+        printf("Error: too many particles to deposit on one rank.\n");
+        free(dest);
+        free(send_counts);
+        free(recv_counts);
+        free(send_offsets);
+        free(recv_offsets);
+        free(row_owner);
+        timerStop();
+        return 1;
+    }
+
+    /* A particle is sent as (x, y, z, mass) */
+    MPI_Datatype particle_type;
+    MPI_Type_contiguous(4, MPI_DOUBLE, &particle_type);
+    MPI_Type_commit(&particle_type);
+
+    double *send_parts = malloc(4 * total_send * sizeof(double));
+    double *recv_parts = malloc(4 * total_recv * sizeof(double));
+    int *fill = malloc(size * sizeof(int));
+    memcpy(fill, send_offsets, size * sizeof(int));
+    for (long long int i = 0; i < num; i++) {
+        double *p = send_parts + 4L * fill[dest[i]];
+        p[0] = pos[3 * i + 0];
+        p[1] = pos[3 * i + 1];
+        p[2] = pos[3 * i + 2];
+        p[3] = mass[i];
+        fill[dest[i]]++;
+    }
+    free(dest);
+
+    commStart("Exchange particles", comm);
+    MPI_Alltoallv(send_parts, send_counts, send_offsets, particle_type, recv_parts,
+                  recv_counts, recv_offsets, particle_type, comm);
+    commStop(4 * (total_send + total_recv) * sizeof(double));
+    free(send_parts);
+    MPI_Type_free(&particle_type);
+
+    /* Deposit the particles directly into the local rows of the (padded)
+     * grid. Contributions to the G rows on either side of the local slice
+     * are collected in a ghost buffer, where rows 0..G-1 start at X0 - G and
+     * rows G..2G-1 start at X0 + NX. */
+    double *ghost = calloc(2 * G * row_size, sizeof(double));
+    for (long long int i = 0; i < total_recv; i++) {
+        const double *p = recv_parts + 4 * i;
+        double X = fwrap(p[0], boxlen) * cell_factor;
+        double Y = fwrap(p[1], boxlen) * cell_factor;
+        double Z = fwrap(p[2], boxlen) * cell_factor;
+        double M = p[3] / cell_volume;
+
+        int iX = (int) floor(X);
+        int iY = (int) floor(Y);
+        int iZ = (int) floor(Z);
+
+        /* The base row relative to the local slice */
+        long int local_X = wrap(iX, N) - X0;
+
+        for (int x = -G; x <= G; x++) {
+            double wx = weightTSC(X - (iX + x));
+            if (wx == 0.) continue;
+
+            /* Find the row in the grid or in the ghost buffer */
+            long int r = local_X + x;
+            double *row;
+            long int stride;
+            if (r < 0) {
+                row = ghost + (r + G) * row_size;
+                stride = N;
+            } else if (r >= NX) {
+                row = ghost + (r - NX + G) * row_size;
+                stride = N;
+            } else {
+                row = dg->box + r * N * (N + 2);
+                stride = N + 2;
+            }
+
+            for (int y = -G; y <= G; y++) {
+                double wy = weightTSC(Y - (iY + y));
+                if (wy == 0.) continue;
+                double *col = row + wrap(iY + y, N) * stride;
+
+                for (int z = -G; z <= G; z++) {
+                    double wz = weightTSC(Z - (iZ + z));
+                    col[wrap(iZ + z, N)] += M * wx * wy * wz;
+                }
+            }
+        }
+    }
+    free(recv_parts);
+
+    /* Send the ghost rows (global row index, followed by the row) to the
+     * ranks that own them. This may include this rank itself. Each rank
+     * sends at most 2G rows, so the counts are small. */
+    const long int msg_size = row_size + 1;
+    const int num_ghost_rows = (NX > 0) ? 2 * G : 0;
+
+    memset(send_counts, 0, size * sizeof(int));
+    for (int i = 0; i < num_ghost_rows; i++) {
+        int global_X = wrap(i < G ? X0 - G + i : X0 + NX + i - G, N);
+        send_counts[row_owner[global_X]]++;
+    }
+
+    MPI_Alltoall(send_counts, 1, MPI_INT, recv_counts, 1, MPI_INT, comm);
+    total_send = exclusiveSum(send_counts, send_offsets, size);
+    total_recv = exclusiveSum(recv_counts, recv_offsets, size);
+
+    MPI_Datatype row_type;
+    MPI_Type_contiguous(msg_size, MPI_DOUBLE, &row_type);
+    MPI_Type_commit(&row_type);
+
+    double *send_rows = malloc(total_send * msg_size * sizeof(double));
+    double *recv_rows = malloc(total_recv * msg_size * sizeof(double));
+    memcpy(fill, send_offsets, size * sizeof(int));
+    for (int i = 0; i < num_ghost_rows; i++) {
+        int global_X = wrap(i < G ? X0 - G + i : X0 + NX + i - G, N);
+        int owner = row_owner[global_X];
+        double *msg = send_rows + fill[owner] * msg_size;
+        msg[0] = global_X;
+        memcpy(msg + 1, ghost + i * row_size, row_size * sizeof(double));
+        fill[owner]++;
+    }
+    free(ghost);
+
+    commStart("Exchange ghost rows", comm);
+    MPI_Alltoallv(send_rows, send_counts, send_offsets, row_type, recv_rows,
+                  recv_counts, recv_offsets, row_type, comm);
+    commStop((total_send + total_recv) * msg_size * sizeof(double));
+    MPI_Type_free(&row_type);
+
+    /* Add the received rows to the local rows of the grid */
+    for (long long int m = 0; m < total_recv; m++) {
+        const double *msg = recv_rows + m * msg_size;
+        const long int x = (long int) msg[0] - X0;
+        for (int y = 0; y < N; y++) {
+            const double *col = msg + 1 + (long int) y * N;
+            double *out = dg->box + (x * N + y) * (N + 2);
+            for (int z = 0; z < N; z++) {
+                out[z] += col[z];
+            }
+        }
+    }
+
+    free(send_rows);
+    free(recv_rows);
+    free(fill);
+    free(send_counts);
+    free(recv_counts);
+    free(send_offsets);
+    free(recv_offsets);
+    free(row_owner);
+
+    timerStop();
+
+    return 0;
+}
@@ -31,6 +31,7 @@
 #include "../include/output.h"
 #include "../include/poisson.h"
 #include "../include/message.h"
+#include "../include/timers.h"
 
 typedef double* dp;
 
@@ -83,6 +84,8 @@ int solveMongeAmpere(struct distributed_grid *potential,
         return 1;
     }
 
+    timerStart("Monge-Ampere");
+
     /* Compute initial (Zel'dovich) guess using the inverse Poisson kernel */
     fft_apply_kernel_dg(potential, density, kernel_inv_poisson, NULL);
 
@@ -166,11 +169,13 @@ int solveMongeAmpere(struct distributed_grid *potential,
 
         /* Add the squared residuals and densities from all MPI ranks */
         double eps_norm[2] = {eps, norm};
+        commStart("Reduce residuals", comm);
         if (rank == 0) {
-            MPI_Reduce(MPI_IN_PLACE, eps_norm, 2, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+            MPI_Reduce(MPI_IN_PLACE, eps_norm, 2, MPI_DOUBLE, MPI_SUM, 0, comm);
         } else {
-            MPI_Reduce(eps_norm, eps_norm, 2, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+            MPI_Reduce(eps_norm, eps_norm, 2, MPI_DOUBLE, MPI_SUM, 0, comm);
         }
+        commStop(sizeof(eps_norm));
 
         /* Compute the root mean square residual, normalized by the source grid */
         if (rank == 0) {
@@ -179,5 +184,7 @@ int solveMongeAmpere(struct distributed_grid *potential,
         }
     }
 
+    timerStop();
+
     return 0;
 }
@@ -22,8 +22,17 @@
 #include <string.h>
 #include "../include/output.h"
 #include "../include/output_mpi.h"
+#include "../include/timers.h"
 #include "../include/fft.h"
 
+/* Layout and filters of datasets created by the methods below. These are
+ * set once from the parameter file, with uncompressed contiguous datasets
+ * as the default. */
+static struct {
+    int compression_level;
+    char shuffle;
+} output_filters = {0, 0};
+
 
 hid_t openFile_MPI(MPI_Comm comm, const char *fname) {
     /* Property list for MPI file access */
@@ -49,12 +58,222 @@ hid_t createFile_MPI(MPI_Comm comm, const char *fname) {
     return h_file;
 }
 
-int createFieldGroup_dg(int N, int NX, hid_t h_file) {
-    if (NX * N * (N+2) * sizeof(double) > HDF5_PARALLEL_IO_MAX_BYTES) {
-        printf("Error: parallel HDF5 cannot handle more than 2GB per chunk.\n");
+/* Collect the MPI-IO hints for the output file from the parameter file.
+ * Hints that are not set are left to the MPI library. */
+MPI_Info createIOHints_MPI(const struct params *pars) {
+    MPI_Info info;
+    MPI_Info_create(&info);
+
+    char value[50];
+    if (pars->StripingFactor > 0) {
+        sprintf(value, "%d", pars->StripingFactor);
+        MPI_Info_set(info, "striping_factor", value);
+    }
+    if (pars->StripingUnit > 0) {
+        sprintf(value, "%ld", pars->StripingUnit);
+        MPI_Info_set(info, "striping_unit", value);
+    }
+    if (pars->CollectiveBufferingNodes > 0) {
+        sprintf(value, "%d", pars->CollectiveBufferingNodes);
+        MPI_Info_set(info, "cb_nodes", value);
+        MPI_Info_set(info, "romio_cb_write", "enable");
+    }
+    if (pars->CollectiveBufferSize > 0) {
+        sprintf(value, "%ld", pars->CollectiveBufferSize);
+        MPI_Info_set(info, "cb_buffer_size", value);
+    }
+
+    return info;
+}
+
+/* Create a file with the MPI-IO hints and dataset alignment from the
+ * parameter file. Must be called collectively. */
+hid_t createFileTuned_MPI(MPI_Comm comm, const char *fname, const struct params *pars) {
+    MPI_Info info = createIOHints_MPI(pars);
+
+    /* Property list for MPI file access */
+    hid_t prop_faxs = H5Pcreate(H5P_FILE_ACCESS);
+    H5Pset_fapl_mpio(prop_faxs, comm, info);
+
+    /* Align large objects (i.e. the datasets) to the given boundary */
+    if (pars->Alignment > 0) {
+        H5Pset_alignment(prop_faxs, pars->Alignment, pars->Alignment);
+    }
+
+    /* Create the hdf5 file */
+    hid_t h_file = H5Fcreate(fname, H5F_ACC_TRUNC, H5P_DEFAULT, prop_faxs);
+    H5Pclose(prop_faxs);
+    MPI_Info_free(&info);
+
+    return h_file;
+}
+
+/* Property list for (optionally collective) parallel data transfers. Since
+ * filtered datasets can only be written collectively, compression implies
+ * collective I/O. */
+hid_t createTransferList_MPI(const struct params *pars) {
+    hid_t prop_xfer = H5Pcreate(H5P_DATASET_XFER);
+    if (pars->CollectiveIO || pars->CompressionLevel > 0) {
+        H5Pset_dxpl_mpio(prop_xfer, H5FD_MPIO_COLLECTIVE);
+    } else {
+        H5Pset_dxpl_mpio(prop_xfer, H5FD_MPIO_INDEPENDENT);
+    }
+
+    return prop_xfer;
+}
+
+/* Write a selection of a dataset and add the time taken and the number of
+ * bytes written to the file to the given counters */
+int writeDatasetTimed_MPI(hid_t h_data, hid_t mem_type, hid_t h_mspace,
+                          hid_t h_fspace, hid_t h_xfer, const void *buf,
+                          double *seconds, long long int *bytes) {
+
+    double time_start = MPI_Wtime();
+    hid_t h_err = H5Dwrite(h_data, mem_type, h_mspace, h_fspace, h_xfer, buf);
+    *seconds += MPI_Wtime() - time_start;
+
+    if (h_err < 0) {
+        printf("Error: writing chunk of hdf5 data.\n");
+        return 1;
+    }
+
+    /* Count the bytes in the file type */
+    hid_t h_type = H5Dget_type(h_data);
+    *bytes += H5Sget_select_npoints(h_fspace) * H5Tget_size(h_type);
+    H5Tclose(h_type);
+
+    return 0;
+}
+
+/* Print the aggregate throughput of a dataset write. The time is the
+ * slowest rank's time, since the write completes only when all ranks are
+ * done. Must be called collectively. */
+void reportIOThroughput_MPI(MPI_Comm comm, const char *name, double seconds,
+                            long long int bytes) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    double max_seconds;
+    long long int total_bytes;
+    MPI_Reduce(&seconds, &max_seconds, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+    MPI_Reduce(&bytes, &total_bytes, 1, MPI_LONG_LONG, MPI_SUM, 0, comm);
+
+    if (rank == 0) {
+        printf("Wrote '%s': %.3f GB in %.3f s (%.3f GB/s)\n", name,
+               total_bytes / 1e9, max_seconds,
+               (max_seconds > 0) ? total_bytes / 1e9 / max_seconds : 0.);
+    }
+}
+
+/* Set the compression of datasets created by createDatasetList_MPI */
+void setOutputFilters_MPI(const struct params *pars) {
+    output_filters.compression_level = pars->CompressionLevel;
+    output_filters.shuffle = pars->Shuffle;
+}
+
+/* Dataset creation property list for a dataset of given rank and dimensions.
+ * If compression is enabled, the dataset is chunked along the first
+ * dimension in blocks of chunk_rows and filtered with shuffle + deflate.
+ * Writing filtered datasets in parallel requires collective I/O. */
+hid_t createDatasetList_MPI(int rank, const hsize_t *dims, hsize_t chunk_rows) {
+    hid_t prop_dcpl = H5Pcreate(H5P_DATASET_CREATE);
+
+    if (output_filters.compression_level > 0 && dims[0] > 0) {
+        hsize_t chunk_dims[3];
+        chunk_dims[0] = (chunk_rows < dims[0]) ? chunk_rows : dims[0];
+        for (int i=1; i<rank; i++) {
+            chunk_dims[i] = dims[i];
+        }
+
+        H5Pset_chunk(prop_dcpl, rank, chunk_dims);
+        if (output_filters.shuffle) {
+            H5Pset_shuffle(prop_dcpl);
+        }
+        H5Pset_deflate(prop_dcpl, output_filters.compression_level);
+    }
+
+    return prop_dcpl;
+}
+
+/* Write a block of consecutive rows (along the first dimension) of a dataset
+ * from a contiguous buffer. The block is split into writes of at most
+ * HDF5_PARALLEL_IO_MAX_BYTES, and all ranks in comm make the same number of
+ * (possibly empty) calls, as required for collective I/O. The memory type
+ * must be the type of the dataset. */
+int writeRows_MPI(MPI_Comm comm, hid_t h_data, hid_t mem_type, hid_t h_xfer,
+                  hsize_t first_row, hsize_t num_rows, const void *buf,
+                  double *seconds, long long int *bytes) {
+
+    /* Dimensions of the dataset */
+    hid_t h_space = H5Dget_space(h_data);
+    int rank = H5Sget_simple_extent_ndims(h_space);
+    hsize_t dims[3];
+    H5Sget_simple_extent_dims(h_space, dims, NULL);
+
+    /* The memory type must match the type in the file. HDF5 converts types
+     * only with independent I/O, so a conversion would quietly turn a
+     * collective transfer into an independent one (and fails altogether
+     * for compressed datasets). */
+    hid_t h_type = H5Dget_type(h_data);
+    const htri_t same_type = H5Tequal(h_type, mem_type);
+    const size_t type_size = H5Tget_size(h_type);
+    H5Tclose(h_type);
+    if (same_type <= 0) {
+        printf("Error: the memory type does not match the type of the dataset.\n");
+        H5Sclose(h_space);
         return 1;
     }
 
+    /* Size of a row */
+    hsize_t row_elements = 1;
+    for (int i=1; i<rank; i++) {
+        row_elements *= dims[i];
+    }
+    const size_t row_bytes_mem = row_elements * type_size;
+
+    /* Determine the number of writes */
+    hsize_t rows_per_write = HDF5_PARALLEL_IO_MAX_BYTES / (row_elements * type_size);
+    if (rows_per_write < 1) rows_per_write = 1;
+    long long int writes = (num_rows + rows_per_write - 1) / rows_per_write;
+    MPI_Allreduce(MPI_IN_PLACE, &writes, 1, MPI_LONG_LONG, MPI_MAX, comm);
+
+    for (long long int w=0; w<writes; w++) {
+        /* The rows written by this call */
+        hsize_t row = w * rows_per_write;
+        hsize_t rows = (row < num_rows) ? num_rows - row : 0;
+        if (rows > rows_per_write) rows = rows_per_write;
+
+        hsize_t count[3] = {rows, 1, 1};
+        hsize_t start[3] = {first_row + row, 0, 0};
+        for (int i=1; i<rank; i++) {
+            count[i] = dims[i];
+        }
+
+        /* Select the rows in the file and in memory */
+        hid_t h_memspace = H5Screate_simple(rank, count, NULL);
+        if (rows > 0) {
+            H5Sselect_hyperslab(h_space, H5S_SELECT_SET, start, NULL, count, NULL);
+        } else {
+            H5Sselect_none(h_space);
+            H5Sselect_none(h_memspace);
+        }
+
+        const char *rows_buf = (const char *) buf + (rows > 0 ? row * row_bytes_mem : 0);
+        int err = writeDatasetTimed_MPI(h_data, mem_type, h_memspace, h_space,
+                                        h_xfer, rows_buf, seconds, bytes);
+        H5Sclose(h_memspace);
+        if (err > 0) {
+            H5Sclose(h_space);
+            return err;
+        }
+    }
+
+    H5Sclose(h_space);
+
+    return 0;
+}
+
+int createFieldGroup_dg(int N, int NX, hid_t h_file) {
     /* Create the Field group */
     hid_t h_grp = H5Gcreate(h_file, "/Field", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
 
@@ -63,11 +282,14 @@ int createFieldGroup_dg(int N, int NX, hid_t h_file) {
     const hsize_t fdims[3] = {N, N, N+2}; //3D space
     hid_t h_fspace = H5Screate_simple(frank, fdims, NULL);
 
-    /* Create the dataset for the field */
-    hid_t h_data = H5Dcreate(h_grp, "Field", H5T_NATIVE_DOUBLE, h_fspace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    /* Create the dataset for the field, optionally compressed in chunks of
+     * one row, such that no chunk is shared between ranks */
+    hid_t h_prop = createDatasetList_MPI(frank, fdims, 1);
+    hid_t h_data = H5Dcreate(h_grp, "Field", H5T_NATIVE_DOUBLE, h_fspace, H5P_DEFAULT, h_prop, H5P_DEFAULT);
 
     /* Close the dataset, corresponding dataspace, property list, and the Field group */
     H5Dclose(h_data);
+    H5Pclose(h_prop);
     H5Sclose(h_fspace);
     H5Gclose(h_grp);
 
@@ -93,7 +315,9 @@ int writeFieldFile_dg(struct distributed_grid *dg, const char *fname) {
         if (err > 0) return err;
 
         /* Write the data */
+        timerStart("Write fields");
         err = writeFieldData_dg(dg, h_file);
+        timerStop();
         if (err > 0) return 0;
 
         /* Close the file */
@@ -110,32 +334,22 @@ int writeFieldData_dg(struct distributed_grid *dg, hid_t h_file) {
     /* Open the Field dataset */
     hid_t h_data = H5Dopen2(h_grp, "Field", H5P_DEFAULT);
 
-    /* Get the file dataspace */
-    hid_t h_space = H5Dget_space(h_data);
+    /* Write the local slice collectively, in pieces of at most 2GB */
+    hid_t h_xfer = H5Pcreate(H5P_DATASET_XFER);
+    H5Pset_dxpl_mpio(h_xfer, H5FD_MPIO_COLLECTIVE);
 
-    /* The chunk in question */
-    const hsize_t chunk_rank = 3;
-    const hsize_t chunk_dims[3] = {dg->NX, dg->N, dg->N+2}; //3D space
+    double seconds = 0.;
+    long long int bytes = 0;
+    int err = writeRows_MPI(dg->comm, h_data, H5T_NATIVE_DOUBLE, h_xfer, dg->X0,
+                            dg->NX, dg->box, &seconds, &bytes);
+    H5Pclose(h_xfer);
 
-    /* Offset of the chunk inside the grid */
-    const hsize_t chunk_offset[3] = {dg->X0, 0, 0};
-
-    /* Create memory space for the chunk */
-    hid_t h_memspace = H5Screate_simple(chunk_rank, chunk_dims, NULL);
-    H5Sselect_hyperslab(h_space, H5S_SELECT_SET, chunk_offset, NULL, chunk_dims, NULL);
-
-    /* Write the data */
-    hid_t h_err = H5Dwrite(h_data, H5T_NATIVE_DOUBLE, h_memspace, h_space, H5P_DEFAULT, dg->box);
-    if (h_err < 0) {
-        printf("Error: writing chunk of hdf5 data.\n");
-        return 1;
-    }
-
-    /* Close the dataset, corresponding dataspace, and the Field group */
+    /* Close the dataset and the Field group */
     H5Dclose(h_data);
-    H5Sclose(h_space);
-    H5Sclose(h_memspace);
     H5Gclose(h_grp);
 
+    if (err > 0) return err;
+    timerAddBytes(0, bytes);
+
     return 0;
 }
@@ -0,0 +1,324 @@
+/*******************************************************************************
+ * This file is part of Mitos.
+ * Copyright (c) 2020 Willem Elbers (whe@willemelbers.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#include "../include/param_table.h"
+#include "../parser/minIni.h"
+
+/* The table used by the readers, if any */
+static const struct param_table *active_table = NULL;
+
+static char *skipLeading(char *str) {
+    while (*str != '\0' && *str <= ' ') str++;
+    return str;
+}
+
+static void stripTrailing(char *str) {
+    char *end = str + strlen(str);
+    while (end > str && *(end - 1) <= ' ') end--;
+    *end = '\0';
+}
+
+/* Remove a trailing comment and surrounding quotes from a value, in the same
+ * way as minIni */
+static char *cleanValue(char *str) {
+    /* Comments start with ';' or '#', unless inside a quoted string */
+    int quoted = 0;
+    char *ep;
+    for (ep = str; *ep != '\0' && ((*ep != ';' && *ep != '#') || quoted); ep++) {
+        if (*ep == '"') {
+            if (*(ep + 1) == '"') ep++;
+            else quoted = !quoted;
+        } else if (*ep == '\\' && *(ep + 1) == '"') {
+            ep++;
+        }
+    }
+    *ep = '\0';
+    stripTrailing(str);
+
+    /* Remove the quotes and the escape characters of quoted strings */
+    ep = str + strlen(str);
+    if (*str == '"' && ep > str && *(ep - 1) == '"') {
+        str++;
+        *--ep = '\0';
+
+        char *d = str;
+        for (char *s = str; *s != '\0'; s++, d++) {
+            if ((*s == '"' || *s == '\\') && *(s + 1) == '"') s++;
+            *d = *s;
+        }
+        *d = '\0';
+    }
+
+    return str;
+}
+
+/* FNV-1a hash of a section and key, ignoring case */
+static uint64_t hashEntry(const char *section, const char *key) {
+    uint64_t h = 14695981039346656037ULL;
+    for (const char *c = section; *c; c++) {
+        h ^= (unsigned char) tolower(*c);
+        h *= 1099511628211ULL;
+    }
+    h ^= 0xff;
+    h *= 1099511628211ULL;
+    for (const char *c = key; *c; c++) {
+        h ^= (unsigned char) tolower(*c);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/* Parse the contents of a parameter file. The table takes ownership of the
+ * buffer, which must be null-terminated and was allocated with malloc. */
+int parseParamTable(struct param_table *pt, const char *fname, char *buffer) {
+    pt->fname = malloc(strlen(fname) + 1);
+    strcpy(pt->fname, fname);
+    pt->buffer = buffer;
+    pt->num_entries = 0;
+
+    /* The sections encountered so far, of which only the first occurrence
+     * is used, like in minIni */
+    int num_sections = 0, max_sections = 16;
+    const char **sections = malloc(max_sections * sizeof(char *));
+
+    /* Keys above the first section belong to the empty section */
+    int max_entries = 64;
+    pt->entries = malloc(max_entries * sizeof(struct param_entry));
+    const char *section = "";
+    sections[num_sections++] = section;
+
+    char *line = buffer;
+    while (line != NULL) {
+        /* Split off the next line */
+        char *next = strchr(line, '\n');
+        if (next != NULL) *next++ = '\0';
+
+        char *sp = skipLeading(line);
+        line = next;
+
+        if (*sp == '[') {
+            /* A new section, which ends the previous one */
+            char *ep = strrchr(sp, ']');
+            section = NULL;
+            if (ep == NULL) continue;
+            *ep = '\0';
+
+            /* Ignore repeated sections */
+            int seen = 0;
+            for (int i = 0; i < num_sections && !seen; i++) {
+                seen = (strcasecmp(sections[i], sp + 1) == 0);
+            }
+            if (seen) continue;
+
+            if (num_sections == max_sections) {
+                max_sections *= 2;
+                sections = realloc(sections, max_sections * sizeof(char *));
+            }
+            section = sp + 1;
+            sections[num_sections++] = section;
+            continue;
+        }
+
+        /* Skip comments and the keys of ignored sections */
+        if (section == NULL || *sp == ';' || *sp == '#') continue;
+
+        /* Split the key from the value */
+        char *ep = strchr(sp, '=');
+        if (ep == NULL) ep = strchr(sp, ':');
+        if (ep == NULL) continue;
+        *ep = '\0';
+        stripTrailing(sp);
+        if (*sp == '\0') continue;
+
+        if (pt->num_entries == max_entries) {
+            max_entries *= 2;
+            pt->entries = realloc(pt->entries, max_entries * sizeof(struct param_entry));
+        }
+        struct param_entry *entry = &pt->entries[pt->num_entries++];
+        entry->section = section;
+        entry->key = sp;
+        entry->value = cleanValue(skipLeading(ep + 1));
+        entry->next = -1;
+    }
+
+    free(sections);
+
+    /* Build the hash table, with at least twice as many buckets as entries */
+    pt->num_buckets = 16;
+    while (pt->num_buckets < 2 * pt->num_entries) pt->num_buckets *= 2;
+    pt->buckets = malloc(pt->num_buckets * sizeof(int));
+    for (int i = 0; i < pt->num_buckets; i++) {
+        pt->buckets[i] = -1;
+    }
+
+    /* Insert the entries in order, keeping the first of repeated keys */
+    int *last = malloc(pt->num_buckets * sizeof(int));
+    for (int i = 0; i < pt->num_entries; i++) {
+        struct param_entry *entry = &pt->entries[i];
+        if (paramTableLookup(pt, entry->section, entry->key) != NULL) continue;
+
+        int b = hashEntry(entry->section, entry->key) & (pt->num_buckets - 1);
+        if (pt->buckets[b] < 0) {
+            pt->buckets[b] = i;
+        } else {
+            pt->entries[last[b]].next = i;
+        }
+        last[b] = i;
+    }
+    free(last);
+
+    return 0;
+}
+
+/* Read the contents of a parameter file into a null-terminated buffer */
+int readParamFile(const char *fname, char **buffer, long int *size) {
+    FILE *f = fopen(fname, "rb");
+    if (f == NULL) {
+        printf("Error opening parameter file '%s'.\n", fname);
+        return 1;
+    }
+
+    long int length = -1;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        length = ftell(f);
+    }
+    if (length < 0 || fseek(f, 0, SEEK_SET) != 0) {
+        printf("Error determining the size of parameter file '%s'.\n", fname);
+        fclose(f);
+        return 1;
+    }
+
+    char *contents = malloc(length + 1);
+    if (contents == NULL || fread(contents, 1, length, f) != (size_t) length) {
+        printf("Error reading parameter file '%s'.\n", fname);
+        free(contents);
+        fclose(f);
+        return 1;
+    }
+    contents[length] = '\0';
+    fclose(f);
+
+    *buffer = contents;
+    *size = length;
+
+    return 0;
+}
+
+/* Read a parameter file from disk and parse it */
+int readParamTable(struct param_table *pt, const char *fname) {
+    char *buffer;
+    long int size;
+    int err = readParamFile(fname, &buffer, &size);
+    if (err > 0) return err;
+
+    return parseParamTable(pt, fname, buffer);
+}
+
+int cleanParamTable(struct param_table *pt) {
+    if (active_table == pt) {
+        active_table = NULL;
+    }
+
+    free(pt->fname);
+    free(pt->buffer);
+    free(pt->entries);
+    free(pt->buckets);
+    pt->fname = NULL;
+    pt->buffer = NULL;
+    pt->entries = NULL;
+    pt->buckets = NULL;
+
+    return 0;
+}
+
+/* Find the value of a key, or NULL if it does not exist */
+const char *paramTableLookup(const struct param_table *pt, const char *section,
+                             const char *key) {
+    if (section == NULL) section = "";
+
+    int b = hashEntry(section, key) & (pt->num_buckets - 1);
+    for (int i = pt->buckets[b]; i >= 0; i = pt->entries[i].next) {
+        const struct param_entry *entry = &pt->entries[i];
+        if (strcasecmp(entry->key, key) == 0 && strcasecmp(entry->section, section) == 0) {
+            return entry->value;
+        }
+    }
+
+    return NULL;
+}
+
+void setParamTable(const struct param_table *pt) {
+    active_table = pt;
+}
+
+/* Replacements for ini_gets, ini_getl, ini_getd, and ini_getbool */
+int paramGets(const char *section, const char *key, const char *def,
+              char *buffer, int size, const char *fname) {
+    if (active_table == NULL || strcmp(active_table->fname, fname) != 0) {
+        return ini_gets(section, key, def, buffer, size, fname);
+    }
+
+    if (buffer == NULL || size <= 0 || key == NULL) return 0;
+
+    const char *value = paramTableLookup(active_table, section, key);
+    if (value == NULL) value = (def != NULL) ? def : "";
+
+    /* Copy and truncate if necessary */
+    int len = 0;
+    while (len < size - 1 && value[len] != '\0') {
+        buffer[len] = value[len];
+        len++;
+    }
+    buffer[len] = '\0';
+
+    return len;
+}
+
+long int paramGetl(const char *section, const char *key, long int def,
+                   const char *fname) {
+    char buffer[64];
+    int len = paramGets(section, key, "", buffer, sizeof(buffer), fname);
+    if (len == 0) return def;
+    return (len >= 2 && toupper(buffer[1]) == 'X') ? strtol(buffer, NULL, 16)
+                                                   : strtol(buffer, NULL, 10);
+}
+
+double paramGetd(const char *section, const char *key, double def,
+                 const char *fname) {
+    char buffer[64];
+    int len = paramGets(section, key, "", buffer, sizeof(buffer), fname);
+    return (len == 0) ? def : strtod(buffer, NULL);
+}
+
+int paramGetbool(const char *section, const char *key, int def,
+                 const char *fname) {
+    char buffer[2];
+    paramGets(section, key, "", buffer, sizeof(buffer), fname);
+    const char c = toupper(buffer[0]);
+    if (c == 'Y' || c == '1' || c == 'T') return 1;
+    if (c == 'N' || c == '0' || c == 'F') return 0;
+    return def;
+}
@@ -23,25 +23,38 @@
 #include "../include/particle.h"
 #include "../include/mitos.h"
 
-int cleanParticles(struct particle **particles, const struct params *pars,
-                   const struct particle_type *ptype) {
+int allocParticles(struct particle_data *parts, long long int num) {
+    parts->num = num;
+    parts->pos = malloc(3 * num * sizeof(pos_t));
+    parts->vel = malloc(3 * num * sizeof(float));
+    parts->id = malloc(num * sizeof(long long int));
 
-    free(*particles);
+    if (num > 0 && (parts->pos == NULL || parts->vel == NULL || parts->id == NULL)) {
+        printf("Error allocating memory for %lld particles.\n", num);
+        free(parts->pos);
+        free(parts->vel);
+        free(parts->id);
+        parts->pos = NULL;
+        parts->vel = NULL;
+        parts->id = NULL;
+        return 1;
+    }
 
     return 0;
 }
 
-int allocParticles(struct particle **particles, const struct params *pars,
-                   const struct particle_type *ptype) {
-
-    long long int partnum = ptype->TotalNumber;
-    long long int chunk_size = ceil((double) partnum / ptype->Chunks);
-    *particles = malloc(chunk_size * sizeof(struct particle));
+int cleanParticles(struct particle_data *parts) {
+    free(parts->pos);
+    free(parts->vel);
+    free(parts->id);
+    parts->pos = NULL;
+    parts->vel = NULL;
+    parts->id = NULL;
 
     return 0;
 }
 
-int genParticles_FromGrid(struct particle **particles, const struct params *pars,
+int genParticles_FromGrid(struct particle_data *parts, const struct params *pars,
                           const struct units *us, const struct cosmology *cosmo,
                           const struct particle_type *ptype, int chunk,
                           long long int id_first_particle) {
@@ -56,10 +69,9 @@ int genParticles_FromGrid(struct particle **particles, const struct params *pars
         return 1;
     }
 
-    /* Physical spacing and mass of the particles */
-    float len = pars->BoxLen;
-    float spacing = len / M;
-    float mass = ptype->Mass;
+    /* Physical spacing of the particles */
+    double len = pars->BoxLen;
+    double spacing = len / M;
 
     /* Find where the chunk starts and ends */
     long long start = chunk * chunk_size;
@@ -70,21 +82,20 @@ int genParticles_FromGrid(struct particle **particles, const struct params *pars
         int x,y,z;
         inverse_row_major(id, &x, &y, &z, M);
 
-        struct particle *part = &(*particles)[id - start];
-        part->X = x * spacing;
-        part->Y = y * spacing;
-        part->Z = z * spacing;
-        part->v_X = 0.f;
-        part->v_Y = 0.f;
-        part->v_Z = 0.f;
-        part->mass = mass;
-        part->id = id + id_first_particle;
+        long long int i = id - start;
+        parts->pos[3 * i + 0] = x * spacing;
+        parts->pos[3 * i + 1] = y * spacing;
+        parts->pos[3 * i + 2] = z * spacing;
+        parts->vel[3 * i + 0] = 0.f;
+        parts->vel[3 * i + 1] = 0.f;
+        parts->vel[3 * i + 2] = 0.f;
+        parts->id[i] = id + id_first_particle;
     }
 
     return 0;
 }
 
-int genParticlesFromGrid_local(struct particle **particles, const struct params *pars,
+int genParticlesFromGrid_local(struct particle_data *parts, const struct params *pars,
                                const struct units *us, const struct cosmology *cosmo,
                                const struct particle_type *ptype, int MX, int X_min,
                                int offset, long long int id_first_particle) {
@@ -98,27 +109,24 @@ int genParticlesFromGrid_local(struct particle **particles, const struct params
         return 1;
     }
 
-    /* Physical spacing and mass of the particles */
-    float len = pars->BoxLen;
-    float spacing = len / M;
-    float mass = ptype->Mass;
+    /* Physical spacing of the particles */
+    double len = pars->BoxLen;
+    double spacing = len / M;
 
-    int counter = 0;
+    long long int counter = 0;
 
     for (int x = X_min - offset; x < X_min - offset + MX; x++) {
         for (int y = 0; y < M; y++) {
             for (int z = 0; z < M; z++) {
                 long long id = row_major(x, y, z, M) + id_first_particle;
 
-                struct particle *part = &(*particles)[counter];
-                part->X = wrap(x, M) * spacing;
-                part->Y = wrap(y, M) * spacing;
-                part->Z = wrap(z, M) * spacing;
-                part->v_X = 0.f;
-                part->v_Y = 0.f;
-                part->v_Z = 0.f;
-                part->mass = mass;
-                part->id = id;
+                parts->pos[3 * counter + 0] = wrap(x, M) * spacing;
+                parts->pos[3 * counter + 1] = wrap(y, M) * spacing;
+                parts->pos[3 * counter + 2] = wrap(z, M) * spacing;
+                parts->vel[3 * counter + 0] = 0.f;
+                parts->vel[3 * counter + 1] = 0.f;
+                parts->vel[3 * counter + 2] = 0.f;
+                parts->id[counter] = id;
 
                 counter++;
             }
@@ -127,3 +135,198 @@ int genParticlesFromGrid_local(struct particle **particles, const struct params
 
     return 0;
 }
+
+/* Generate parts->num particles from the lattice, starting with the particle
+ * at (row major) lattice index first */
+int genParticlesFromGrid_range(struct particle_data *parts, const struct params *pars,
+                               const struct particle_type *ptype, long long int first,
+                               long long int id_first_particle) {
+
+    long long int partnum = ptype->TotalNumber;
+    int M = ptype->CubeRootNumber;
+
+    /* Throw an error if the particle number is not a cube */
+    if ((long long int) M*M*M != partnum) {
+        printf("ERROR: Number is not a cube; cannot generate particles from grid.\n");
+        return 1;
+    }
+
+    /* Throw an error if the range is out of bounds */
+    if (first < 0 || first + parts->num > partnum) {
+        printf("ERROR: Particle range [%lld, %lld) out of bounds.\n", first, first + parts->num);
+        return 1;
+    }
+
+    /* Physical spacing of the particles */
+    double len = pars->BoxLen;
+    double spacing = len / M;
+
+    /* Place the particles on a grid */
+    #pragma omp parallel for
+    for (long long int i = 0; i < parts->num; i++) {
+        int x,y,z;
+        inverse_row_major(first + i, &x, &y, &z, M);
+
+        parts->pos[3 * i + 0] = x * spacing;
+        parts->pos[3 * i + 1] = y * spacing;
+        parts->pos[3 * i + 2] = z * spacing;
+        parts->vel[3 * i + 0] = 0.f;
+        parts->vel[3 * i + 1] = 0.f;
+        parts->vel[3 * i + 2] = 0.f;
+        parts->id[i] = first + i + id_first_particle;
+    }
+
+    return 0;
+}
+
+/* Peak memory per particle in the particle stage, where one buffer of
+ * particles is being written while the next is generated, including the
+ * temporary arrays used for sorting the particles by cell */
+size_t particleStageBytes(char sort) {
+    const size_t particle_bytes = 3 * sizeof(pos_t) + 3 * sizeof(float) + sizeof(long long int);
+    if (sort) {
+        /* A permuted copy, the sort order, and the sort keys */
+        return 3 * particle_bytes + 2 * sizeof(long long int);
+    } else {
+        return 2 * particle_bytes;
+    }
+}
+
+/* The number of particles generated from the lattice of a given type by the
+ * rank that holds the grid slice X0 <= X < X0 + NX */
+long long int localParticleNumber(const struct particle_type *ptype, int N,
+                                  int X0, int NX) {
+    if (ptype->TotalNumber <= 0) return 0;
+
+    /* The particles are generated from a grid with dimension M^3 */
+    int M = ptype->CubeRootNumber;
+    double fac = (double) M / N;
+    int X_min = ceil(X0 * fac);
+    int X_max = ceil((X0 + NX) * fac);
+
+    return (long long int) (X_max - X_min) * M * M;
+}
+
+/* The grid rows X0 <= X < X0 + NX that contain the lattice positions of
+ * the particles first <= i < first + num of a given type (num > 0) */
+void particleGridRows(const struct particle_type *ptype, int N,
+                      long long int first, long long int num, int *X0, int *NX) {
+    const long long int M = ptype->CubeRootNumber;
+
+    /* The first and last lattice rows of the particles */
+    const long long int row_first = first / (M * M);
+    const long long int row_last = (first + num - 1) / (M * M);
+
+    *X0 = row_first * N / M;
+    *NX = row_last * N / M - *X0 + 1;
+}
+
+/* An upper bound on the number of grid rows that contain the lattice
+ * positions of any num consecutive particles of a given type */
+int maxParticleGridRows(const struct particle_type *ptype, int N,
+                        long long int num) {
+    const long long int M = ptype->CubeRootNumber;
+
+    /* The particles can span one more lattice row than they fill */
+    const long long int lattice_rows = (num + M * M - 1) / (M * M) + 1;
+    const long long int rows = ((lattice_rows - 1) * N + M - 1) / M + 1;
+
+    return (rows < N) ? rows : N;
+}
+
+/* Apply a permutation to the particle arrays, such that the particle at
+ * position i is moved to position dest[i] (scatter) or the particle at
+ * position src[i] is moved to position i (gather). */
+static int permuteParticles(struct particle_data *parts, const long long int *order,
+                            char scatter) {
+    const long long int num = parts->num;
+    struct particle_data permuted;
+    if (allocParticles(&permuted, num) > 0) return 1;
+
+    #pragma omp parallel for
+    for (long long int i = 0; i < num; i++) {
+        long long int dst = scatter ? order[i] : i;
+        long long int src = scatter ? i : order[i];
+        for (int k = 0; k < 3; k++) {
+            permuted.pos[3 * dst + k] = parts->pos[3 * src + k];
+            permuted.vel[3 * dst + k] = parts->vel[3 * src + k];
+        }
+        permuted.id[dst] = parts->id[src];
+    }
+
+    cleanParticles(parts);
+    *parts = permuted;
+
+    return 0;
+}
+
+/* Sort the particles by the (X,Y) column of grid cells that contains them,
+ * such that interpolation passes access the grids in slab order. We use a
+ * stable counting sort over the columns of the local slice and its ghost
+ * rows. On return, the particle now at position i was previously at
+ * position order[i]. */
+int sortParticlesByCell(struct particle_data *parts, long long int *order,
+                        int N, double boxlen, int X0, int NX, int ghost_NX) {
+
+    const long long int num = parts->num;
+
+    /* Number of rows spanned by the local slice and the ghost rows */
+    const int rows = (NX + 2 * ghost_NX < N) ? NX + 2 * ghost_NX : N;
+    const long long int columns = (long long int) rows * N;
+
+    /* Compute the column index of each particle */
+    long long int *keys = malloc(num * sizeof(long long int));
+    long long int *counts = calloc(columns + 1, sizeof(long long int));
+    if (keys == NULL || counts == NULL) {
+        printf("Error allocating memory for sorting particles.\n");
+        return 1;
+    }
+
+    #pragma omp parallel for
+    for (long long int i = 0; i < num; i++) {
+        int iX = (int) floor(parts->pos[3 * i + 0] * N / boxlen);
+        int iY = (int) floor(parts->pos[3 * i + 1] * N / boxlen);
+
+        /* Local row, counting from the first ghost row on the left */
+        int lX = wrap(iX - X0 + ghost_NX, N);
+        if (lX >= rows) lX = rows - 1;
+
+        keys[i] = (long long int) lX * N + wrap(iY, N);
+    }
+
+    /* Count the particles in each column */
+    for (long long int i = 0; i < num; i++) {
+        counts[keys[i] + 1]++;
+    }
+
+    /* Prefix sum to find where each column starts */
+    for (long long int c = 0; c < columns; c++) {
+        counts[c + 1] += counts[c];
+    }
+
+    /* Stable placement of the particles */
+    for (long long int i = 0; i < num; i++) {
+        order[counts[keys[i]]++] = i;
+    }
+
+    free(keys);
+    free(counts);
+
+    /* Gather the particles into sorted order */
+    if (permuteParticles(parts, order, 0) > 0) {
+        printf("Error allocating memory for sorting particles.\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Undo the permutation applied by sortParticlesByCell */
+int unsortParticles(struct particle_data *parts, const long long int *order) {
+    if (permuteParticles(parts, order, 1) > 0) {
+        printf("Error allocating memory for unsorting particles.\n");
+        return 1;
+    }
+
+    return 0;
+}
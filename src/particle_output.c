@@ -0,0 +1,164 @@
+/*******************************************************************************
+ * This file is part of Mitos.
+ * Copyright (c) 2020 Willem Elbers (whe@willemelbers.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "../include/particle_output.h"
+#include "../include/mitos.h"
+
+const char *particle_dataset_names[NUM_PARTICLE_DATASETS] = {
+    "Coordinates", "Velocities", "ParticleIDs", "Masses"};
+
+/* Create the datasets of an export group with num particles, including the
+ * Masses dataset if with_masses is set. The datasets have the same types as
+ * the particle arrays (see writeParticles_MPI). */
+int createParticleDatasets(hid_t h_grp, hsize_t num, char with_masses) {
+    /* Vector dataspace (e.g. positions, velocities) */
+    const hsize_t vrank = 2;
+    const hsize_t vdims[2] = {num, 3};
+    hid_t h_vspace = H5Screate_simple(vrank, vdims, NULL);
+
+    /* Scalar dataspace (e.g. masses, particle ids) */
+    const hsize_t srank = 1;
+    const hsize_t sdims[1] = {num};
+    hid_t h_sspace = H5Screate_simple(srank, sdims, NULL);
+
+    /* Dataset properties for vectors & scalars (optionally compressed) */
+    hid_t h_vprop = createDatasetList_MPI(vrank, vdims, HDF5_PARTICLE_CHUNK_ROWS);
+    hid_t h_sprop = createDatasetList_MPI(srank, sdims, HDF5_PARTICLE_CHUNK_ROWS);
+
+    /* The dataset types, in the order of the particle datasets */
+    const hid_t types[NUM_PARTICLE_DATASETS] = {
+        H5T_NATIVE_POS, H5T_NATIVE_FLOAT, H5T_NATIVE_LLONG, H5T_NATIVE_DOUBLE};
+    const char vector[NUM_PARTICLE_DATASETS] = {1, 1, 0, 0};
+
+    int err = 0;
+    for (int i=0; i<NUM_PARTICLE_DATASETS; i++) {
+        if (i == DATASET_MASSES && !with_masses) continue;
+
+        hid_t h_space = vector[i] ? h_vspace : h_sspace;
+        hid_t h_prop = vector[i] ? h_vprop : h_sprop;
+        hid_t h_data = H5Dcreate(h_grp, particle_dataset_names[i], types[i], h_space, H5P_DEFAULT, h_prop, H5P_DEFAULT);
+        if (h_data < 0) {
+            printf("Error creating dataset '%s'.\n", particle_dataset_names[i]);
+            err = 1;
+            break;
+        }
+        H5Dclose(h_data);
+    }
+
+    /* Close the property lists and dataspaces */
+    H5Pclose(h_vprop);
+    H5Pclose(h_sprop);
+    H5Sclose(h_vspace);
+    H5Sclose(h_sspace);
+
+    return err;
+}
+
+/* Write the coordinates, velocities, ids, and (if needed) masses of a
+ * sub-chunk of particles. The particle arrays have the same layout and
+ * types as the datasets, so they can be written directly without type
+ * conversion, which would make HDF5 switch to independent I/O. */
+int writeParticles_MPI(struct particle_write *pw) {
+    const struct particle_data *parts = pw->parts;
+    const hsize_t num = parts->num;
+    hid_t h_data;
+    int err;
+
+    /* Write coordinate data (vector) */
+    h_data = H5Dopen(pw->h_grp, "Coordinates", H5P_DEFAULT);
+    err = writeRows_MPI(pw->comm, h_data, H5T_NATIVE_POS, pw->h_xfer, pw->first_row, num, parts->pos,
+                        &pw->seconds[DATASET_COORDINATES], &pw->bytes[DATASET_COORDINATES]);
+    H5Dclose(h_data);
+    if (err > 0) return err;
+
+    /* Write velocity data (vector) */
+    h_data = H5Dopen(pw->h_grp, "Velocities", H5P_DEFAULT);
+    err = writeRows_MPI(pw->comm, h_data, H5T_NATIVE_FLOAT, pw->h_xfer, pw->first_row, num, parts->vel,
+                        &pw->seconds[DATASET_VELOCITIES], &pw->bytes[DATASET_VELOCITIES]);
+    H5Dclose(h_data);
+    if (err > 0) return err;
+
+    /* Write particle id data (scalar) */
+    h_data = H5Dopen(pw->h_grp, "ParticleIDs", H5P_DEFAULT);
+    err = writeRows_MPI(pw->comm, h_data, H5T_NATIVE_LLONG, pw->h_xfer, pw->first_row, num, parts->id,
+                        &pw->seconds[DATASET_IDS], &pw->bytes[DATASET_IDS]);
+    H5Dclose(h_data);
+    if (err > 0) return err;
+
+    /* Write mass data (scalar), unless the masses are in the MassTable.
+     * The masses are uniform, so we write them from a small constant buffer,
+     * one block at a time. All ranks make the same number of (possibly
+     * empty) writes for collective I/O. */
+    if (H5Lexists(pw->h_grp, "Masses", H5P_DEFAULT) > 0) {
+        const hsize_t mass_block = 65536;
+        double *masses = malloc(mass_block * sizeof(double));
+        for (hsize_t j=0; j<mass_block; j++) {
+            masses[j] = pw->mass;
+        }
+
+        long long int blocks = (num + mass_block - 1) / mass_block;
+        MPI_Allreduce(MPI_IN_PLACE, &blocks, 1, MPI_LONG_LONG, MPI_MAX, pw->comm);
+
+        h_data = H5Dopen(pw->h_grp, "Masses", H5P_DEFAULT);
+        for (long long int b=0; b<blocks && err == 0; b++) {
+            const hsize_t j = b * mass_block;
+            const hsize_t rows = (num > j) ? ((num - j < mass_block) ? num - j : mass_block) : 0;
+            err = writeRows_MPI(pw->comm, h_data, H5T_NATIVE_DOUBLE, pw->h_xfer, pw->first_row + j, rows, masses,
+                                &pw->seconds[DATASET_MASSES], &pw->bytes[DATASET_MASSES]);
+        }
+        H5Dclose(h_data);
+        free(masses);
+    }
+
+    return err;
+}
+
+static void *particleWriteThread(void *arg) {
+    struct particle_write *pw = (struct particle_write *) arg;
+    pw->err = writeParticles_MPI(pw);
+    return NULL;
+}
+
+/* Start writing a sub-chunk of particles, either in a background thread or
+ * (if async is false or the thread cannot be created) immediately */
+int startParticleWrite_MPI(struct particle_write *pw, char async) {
+    pw->err = 0;
+    pw->running = 0;
+
+    if (async && pthread_create(&pw->thread, NULL, particleWriteThread, pw) == 0) {
+        pw->running = 1;
+        return 0;
+    }
+
+    pw->err = writeParticles_MPI(pw);
+    return pw->err;
+}
+
+/* Wait for a write started by startParticleWrite_MPI to complete */
+int finishParticleWrite_MPI(struct particle_write *pw) {
+    if (pw->running) {
+        pthread_join(pw->thread, NULL);
+        pw->running = 0;
+    }
+
+    return pw->err;
+}
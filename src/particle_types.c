@@ -40,7 +40,7 @@ int readTypes(struct params *pars, struct particle_type **tps, const char *fname
         char seek_str[40];
         char identifier[40];
         sprintf(seek_str, "ParticleType_%d", i);
-        ini_gets(seek_str, "Identifier", "", identifier, 40, fname);
+        paramGets(seek_str, "Identifier", "", identifier, 40, fname);
 
         /* Have we found a non-empty identifier? */
         if (identifier[0] != '\0') {
@@ -48,38 +48,38 @@ int readTypes(struct params *pars, struct particle_type **tps, const char *fname
 
             tp->Identifier = malloc(strlen(identifier)+1);
             tp->ExportName = malloc(DEFAULT_STRING_LENGTH);
-            ini_gets(seek_str, "Identifier", "", tp->Identifier, 20, fname);
-            ini_gets(seek_str, "ExportName", "", tp->ExportName, 20, fname);
-            // tp->Omega = ini_getd(seek_str, "Omega", 1.0, fname);
-            // tp->Mass = ini_getd(seek_str, "Mass", 1.0, fname);
-            tp->Multiplicity = ini_getd(seek_str, "Multiplicity", 1.0, fname);
-            tp->TotalNumber = ini_getl(seek_str, "TotalNumber", 0, fname);
-            tp->CubeRootNumber = ini_getl(seek_str, "CubeRootNumber", 0, fname);
-            tp->Chunks = ini_getl(seek_str, "Chunks", 0, fname);
-            tp->ChunkSize = ini_getl(seek_str, "ChunkSize", 0, fname);
-
-            tp->CyclesOfMongeAmpere = ini_getl(seek_str, "CyclesOfMongeAmpere", 0, fname);
-            tp->CyclesOfSPT = ini_getl(seek_str, "CyclesOfSPT", 0, fname);
-            tp->Run2LPT = ini_getl(seek_str, "Run2LPT", 0, fname);
+            paramGets(seek_str, "Identifier", "", tp->Identifier, 20, fname);
+            paramGets(seek_str, "ExportName", "", tp->ExportName, 20, fname);
+            // tp->Omega = paramGetd(seek_str, "Omega", 1.0, fname);
+            // tp->Mass = paramGetd(seek_str, "Mass", 1.0, fname);
+            tp->Multiplicity = paramGetd(seek_str, "Multiplicity", 1.0, fname);
+            tp->TotalNumber = paramGetl(seek_str, "TotalNumber", 0, fname);
+            tp->CubeRootNumber = paramGetl(seek_str, "CubeRootNumber", 0, fname);
+            tp->Chunks = paramGetl(seek_str, "Chunks", 0, fname);
+            tp->ChunkSize = paramGetl(seek_str, "ChunkSize", 0, fname);
+
+            tp->CyclesOfMongeAmpere = paramGetl(seek_str, "CyclesOfMongeAmpere", 0, fname);
+            tp->CyclesOfSPT = paramGetl(seek_str, "CyclesOfSPT", 0, fname);
+            tp->Run2LPT = paramGetl(seek_str, "Run2LPT", 0, fname);
 
             /* Possible input filenames for density and energy flux fields */
             int len = DEFAULT_STRING_LENGTH;
             tp->InputFilenameDensity = malloc(len);
             tp->InputFilenameVelocity = malloc(len);
-            ini_gets(seek_str, "InputFilenameDensity", "", tp->InputFilenameDensity, len, fname);
-            ini_gets(seek_str, "InputFilenameVelocity", "", tp->InputFilenameVelocity, len, fname);
+            paramGets(seek_str, "InputFilenameDensity", "", tp->InputFilenameDensity, len, fname);
+            paramGets(seek_str, "InputFilenameVelocity", "", tp->InputFilenameVelocity, len, fname);
 
             /* Further strings */
             tp->TransferFunctionDensity = malloc(20);
             tp->TransferFunctionVelocity = malloc(20);
             tp->ThermalMotionType = malloc(20);
-            ini_gets(seek_str, "TransferFunctionDensity", "", tp->TransferFunctionDensity, 20, fname);
-            ini_gets(seek_str, "TransferFunctionVelocity", "", tp->TransferFunctionVelocity, 20, fname);
-            ini_gets(seek_str, "ThermalMotionType", "", tp->ThermalMotionType, 20, fname);
+            paramGets(seek_str, "TransferFunctionDensity", "", tp->TransferFunctionDensity, 20, fname);
+            paramGets(seek_str, "TransferFunctionVelocity", "", tp->TransferFunctionVelocity, 20, fname);
+            paramGets(seek_str, "ThermalMotionType", "", tp->ThermalMotionType, 20, fname);
 
             /* Firebolt rejection sampler settings */
-            tp->FireboltMaxPerturbation = ini_getd(seek_str, "FireboltMaxPerturbation", 0.01, fname);
-            tp->UseFirebolt = ini_getbool(seek_str, "UseFirebolt", 0, fname);
+            tp->FireboltMaxPerturbation = paramGetd(seek_str, "FireboltMaxPerturbation", 0.01, fname);
+            tp->UseFirebolt = paramGetbool(seek_str, "UseFirebolt", 0, fname);
 
             /* Infer total number from cube root number or vice versa */
             if (tp->TotalNumber == 0 && tp->CubeRootNumber > 0) {
@@ -89,10 +89,11 @@ int readTypes(struct params *pars, struct particle_type **tps, const char *fname
                 tp->CubeRootNumber = ceil(cbrt((double)tp->TotalNumber));
             }
 
-            /* Make sure that Chunks and ChunkSize match */
-            if (tp->Chunks == 0 && tp->ChunkSize > 0) {
+            /* Make sure that Chunks and ChunkSize match (ChunkSize takes
+             * precedence if both are specified) */
+            if (tp->ChunkSize > 0) {
                 tp->Chunks = ceil((double) tp->TotalNumber / tp->ChunkSize);
-            } else if (tp->Chunks > 0 && tp->ChunkSize == 0) {
+            } else if (tp->Chunks > 0) {
                 tp->ChunkSize = ceil((double) tp->TotalNumber / tp->Chunks);
             } else {
                 tp->Chunks = 1;
@@ -278,3 +279,77 @@ int cleanExportGroups(struct params *pars, struct export_group **grps) {
 
     return 0;
 }
+
+/* Determine whether all particle types that map into the export group with
+ * the given name have the same mass. If so, the mass is stored in *mass. */
+char exportGroupUniformMass(const struct params *pars, struct particle_type **tps,
+                            const char *ExportName, double *mass) {
+    char found = 0;
+    char uniform = 1;
+
+    /* For each user-defined particle type */
+    for (int pti = 0; pti < pars->NumParticleTypes; pti++) {
+        struct particle_type *ptype = *tps + pti;
+
+        /* Skip particle types that map into other groups */
+        if (strcmp(ptype->ExportName, ExportName) != 0) continue;
+
+        if (!found) {
+            *mass = ptype->Mass;
+            found = 1;
+        } else if (ptype->Mass != *mass) {
+            uniform = 0;
+        }
+    }
+
+    return found && uniform;
+}
+
+/* Add a title to a list of titles, unless it is empty or already present */
+static void addTitle(char **titles, int *n_titles, const char *title) {
+    if (strcmp(title, "") == 0) return;
+    for (int i = 0; i < *n_titles; i++) {
+        if (strcmp(titles[i], title) == 0) return;
+    }
+    titles[*n_titles] = malloc(strlen(title) + 1);
+    strcpy(titles[*n_titles], title);
+    (*n_titles)++;
+}
+
+/* Determine the titles of the transfer functions that are needed for the
+ * particle types and the other settings. The caller should free the titles
+ * and the list. */
+int requiredTransferTitles(const struct params *pars, struct particle_type **tps,
+                           char ***titles, int *n_titles) {
+    /* Two titles per particle type, plus the titles below */
+    *titles = malloc((2 * pars->NumParticleTypes + 8) * sizeof(char*));
+    *n_titles = 0;
+
+    char UseFirebolt = 0;
+
+    /* For each user-defined particle type */
+    for (int pti = 0; pti < pars->NumParticleTypes; pti++) {
+        struct particle_type *ptype = *tps + pti;
+        addTitle(*titles, n_titles, ptype->TransferFunctionDensity);
+        addTitle(*titles, n_titles, ptype->TransferFunctionVelocity);
+        UseFirebolt |= ptype->UseFirebolt;
+    }
+
+    /* Merging cdm & baryons requires both sets of functions */
+    if (pars->MergeDarkMatterBaryons) {
+        addTitle(*titles, n_titles, "d_cdm");
+        addTitle(*titles, n_titles, "d_b");
+        addTitle(*titles, n_titles, "t_cdm");
+        addTitle(*titles, n_titles, "t_b");
+    }
+
+    /* Source functions for the Firebolt Boltzmann solver */
+    if (UseFirebolt) {
+        addTitle(*titles, n_titles, "h_prime");
+        addTitle(*titles, n_titles, "eta_prime");
+        addTitle(*titles, n_titles, "delta_shift_Nb_m");
+        addTitle(*titles, n_titles, "t_cdm");
+    }
+
+    return 0;
+}
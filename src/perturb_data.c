@@ -28,10 +28,57 @@
 /* Read the perturbation data from file */
 int readPerturb(const struct params *pars, const struct units *us,
                 struct perturb_data *pt, char *fname) {
+    return readPerturbSelection(pars, us, pt, fname, NULL, 0, 0.);
+}
+
+/* Read the rows tau_first <= tau < tau_first + tau_count of function i from
+ * a dataset with layout (n_functions, tau_size, inner), which may be stored
+ * with rank 1, 2, or 3 */
+static herr_t readFunctionRows(hid_t h_data, int i, int tau_first, int tau_count,
+                               int tau_size, int inner, double *out) {
+    hid_t h_space = H5Dget_space(h_data);
+    int rank = H5Sget_simple_extent_ndims(h_space);
+
+    hsize_t start[3] = {i, tau_first, 0};
+    hsize_t count[3] = {1, tau_count, inner};
+    if (rank == 2) {
+        start[1] = (hsize_t) tau_first * inner;
+        count[1] = (hsize_t) tau_count * inner;
+    } else if (rank == 1) {
+        start[0] = ((hsize_t) i * tau_size + tau_first) * inner;
+        count[0] = (hsize_t) tau_count * inner;
+    } else if (rank != 3) {
+        H5Sclose(h_space);
+        return -1;
+    }
+
+    /* Read the selection into a contiguous block of memory */
+    const hsize_t mem_count = (hsize_t) tau_count * inner;
+    hid_t h_memspace = H5Screate_simple(1, &mem_count, NULL);
+    H5Sselect_hyperslab(h_space, H5S_SELECT_SET, start, NULL, count, NULL);
+    herr_t h_err = H5Dread(h_data, H5T_NATIVE_DOUBLE, h_memspace, h_space, H5P_DEFAULT, out);
+
+    H5Sclose(h_memspace);
+    H5Sclose(h_space);
+
+    return h_err;
+}
+
+/* Read the perturbation data from file, retaining only the transfer functions
+ * with the given titles (or all functions if select_titles is NULL). If
+ * z_max > 0, only the time steps after z = z_max are retained, along with a
+ * few earlier steps as margin for interpolation. */
+int readPerturbSelection(const struct params *pars, const struct units *us,
+                         struct perturb_data *pt, char *fname,
+                         char **select_titles, int n_select, double z_max) {
     message(pars->rank, "Reading cosmological perturbations from '%s'.\n", fname);
 
     /* Open the hdf5 file (file exists error handled by HDF5) */
     hid_t h_file = H5Fopen(fname, H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (h_file < 0) {
+        printf("ERROR: unable to open perturbation file '%s'.\n", fname);
+        return 1;
+    }
 
     /* Open the Header group */
     hid_t h_grp = H5Gopen(h_file, "Header", H5P_DEFAULT);
@@ -57,6 +104,8 @@ int readPerturb(const struct params *pars, const struct units *us,
     /* Check that it makes sense */
     if (pt->k_size <= 0 || pt->tau_size <= 0 || pt->n_functions <= 0) {
         printf("ERROR: reading an empty perturbation file.\n");
+        H5Gclose(h_grp);
+        H5Fclose(h_file);
         return 1;
     }
 
@@ -97,32 +146,59 @@ int readPerturb(const struct params *pars, const struct units *us,
     /* Check that it makes sense */
     if (UnitLengthMetres <= 0 || UnitTimeSeconds <= 0 || UnitMassKilogram <= 0) {
         printf("ERROR: unknown units of perturbation file.\n");
+        H5Gclose(h_grp);
+        H5Fclose(h_file);
         return 1;
     }
 
     /* Close the Header group */
     H5Gclose(h_grp);
 
+    /* Determine which transfer functions to read */
+    const int n_functions_file = pt->n_functions;
+    int *file_index = malloc(n_functions_file * sizeof(int));
+    pt->n_functions = 0;
+    for (int i=0; i<n_functions_file; i++) {
+        char keep = (select_titles == NULL);
+        for (int j=0; j<n_select && !keep; j++) {
+            keep = (strcmp(pt->titles[i], select_titles[j]) == 0);
+        }
+
+        if (keep) {
+            file_index[pt->n_functions] = i;
+            pt->titles[pt->n_functions] = pt->titles[i];
+            pt->n_functions++;
+        } else {
+            free(pt->titles[i]);
+        }
+    }
+
+    if (select_titles != NULL) {
+        message(pars->rank, "Reading %d of %d transfer functions.\n", pt->n_functions, n_functions_file);
+    }
+
     /* Open the data group */
     h_grp = H5Gopen(h_file, "Perturb", H5P_DEFAULT);
 
-    /* Allocate memory */
+    /* Allocate memory for the time-independent and background vectors */
+    const int tau_size_file = pt->tau_size;
     pt->k = calloc(pt->k_size, sizeof(double));
-    pt->log_tau = calloc(pt->tau_size, sizeof(double));
-    pt->redshift = calloc(pt->tau_size, sizeof(double));
-    pt->D_growth = calloc(pt->tau_size, sizeof(double));
-    pt->f_growth = calloc(pt->tau_size, sizeof(double));
-    pt->H_Hubble = calloc(pt->tau_size, sizeof(double));
-    pt->delta = malloc(pt->n_functions * pt->k_size * pt->tau_size * sizeof(double));
-    pt->Omega = malloc(pt->n_functions * pt->tau_size * sizeof(double));
-    // pt->dydt = malloc(pt->n_functions * pt->k_size * pt->tau_size * sizeof(double));
+    pt->log_tau = calloc(tau_size_file, sizeof(double));
+    pt->redshift = calloc(tau_size_file, sizeof(double));
+    pt->D_growth = calloc(tau_size_file, sizeof(double));
+    pt->f_growth = calloc(tau_size_file, sizeof(double));
+    pt->H_Hubble = calloc(tau_size_file, sizeof(double));
 
     /* Dataspace */
     hid_t h_data;
 
     /* Allocation successful? */
-    if (pt->k == NULL || pt->log_tau == NULL || pt->delta == NULL || pt->redshift == NULL || pt->D_growth == NULL) {
+    if (pt->k == NULL || pt->log_tau == NULL || pt->redshift == NULL || pt->D_growth == NULL) {
         printf("ERROR: unable to allocate memory for perturbation data.");
+        free(file_index);
+        H5Gclose(h_grp);
+        H5Fclose(h_file);
+        return 1;
     }
 
     /* Read the wavenumbers */
@@ -155,25 +231,66 @@ int readPerturb(const struct params *pars, const struct units *us,
     h_err = H5Dread(h_data, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, pt->H_Hubble);
     H5Dclose(h_data);
 
-    /* Read the background densities */
+    /* Determine the first time step to retain. The redshifts decrease with
+     * time, so we keep the steps from just before z_max until the end. */
+    int tau_first = 0;
+    if (z_max > 0) {
+        for (int i=0; i<tau_size_file; i++) {
+            if (pt->redshift[i] >= z_max) {
+                tau_first = i;
+            }
+        }
+        tau_first = (tau_first > PERTURB_TIME_WINDOW_MARGIN) ? tau_first - PERTURB_TIME_WINDOW_MARGIN : 0;
+        pt->tau_size = tau_size_file - tau_first;
+
+        message(pars->rank, "Reading %d of %d time steps (z <= %.2f).\n", pt->tau_size, tau_size_file, pt->redshift[tau_first]);
+
+        /* Discard the earlier time steps from the background vectors */
+        memmove(pt->log_tau, pt->log_tau + tau_first, pt->tau_size * sizeof(double));
+        memmove(pt->redshift, pt->redshift + tau_first, pt->tau_size * sizeof(double));
+        memmove(pt->D_growth, pt->D_growth + tau_first, pt->tau_size * sizeof(double));
+        memmove(pt->f_growth, pt->f_growth + tau_first, pt->tau_size * sizeof(double));
+        memmove(pt->H_Hubble, pt->H_Hubble + tau_first, pt->tau_size * sizeof(double));
+    }
+
+    /* Allocate memory for the selected functions */
+    pt->delta = malloc((long int) pt->n_functions * pt->k_size * pt->tau_size * sizeof(double));
+    pt->Omega = malloc((long int) pt->n_functions * pt->tau_size * sizeof(double));
+
+    if ((pt->delta == NULL || pt->Omega == NULL) && pt->n_functions > 0) {
+        printf("ERROR: unable to allocate memory for perturbation data.");
+        free(file_index);
+        H5Gclose(h_grp);
+        H5Fclose(h_file);
+        return 1;
+    }
+
+    /* Read the background densities of the selected functions */
     h_data = H5Dopen2(h_grp, "Omegas", H5P_DEFAULT);
-    h_err = H5Dread(h_data, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, pt->Omega);
+    for (int i=0; i<pt->n_functions && h_err >= 0; i++) {
+        h_err = readFunctionRows(h_data, file_index[i], tau_first, pt->tau_size,
+                                 tau_size_file, 1, pt->Omega + (long int) i * pt->tau_size);
+    }
     H5Dclose(h_data);
 
     if (h_err < 0) {
         printf("ERROR: problem with reading background densities.\n");
+        free(file_index);
+        H5Gclose(h_grp);
+        H5Fclose(h_file);
         return 1;
     }
 
-    /* Read the transfer functions */
+    /* Read the selected transfer functions */
     h_data = H5Dopen2(h_grp, "Transfer functions", H5P_DEFAULT);
-    h_err = H5Dread(h_data, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, pt->delta);
+    for (int i=0; i<pt->n_functions && h_err >= 0; i++) {
+        h_err = readFunctionRows(h_data, file_index[i], tau_first, pt->tau_size,
+                                 tau_size_file, pt->k_size,
+                                 pt->delta + (long int) i * pt->k_size * pt->tau_size);
+    }
     H5Dclose(h_data);
 
-    if (h_err < 0 || pt->k[0] == 0 || pt->log_tau[0] == 0) {
-        printf("ERROR: problem with reading the perturbation data.\n");
-        return 1;
-    }
+    free(file_index);
 
     /* Close the data group */
     H5Gclose(h_grp);
@@ -181,6 +298,11 @@ int readPerturb(const struct params *pars, const struct units *us,
     /* Close the file */
     H5Fclose(h_file);
 
+    if (h_err < 0 || pt->k[0] == 0 || pt->log_tau[0] == 0) {
+        printf("ERROR: problem with reading the perturbation data.\n");
+        return 1;
+    }
+
     /* Perform unit conversions for the wavenumbers */
     for (int i=0; i<pt->k_size; i++) {
         pt->k[i] *= us->UnitLengthMetres / UnitLengthMetres;
@@ -216,7 +338,7 @@ int readPerturb(const struct params *pars, const struct units *us,
         /* Convert from input units to internal units */
         for (int index_k=0; index_k<pt->k_size; index_k++) {
             for (int index_tau=0; index_tau<pt->tau_size; index_tau++) {
-                int index = pt->tau_size * pt->k_size * i + pt->k_size * index_tau + index_k;
+                long int index = (long int) pt->tau_size * pt->k_size * i + pt->k_size * index_tau + index_k;
                 pt->delta[index] *= unit_factor;
             }
         }
@@ -272,7 +394,7 @@ int cleanPerturb(struct perturb_data *pt) {
     free(pt->H_Hubble);
     free(pt->delta);
     free(pt->Omega);
-    for (int i=0; i<pt->n_functions; i++) {
+    for (int i=0; pt->titles != NULL && i<pt->n_functions; i++) {
         free(pt->titles[i]);
     }
     free(pt->titles);
@@ -26,6 +26,20 @@
 
 #include "../include/perturb_spline.h"
 
+/* Find the largest index i in [lo, hi] with x[i] <= v in an ascending
+ * vector, assuming that x[lo] <= v or lo = 0 */
+static inline int searchAscending(const double *x, int lo, int hi, double v) {
+    while (hi > lo) {
+        int mid = (lo + hi + 1) / 2;
+        if (x[mid] <= v) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
 /* Initialize the perturbation spline */
 int initPerturbSpline(struct perturb_spline *spline, int k_acc_size,
                       const struct perturb_data *ptdat) {
@@ -34,7 +48,7 @@ int initPerturbSpline(struct perturb_spline *spline, int k_acc_size,
     spline->ptdat = ptdat;
 
     /* Allocate the k search table */
-    spline->k_acc_table = malloc(k_acc_size * sizeof(double));
+    spline->k_acc_table = malloc(k_acc_size * sizeof(int));
     spline->k_acc_table_size = k_acc_size;
 
     if (spline->k_acc_table == NULL) return 1;
@@ -44,19 +58,26 @@ int initPerturbSpline(struct perturb_spline *spline, int k_acc_size,
     double k_min = ptdat->k[0];
     double k_max = ptdat->k[k_size-1];
 
-    /* Make the index table */
+    /* The table is uniform in log(k), which is O(1) for the logarithmic
+     * k-vectors of Boltzmann codes, unless there are non-positive k */
+    spline->k_acc_log = (k_min > 0);
+    if (spline->k_acc_log) {
+        spline->k_acc_min = log(k_min);
+        spline->k_acc_inv_width = k_acc_size / (log(k_max) - log(k_min));
+    } else {
+        spline->k_acc_min = k_min;
+        spline->k_acc_inv_width = k_acc_size / (k_max - k_min);
+    }
+
+    /* Make the index table in a single pass: entry i is the largest bin j
+     * with k[j] <= v, where v is the left edge of table cell i */
+    int j = 0;
     for (int i=0; i<k_acc_size; i++) {
-        double u = (double) i/k_acc_size;
-        double v = k_min + u * (k_max - k_min);
-
-        /* Find the largest bin such that w > k */
-        double maxJ = 0;
-        for(int j=0; j<k_size; j++) {
-            if (ptdat->k[j] < v) {
-                maxJ = j;
-            }
-        }
-        spline->k_acc_table[i] = maxJ;
+        double w = spline->k_acc_min + i / spline->k_acc_inv_width;
+        double v = spline->k_acc_log ? exp(w) : w;
+
+        while (j < k_size - 2 && ptdat->k[j + 1] <= v) j++;
+        spline->k_acc_table[i] = j;
     }
 
     return 0;
@@ -87,13 +108,8 @@ int perturbSplineFindTau(const struct perturb_spline *spline, double log_tau,
         return 0;
     }
 
-    /* Find i such that log_tau[i] <= log_tau */
-    for (int i=1; i<tau_size; i++) {
-        if (spline->ptdat->log_tau[i] >= log_tau) {
-          *index = i-1;
-          break;
-        }
-    }
+    /* Find i such that log_tau[i] <= log_tau < log_tau[i+1] */
+    *index = searchAscending(spline->ptdat->log_tau, 0, tau_size - 2, log_tau);
 
     /* Find the bounding values */
     double left = spline->ptdat->log_tau[*index];
@@ -112,33 +128,40 @@ int perturbSplineFindK(const struct perturb_spline *spline, double k, int *index
     /* Bounding values for the larger table */
     int k_acc_table_size = spline->k_acc_table_size;
     int k_size = spline->ptdat->k_size;
-    double k_min = spline->ptdat->k[0];
-    double k_max = spline->ptdat->k[k_size-1];
+    const double *kvec = spline->ptdat->k;
+    double k_min = kvec[0];
+    double k_max = kvec[k_size-1];
 
-    if (k > k_max) {
+    if (k >= k_max) {
       *index = k_size - 2;
       *u = 1.0;
       return 0;
+    } else if (k <= k_min) {
+      *index = 0;
+      *u = 0.0;
+      return 0;
     }
 
-    /* Quickly find a starting index using the indexed seach */
-    double v = k;
-    double w = (v - k_min) / (k_max - k_min);
-    int J = floor(w * k_acc_table_size);
-    int start = spline->k_acc_table[J < k_acc_table_size ? J : k_acc_table_size - 1];
+    /* Find the cell of the acceleration table */
+    double w = spline->k_acc_log ? log(k) : k;
+    int J = (w - spline->k_acc_min) * spline->k_acc_inv_width;
+    if (J < 0) J = 0;
+    if (J >= k_acc_table_size) J = k_acc_table_size - 1;
 
-    /* Search in the k vector */
-    int i;
-    for (i = start; i < k_size; i++) {
-        if (k >= spline->ptdat->k[i] && k <= spline->ptdat->k[i + 1]) break;
-    }
+    /* The index is bracketed by this cell and the next one */
+    int lo = spline->k_acc_table[J];
+    int hi = (J + 1 < k_acc_table_size) ? spline->k_acc_table[J + 1] : k_size - 2;
 
-    /* We found the index */
-    *index = i;
+    /* Correct for round-off at the cell edges */
+    while (lo > 0 && kvec[lo] > k) lo--;
+    while (hi < k_size - 2 && kvec[hi + 1] <= k) hi++;
+
+    /* Search in the k vector */
+    *index = searchAscending(kvec, lo, hi, k);
 
     /* Find the bounding values */
-    double left = spline->ptdat->k[*index];
-    double right = spline->ptdat->k[*index + 1];
+    double left = kvec[*index];
+    double right = kvec[*index + 1];
 
     /* Calculate the ratio (X - X_left) / (X_right - X_left) */
     *u = (k - left) / (right - left);
@@ -146,6 +169,62 @@ int perturbSplineFindK(const struct perturb_spline *spline, double k, int *index
     return 0;
 }
 
+/* Find the index along the time direction, trying the last hit first */
+int perturbSplineFindTauCursor(const struct perturb_spline *spline,
+                               struct perturb_spline_cursor *cursor,
+                               double log_tau, int *index, double *u) {
+
+    const double *x = spline->ptdat->log_tau;
+    int i = cursor->tau_index;
+
+    /* Try the last bin and the next one, before doing a full search */
+    if (i >= 0 && i < spline->ptdat->tau_size - 1 && x[i] <= log_tau) {
+        if (log_tau < x[i + 1]) {
+            *index = i;
+            *u = (log_tau - x[i]) / (x[i + 1] - x[i]);
+            return 0;
+        } else if (i + 1 < spline->ptdat->tau_size - 1 && log_tau < x[i + 2]) {
+            *index = i + 1;
+            *u = (log_tau - x[i + 1]) / (x[i + 2] - x[i + 1]);
+            cursor->tau_index = *index;
+            return 0;
+        }
+    }
+
+    perturbSplineFindTau(spline, log_tau, index, u);
+    cursor->tau_index = *index;
+
+    return 0;
+}
+
+/* Find the index along the k direction, trying the last hit first */
+int perturbSplineFindKCursor(const struct perturb_spline *spline,
+                             struct perturb_spline_cursor *cursor, double k,
+                             int *index, double *u) {
+
+    const double *x = spline->ptdat->k;
+    int i = cursor->k_index;
+
+    /* Try the last bin and the next one, before doing a full search */
+    if (i >= 0 && i < spline->ptdat->k_size - 1 && x[i] <= k) {
+        if (k < x[i + 1]) {
+            *index = i;
+            *u = (k - x[i]) / (x[i + 1] - x[i]);
+            return 0;
+        } else if (i + 1 < spline->ptdat->k_size - 1 && k < x[i + 2]) {
+            *index = i + 1;
+            *u = (k - x[i + 1]) / (x[i + 2] - x[i + 1]);
+            cursor->k_index = *index;
+            return 0;
+        }
+    }
+
+    perturbSplineFindK(spline, k, index, u);
+    cursor->k_index = *index;
+
+    return 0;
+}
+
 /* Bilinear interpolation of the desired transfer function */
 double perturbSplineInterp(const struct perturb_spline *spline, int k_index,
                            int tau_index, double u_k, double u_tau,
@@ -185,6 +264,24 @@ double perturbSplineInterp0(const struct perturb_spline *spline, double k,
     return perturbSplineInterp(spline, k_index, tau_index, u_k, u_tau, index_src);
 }
 
+/* Bilinear interpolation, using a cursor for a sequence of nearby points */
+double perturbSplineInterpCursor(const struct perturb_spline *spline,
+                                 struct perturb_spline_cursor *cursor, double k,
+                                 double log_tau, int index_src) {
+
+    /* Indices in the k and tau directions */
+    int k_index = 0, tau_index = 0;
+    /* Spacing (0 <= u <= 1) between subsequent indices in both directions */
+    double u_k, u_tau;
+
+    /* Find the indices and spacings */
+    perturbSplineFindTauCursor(spline, cursor, log_tau, &tau_index, &u_tau);
+    perturbSplineFindKCursor(spline, cursor, k, &k_index, &u_k);
+
+    /* Do the interpolation */
+    return perturbSplineInterp(spline, k_index, tau_index, u_k, u_tau, index_src);
+}
+
 double perturbRedshiftAtLogTau(const struct perturb_spline *spline, double log_tau) {
     /* Indices in the tau directions */
     int tau_index = 0;
@@ -249,10 +346,16 @@ double perturbLogTauAtRedshift(const struct perturb_spline *spline, double redsh
         return spline->ptdat->log_tau[tau_size - 1];
     }
 
-    /* Find i such that redshift[i] >= redshift */
-    int index;
-    for (index=tau_size - 1; index>0; index--) {
-        if (spline->ptdat->redshift[index] >= redshift) break;
+    /* Find the largest i such that redshift[i] >= redshift (descending) */
+    const double *z = spline->ptdat->redshift;
+    int index = 0, hi = tau_size - 1;
+    while (hi - index > 1) {
+        int mid = (index + hi) / 2;
+        if (z[mid] >= redshift) {
+            index = mid;
+        } else {
+            hi = mid;
+        }
     }
 
     /* Find the bounding values */
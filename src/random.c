@@ -287,3 +287,67 @@ double samplerCustom(struct sampler *s, rng_state *state) {
 
     return H;
 }
+
+/* Tabulate the inverse cdf of a pdf on [xl, xr] at n + 1 equally spaced
+ * quantiles. The cdf is first integrated with the trapezoidal rule on a
+ * fine grid, which is then inverted with linear interpolation in a single
+ * sweep, so the table is constructed in linear time. */
+int initTableSampler(struct table_sampler *ts, pdf f, double xl, double xr,
+                     void *params) {
+    const int n = INVERSE_CDF_TABLE_LENGTH;
+    const int samples = INVERSE_CDF_PDF_SAMPLES;
+    const double delta = (xr - xl) / samples;
+
+    ts->xl = xl;
+    ts->xr = xr;
+    ts->n = n;
+    ts->x = malloc((n + 1) * sizeof(double));
+
+    /* Unnormalized cdf on the fine grid */
+    double *F = malloc((samples + 1) * sizeof(double));
+
+    if (ts->x == NULL || F == NULL) {
+        printf("Error allocating memory for the inverse cdf table.\n");
+        return 1;
+    }
+
+    F[0] = 0.;
+    double f_prev = f(xl, params);
+    for (int j=1; j<=samples; j++) {
+        double f_next = f(xl + j * delta, params);
+        F[j] = F[j-1] + 0.5 * delta * (f_prev + f_next);
+        f_prev = f_next;
+    }
+
+    if (!(F[samples] > 0)) {
+        printf("Error: the pdf does not have a positive normalization.\n");
+        free(F);
+        return 1;
+    }
+
+    /* Invert the cdf, using that both F and the quantiles are increasing */
+    const double norm = F[samples];
+    int j = 0;
+    ts->x[0] = xl;
+    for (int i=1; i<n; i++) {
+        double target = norm * i / n;
+        while (j < samples - 1 && F[j + 1] < target) j++;
+
+        /* Linear interpolation within the fine interval [j, j+1] */
+        double dF = F[j + 1] - F[j];
+        double w = (dF > 0) ? (target - F[j]) / dF : 0.;
+        ts->x[i] = xl + (j + w) * delta;
+    }
+    ts->x[n] = xr;
+
+    free(F);
+
+    return 0;
+}
+
+int cleanTableSampler(struct table_sampler *ts) {
+    free(ts->x);
+    ts->x = NULL;
+
+    return 0;
+}
@@ -0,0 +1,356 @@
+/*******************************************************************************
+ * This file is part of Mitos.
+ * Copyright (c) 2020 Willem Elbers (whe@willemelbers.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <sys/resource.h>
+
+#include "../include/timers.h"
+
+/* The timers, in the order in which they were first started */
+static struct timer timers[MAX_TIMERS];
+static int num_timers = 0;
+
+/* The running timers and their starting times */
+static int timer_stack[MAX_TIMER_DEPTH];
+static double timer_start[MAX_TIMER_DEPTH];
+static int timer_depth = 0;
+
+/* Number of timers that were started beyond the available space */
+static int timer_overflow = 0;
+
+/* Whether to synchronize the ranks before communication (see commStart) */
+static char profile_mpi = 0;
+
+/* The load balance reports, only stored on the first rank */
+struct load_balance {
+    char name[TIMER_NAME_LENGTH];
+    double min, mean, max;
+    int flagged;
+};
+static struct load_balance balances[MAX_TIMERS];
+static int num_balances = 0;
+
+/* Peak resident memory of this process in kB */
+long int peakMemoryKB(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static int findTimer(const char *name) {
+    for (int i=0; i<num_timers; i++) {
+        if (strcmp(timers[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+/* Start a timer, nested inside the currently running timer (if any) */
+void timerStart(const char *name) {
+    if (timer_overflow > 0 || timer_depth >= MAX_TIMER_DEPTH) {
+        timer_overflow++;
+        return;
+    }
+
+    /* The full name includes the names of the parents */
+    char full_name[TIMER_NAME_LENGTH];
+    if (timer_depth > 0) {
+        snprintf(full_name, TIMER_NAME_LENGTH, "%s/%s",
+                 timers[timer_stack[timer_depth - 1]].name, name);
+    } else {
+        snprintf(full_name, TIMER_NAME_LENGTH, "%s", name);
+    }
+
+    int index = findTimer(full_name);
+    if (index < 0) {
+        if (num_timers >= MAX_TIMERS) {
+            timer_overflow++;
+            return;
+        }
+        index = num_timers++;
+        memset(&timers[index], 0, sizeof(struct timer));
+        strcpy(timers[index].name, full_name);
+    }
+
+    timer_stack[timer_depth] = index;
+    timer_start[timer_depth] = MPI_Wtime();
+    timer_depth++;
+}
+
+/* Stop the innermost running timer */
+void timerStop(void) {
+    if (timer_overflow > 0) {
+        timer_overflow--;
+        return;
+    }
+    if (timer_depth == 0) return;
+
+    timer_depth--;
+    struct timer *t = &timers[timer_stack[timer_depth]];
+    t->seconds += MPI_Wtime() - timer_start[timer_depth];
+    t->calls++;
+    t->peak_rss_kb = peakMemoryKB();
+}
+
+/* Add bytes read from or written to disk to all running timers */
+void timerAddBytes(long long int bytes_read, long long int bytes_written) {
+    for (int i=0; i<timer_depth; i++) {
+        timers[timer_stack[i]].bytes_read += bytes_read;
+        timers[timer_stack[i]].bytes_written += bytes_written;
+    }
+}
+
+/* Discard all timers and load balance reports, e.g. between runs */
+void resetTimers(void) {
+    num_timers = 0;
+    timer_depth = 0;
+    timer_overflow = 0;
+    num_balances = 0;
+}
+
+/* Enable or disable the synchronization before communication */
+void setProfileMPI(char enabled) {
+    profile_mpi = enabled;
+}
+
+/* Start timing a communication step */
+void commStart(const char *name, MPI_Comm comm) {
+    timerStart(name);
+
+    /* Separate the time spent waiting for other ranks */
+    if (profile_mpi) {
+        timerStart("Wait");
+        MPI_Barrier(comm);
+        timerStop();
+    }
+}
+
+/* Stop timing a communication step and add the bytes exchanged with other
+ * ranks to all running timers */
+void commStop(long long int bytes_exchanged) {
+    if (timer_overflow == 0) {
+        for (int i=0; i<timer_depth; i++) {
+            timers[timer_stack[i]].bytes_comm += bytes_exchanged;
+        }
+    }
+    timerStop();
+}
+
+/* Compare the work assigned to the ranks and flag the outliers */
+int reportLoadBalance_MPI(MPI_Comm comm, const char *name, double work) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    double *all_work = (rank == 0) ? malloc(size * sizeof(double)) : NULL;
+    MPI_Gather(&work, 1, MPI_DOUBLE, all_work, 1, MPI_DOUBLE, 0, comm);
+
+    if (rank == 0) {
+        double min = all_work[0], max = all_work[0], sum = 0;
+        for (int r=0; r<size; r++) {
+            if (all_work[r] < min) min = all_work[r];
+            if (all_work[r] > max) max = all_work[r];
+            sum += all_work[r];
+        }
+        const double mean = sum / size;
+
+        printf("Load balance of %s: [min, mean, max] = [%g, %g, %g], max/mean = %.3f\n",
+               name, min, mean, max, (mean > 0) ? max / mean : 1.0);
+
+        /* List the ranks that deviate from the mean */
+        int flagged = 0;
+        for (int r=0; r<size; r++) {
+            const double deviation = (mean > 0) ? all_work[r] / mean - 1.0 : 0.0;
+            if (fabs(deviation) > LOAD_BALANCE_TOLERANCE) {
+                if (flagged < LOAD_BALANCE_MAX_LISTED) {
+                    printf("  Rank %03d: %g (%+.1f%% from the mean)\n", r, all_work[r], deviation * 100);
+                }
+                flagged++;
+            }
+        }
+        if (flagged > LOAD_BALANCE_MAX_LISTED) {
+            printf("  ... and %d more ranks deviate by more than %.0f%%\n",
+                   flagged - LOAD_BALANCE_MAX_LISTED, LOAD_BALANCE_TOLERANCE * 100);
+        }
+
+        /* Store the result for the final report */
+        if (num_balances < MAX_TIMERS) {
+            struct load_balance *lb = &balances[num_balances++];
+            snprintf(lb->name, TIMER_NAME_LENGTH, "%s", name);
+            lb->min = min;
+            lb->mean = mean;
+            lb->max = max;
+            lb->flagged = flagged;
+        }
+
+        free(all_work);
+    }
+
+    return 0;
+}
+
+/* Write a string to a JSON file, escaping quotes and backslashes */
+static void writeJSONString(FILE *f, const char *str) {
+    fputc('"', f);
+    for (const char *c = str; *c; c++) {
+        if (*c == '"' || *c == '\\') fputc('\\', f);
+        fputc(*c, f);
+    }
+    fputc('"', f);
+}
+
+/* Print a summary of the timers, reduced over the ranks, and optionally
+ * write it to a JSON file. The timers of the first rank are reported; ranks
+ * that did not run a timer count zero seconds for it. The imbalance of a
+ * timer is the ratio of the maximum and average time over the ranks. */
+int reportTimers_MPI(MPI_Comm comm, double total_seconds, const char *fname) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    /* Use the timer names of the first rank */
+    int num = num_timers;
+    MPI_Bcast(&num, 1, MPI_INT, 0, comm);
+    char *names = malloc(num * TIMER_NAME_LENGTH + 1);
+    if (rank == 0) {
+        for (int i=0; i<num; i++) {
+            memcpy(names + i * TIMER_NAME_LENGTH, timers[i].name, TIMER_NAME_LENGTH);
+        }
+    }
+    MPI_Bcast(names, num * TIMER_NAME_LENGTH, MPI_CHAR, 0, comm);
+
+    /* Collect the local values: seconds, calls, bytes read, written, and
+     * exchanged, and the peak memory, with the totals of the run in the
+     * last entry */
+    const int nc = 4;
+    double *seconds = calloc(num + 1, sizeof(double));
+    long long int *counts = calloc(nc * (num + 1), sizeof(long long int));
+    long long int *rss = calloc(num + 1, sizeof(long long int));
+    for (int i=0; i<num; i++) {
+        int index = findTimer(names + i * TIMER_NAME_LENGTH);
+        if (index < 0) continue;
+        seconds[i] = timers[index].seconds;
+        counts[nc * i + 0] = timers[index].calls;
+        counts[nc * i + 1] = timers[index].bytes_read;
+        counts[nc * i + 2] = timers[index].bytes_written;
+        counts[nc * i + 3] = timers[index].bytes_comm;
+        rss[i] = timers[index].peak_rss_kb;
+    }
+    seconds[num] = total_seconds;
+    rss[num] = peakMemoryKB();
+
+    /* Reduce over the ranks */
+    double *min_seconds = malloc((num + 1) * sizeof(double));
+    double *max_seconds = malloc((num + 1) * sizeof(double));
+    double *sum_seconds = malloc((num + 1) * sizeof(double));
+    long long int *min_counts = malloc(nc * (num + 1) * sizeof(long long int));
+    long long int *max_counts = malloc(nc * (num + 1) * sizeof(long long int));
+    long long int *sum_counts = malloc(nc * (num + 1) * sizeof(long long int));
+    long long int *min_rss = malloc((num + 1) * sizeof(long long int));
+    long long int *max_rss = malloc((num + 1) * sizeof(long long int));
+    long long int *sum_rss = malloc((num + 1) * sizeof(long long int));
+    MPI_Reduce(seconds, min_seconds, num + 1, MPI_DOUBLE, MPI_MIN, 0, comm);
+    MPI_Reduce(seconds, max_seconds, num + 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+    MPI_Reduce(seconds, sum_seconds, num + 1, MPI_DOUBLE, MPI_SUM, 0, comm);
+    MPI_Reduce(counts, min_counts, nc * (num + 1), MPI_LONG_LONG, MPI_MIN, 0, comm);
+    MPI_Reduce(counts, max_counts, nc * (num + 1), MPI_LONG_LONG, MPI_MAX, 0, comm);
+    MPI_Reduce(counts, sum_counts, nc * (num + 1), MPI_LONG_LONG, MPI_SUM, 0, comm);
+    MPI_Reduce(rss, min_rss, num + 1, MPI_LONG_LONG, MPI_MIN, 0, comm);
+    MPI_Reduce(rss, max_rss, num + 1, MPI_LONG_LONG, MPI_MAX, 0, comm);
+    MPI_Reduce(rss, sum_rss, num + 1, MPI_LONG_LONG, MPI_SUM, 0, comm);
+
+    int err = 0;
+    if (rank == 0) {
+        /* Print the summary */
+        printf("\n%-48s %6s %10s %10s %10s %7s %10s %10s %10s %9s\n", "Stage", "calls",
+               "min [s]", "avg [s]", "max [s]", "max/avg", "read [GB]", "wrote [GB]",
+               "comm [GB]", "RSS [MB]");
+        for (int i=0; i<num; i++) {
+            const double avg = sum_seconds[i] / size;
+            printf("%-48s %6lld %10.3f %10.3f %10.3f %7.3f %10.3f %10.3f %10.3f %9.1f\n",
+                   names + i * TIMER_NAME_LENGTH, max_counts[nc * i],
+                   min_seconds[i], avg, max_seconds[i],
+                   (avg > 0) ? max_seconds[i] / avg : 1.0,
+                   sum_counts[nc * i + 1] / 1e9, sum_counts[nc * i + 2] / 1e9,
+                   sum_counts[nc * i + 3] / 1e9, max_rss[i] / 1024.);
+        }
+        printf("Peak memory per rank: %.1f MB (min), %.1f MB (avg), %.1f MB (max)\n",
+               min_rss[num] / 1024., (double) sum_rss[num] / size / 1024., max_rss[num] / 1024.);
+
+        /* Write the JSON file */
+        FILE *f = (fname != NULL) ? fopen(fname, "w") : NULL;
+        if (fname != NULL && f == NULL) {
+            printf("Error opening timers file '%s'.\n", fname);
+            err = 1;
+        }
+        if (f != NULL) {
+            fprintf(f, "{\n  \"ranks\": %d,\n", size);
+            fprintf(f, "  \"total_seconds\": {\"min\": %g, \"avg\": %g, \"max\": %g},\n",
+                    min_seconds[num], sum_seconds[num] / size, max_seconds[num]);
+            fprintf(f, "  \"peak_rss_mb\": {\"min\": %g, \"avg\": %g, \"max\": %g},\n",
+                    min_rss[num] / 1024., (double) sum_rss[num] / size / 1024., max_rss[num] / 1024.);
+            fprintf(f, "  \"timers\": [\n");
+            for (int i=0; i<num; i++) {
+                const double avg = sum_seconds[i] / size;
+                fprintf(f, "    {\"name\": ");
+                writeJSONString(f, names + i * TIMER_NAME_LENGTH);
+                fprintf(f, ", \"calls\": %lld, \"min\": %g, \"avg\": %g, \"max\": %g, \"imbalance\": %g, "
+                           "\"bytes_read\": %lld, \"bytes_written\": %lld, "
+                           "\"bytes_comm\": {\"min\": %lld, \"avg\": %g, \"max\": %lld}, "
+                           "\"peak_rss_mb\": %g}%s\n",
+                        max_counts[nc * i], min_seconds[i], avg, max_seconds[i],
+                        (avg > 0) ? max_seconds[i] / avg : 1.0,
+                        sum_counts[nc * i + 1], sum_counts[nc * i + 2],
+                        min_counts[nc * i + 3], (double) sum_counts[nc * i + 3] / size,
+                        max_counts[nc * i + 3], max_rss[i] / 1024., (i < num - 1) ? "," : "");
+            }
+            fprintf(f, "  ],\n");
+            fprintf(f, "  \"load_balance\": [\n");
+            for (int i=0; i<num_balances; i++) {
+                fprintf(f, "    {\"name\": ");
+                writeJSONString(f, balances[i].name);
+                fprintf(f, ", \"min\": %g, \"mean\": %g, \"max\": %g, \"flagged_ranks\": %d}%s\n",
+                        balances[i].min, balances[i].mean, balances[i].max,
+                        balances[i].flagged, (i < num_balances - 1) ? "," : "");
+            }
+            fprintf(f, "  ]\n}\n");
+            fclose(f);
+        }
+    }
+
+    free(names);
+    free(seconds);
+    free(counts);
+    free(rss);
+    free(min_seconds);
+    free(max_seconds);
+    free(sum_seconds);
+    free(min_counts);
+    free(max_counts);
+    free(sum_counts);
+    free(min_rss);
+    free(max_rss);
+    free(sum_rss);
+
+    MPI_Bcast(&err, 1, MPI_INT, 0, comm);
+
+    return err;
+}
@@ -0,0 +1,284 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "../include/mitos.h"
+
+#ifndef MITOS_VERSION
+#define MITOS_VERSION "unknown"
+#endif
+
+/* Number of repetitions of each benchmark. The best and the median time
+ * are reported. */
+#define BENCH_REPEATS 5
+
+/* Problem sizes, fixed such that the results can be compared over time */
+#define BENCH_GRID_SIZE 128
+#define BENCH_PARTICLES 4000000
+#define BENCH_SAMPLES 10000000
+
+/* Prevents the benchmarked work from being optimized away */
+static volatile double sink;
+
+/* Elapsed time in seconds since a given starting time */
+static inline double elapsed(const struct timeval *start) {
+    struct timeval stop;
+    gettimeofday(&stop, NULL);
+    return (stop.tv_sec - start->tv_sec) + (stop.tv_usec - start->tv_usec) / 1e6;
+}
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/* Print a row of the results table and optionally append it to a file */
+static void report(FILE *f, const char *name, long long int size,
+                   double *times, double units_per_run, const char *unit) {
+    qsort(times, BENCH_REPEATS, sizeof(double), compareDoubles);
+    const double best = times[0];
+    const double median = times[BENCH_REPEATS / 2];
+    const double rate = units_per_run / best;
+
+    printf("%-16s %12lld %12.4e %12.4e %12.4e %s\n", name, size, best, median, rate, unit);
+
+    if (f != NULL) {
+        char date[32];
+        time_t now = time(NULL);
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+        fprintf(f, "%s\t%s\t%s\t%lld\t%e\t%e\t%e\t%s\n", date, MITOS_VERSION,
+                name, size, best, median, rate, unit);
+    }
+}
+
+/* Displace particles stored with a given precision by a field, in blocks of
+ * INTERP_BATCH, as in the particle stage of mitos */
+#define DEFINE_DISPLACE(type)                                                  \
+static void displace_##type(type *pos, long long int num, const double *box,   \
+                            int N, double boxlen) {                            \
+    for (int dir=0; dir<3; dir++) {                                            \
+        for (long long int b=0; b<num; b+=INTERP_BATCH) {                      \
+            int n = (num - b < INTERP_BATCH) ? num - b : INTERP_BATCH;         \
+            double x[INTERP_BATCH], y[INTERP_BATCH], z[INTERP_BATCH];          \
+            for (int l=0; l<n; l++) {                                          \
+                x[l] = pos[3 * (b + l) + 0];                                   \
+                y[l] = pos[3 * (b + l) + 1];                                   \
+                z[l] = pos[3 * (b + l) + 2];                                   \
+            }                                                                  \
+            double disp[INTERP_BATCH];                                         \
+            gridTSC_batch(box, N, boxlen, n, x, y, z, disp);                   \
+            for (int l=0; l<n; l++) {                                          \
+                pos[3 * (b + l) + dir] -= disp[l];                             \
+            }                                                                  \
+        }                                                                      \
+    }                                                                          \
+}
+
+DEFINE_DISPLACE(float)
+DEFINE_DISPLACE(double)
+
+static inline void gaussian_kernel(struct kernel *the_kernel) {
+    double k = the_kernel->k;
+    the_kernel->kern = exp(-k * k / 0.02);
+}
+
+int main(int argc, char *argv[]) {
+    /* Optionally append the results to a tab-separated file */
+    FILE *f = NULL;
+    if (argc > 1) {
+        f = fopen(argv[1], "a");
+        if (f == NULL) {
+            printf("Error opening '%s'.\n", argv[1]);
+            return 1;
+        }
+    }
+
+    const int N = BENCH_GRID_SIZE;
+    const double boxlen = 100.0;
+    const long long int cells = (long long int) N * N * N;
+    rng_state seed = rand_uint64_init(101);
+    struct timeval start;
+    double times[BENCH_REPEATS];
+
+    printf("Mitos benchmarks (version %s)\n\n", MITOS_VERSION);
+    printf("%-16s %12s %12s %12s %12s %s\n", "benchmark", "size", "best [s]",
+           "median [s]", "rate", "unit");
+
+    /* A Gaussian random field and its Fourier transform */
+    double *box = fftw_malloc(cells * sizeof(double));
+    fftw_complex *fbox = fftw_malloc((long long int) N * N * (N / 2 + 1) * sizeof(fftw_complex));
+    fftw_plan r2c = fftw_plan_dft_r2c_3d(N, N, N, box, fbox, FFTW_ESTIMATE);
+    fftw_plan c2r = fftw_plan_dft_c2r_3d(N, N, N, fbox, box, FFTW_ESTIMATE);
+    for (long long int i=0; i<cells; i++) {
+        box[i] = sampleNorm(&seed);
+    }
+
+    /* Forward and backward Fourier transforms. The transforms are done in
+     * pairs, such that the field stays the same between repetitions. */
+    double times_c2r[BENCH_REPEATS];
+    for (int r=0; r<BENCH_REPEATS; r++) {
+        gettimeofday(&start, NULL);
+        fft_execute(r2c);
+        fft_normalize_r2c(fbox, N, boxlen);
+        times[r] = elapsed(&start);
+
+        gettimeofday(&start, NULL);
+        fft_execute(c2r);
+        fft_normalize_c2r(box, N, boxlen);
+        times_c2r[r] = elapsed(&start);
+    }
+    report(f, "fft_r2c", N, times, cells, "cells/s");
+    report(f, "fft_c2r", N, times_c2r, cells, "cells/s");
+
+    /* Kernel application in momentum space */
+    fft_execute(r2c);
+    fft_normalize_r2c(fbox, N, boxlen);
+    for (int r=0; r<BENCH_REPEATS; r++) {
+        gettimeofday(&start, NULL);
+        fft_apply_kernel(fbox, fbox, N, boxlen, gaussian_kernel, NULL);
+        times[r] = elapsed(&start);
+    }
+    sink = creal(fbox[1]);
+    report(f, "apply_kernel", N, times, cells, "cells/s");
+
+    /* TSC interpolation at random positions, on the full grid and on a
+     * slab with ghost rows, as used by the particle stage */
+    const int n = BENCH_PARTICLES;
+    double *x = malloc(n * sizeof(double));
+    double *y = malloc(n * sizeof(double));
+    double *z = malloc(n * sizeof(double));
+    double *out = malloc(n * sizeof(double));
+    for (int i=0; i<n; i++) {
+        x[i] = sampleUniform(&seed) * boxlen;
+        y[i] = sampleUniform(&seed) * boxlen;
+        z[i] = sampleUniform(&seed) * boxlen;
+    }
+
+    for (int r=0; r<BENCH_REPEATS; r++) {
+        gettimeofday(&start, NULL);
+        gridTSC_batch(box, N, boxlen, n, x, y, z, out);
+        times[r] = elapsed(&start);
+    }
+    sink = out[n / 2];
+    report(f, "tsc_batch", n, times, n, "particles/s");
+
+    /* Displacing particles with single and double precision positions */
+    float *pos_f = malloc(3 * (long long int) n * sizeof(float));
+    double *pos_d = malloc(3 * (long long int) n * sizeof(double));
+    double times_d[BENCH_REPEATS];
+    for (int r=0; r<BENCH_REPEATS; r++) {
+        for (int i=0; i<n; i++) {
+            pos_d[3 * i + 0] = pos_f[3 * i + 0] = x[i];
+            pos_d[3 * i + 1] = pos_f[3 * i + 1] = y[i];
+            pos_d[3 * i + 2] = pos_f[3 * i + 2] = z[i];
+        }
+
+        gettimeofday(&start, NULL);
+        displace_float(pos_f, n, box, N, boxlen);
+        times[r] = elapsed(&start);
+
+        gettimeofday(&start, NULL);
+        displace_double(pos_d, n, box, N, boxlen);
+        times_d[r] = elapsed(&start);
+    }
+    sink = pos_f[n / 2] + pos_d[n / 2];
+    report(f, "displace_float", n, times, n, "particles/s");
+    report(f, "displace_double", n, times_d, n, "particles/s");
+    free(pos_f);
+    free(pos_d);
+
+    /* Memory per particle (positions, velocities, ids) */
+    printf("(positions: float %zu vs double %zu bytes/particle)\n",
+           3 * sizeof(float) + 3 * sizeof(float) + sizeof(long long int),
+           3 * sizeof(double) + 3 * sizeof(float) + sizeof(long long int));
+
+    const int X0 = N / 2, NX = N / 8, ghost_NX = 4;
+    struct ghost_slab gs;
+    alloc_ghost_slab(&gs, N, X0, NX, ghost_NX);
+    for (int i=-ghost_NX; i<NX+ghost_NX; i++) {
+        for (int j=0; j<N; j++) {
+            for (int k=0; k<N; k++) {
+                gs.base[i * gs.stride_x + j * gs.stride_y + k] = box[row_major(X0 + i, j, k, N)];
+            }
+        }
+    }
+    fill_ghost_slab_padding(&gs);
+    for (int i=0; i<n; i++) {
+        x[i] = (X0 + NX * sampleUniform(&seed)) * boxlen / N;
+    }
+
+    for (int r=0; r<BENCH_REPEATS; r++) {
+        gettimeofday(&start, NULL);
+        gridTSC_dg_batch(&gs, boxlen, n, x, y, z, out);
+        times[r] = elapsed(&start);
+    }
+    sink = out[n / 2];
+    report(f, "tsc_dg_batch", n, times, n, "particles/s");
+    free_ghost_slab(&gs);
+
+    /* Gaussian and thermal (Fermi-Dirac) sampling */
+    const int m = BENCH_SAMPLES;
+    for (int r=0; r<BENCH_REPEATS; r++) {
+        double sum = 0;
+        gettimeofday(&start, NULL);
+        for (int i=0; i<m; i++) {
+            sum += sampleNorm(&seed);
+        }
+        times[r] = elapsed(&start);
+        sink = sum;
+    }
+    report(f, "sample_norm", m, times, m, "samples/s");
+
+    const double T = 1.68e-4;
+    double params[2] = {T, 0.};
+    struct table_sampler ts;
+    initTableSampler(&ts, fd_pdf, THERMAL_MIN_MOMENTUM * T, THERMAL_MAX_MOMENTUM * T, params);
+    for (int r=0; r<BENCH_REPEATS; r++) {
+        double sum = 0;
+        gettimeofday(&start, NULL);
+        for (int i=0; i<m; i++) {
+            sum += sampleTable(&ts, &seed);
+        }
+        times[r] = elapsed(&start);
+        sink = sum;
+    }
+    report(f, "sample_thermal", m, times, m, "samples/s");
+    cleanTableSampler(&ts);
+
+    /* Writing and reading a field file */
+    const char field_fname[] = "bench_field.hdf5";
+    const double field_MB = cells * sizeof(double) / 1e6;
+    double times_read[BENCH_REPEATS];
+    for (int r=0; r<BENCH_REPEATS; r++) {
+        gettimeofday(&start, NULL);
+        writeFieldFile(box, N, boxlen, field_fname);
+        times[r] = elapsed(&start);
+
+        gettimeofday(&start, NULL);
+        readFieldFileInPlace(box, field_fname);
+        times_read[r] = elapsed(&start);
+    }
+    report(f, "hdf5_write", N, times, field_MB, "MB/s");
+    report(f, "hdf5_read", N, times_read, field_MB, "MB/s");
+    remove(field_fname);
+
+    /* Clean up */
+    fftw_destroy_plan(r2c);
+    fftw_destroy_plan(c2r);
+    fftw_free(box);
+    fftw_free(fbox);
+    free(x);
+    free(y);
+    free(z);
+    free(out);
+
+    if (f != NULL) {
+        fclose(f);
+        printf("\nResults appended to '%s'.\n", argv[1]);
+    }
+
+    return 0;
+}
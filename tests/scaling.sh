@@ -0,0 +1,127 @@
+#!/bin/sh
+# Strong and weak scaling runs of mitos on a single machine.
+#
+# Usage: ./scaling.sh [params.ini] [rank counts] [results file]
+#
+# For each number of MPI ranks, mitos is run once with the given parameter
+# file (strong scaling) and once with the grid and particle numbers scaled
+# such that the work per rank stays fixed (weak scaling). The total time
+# and peak memory are read from the timings file of each run, printed as a
+# table, and appended to the results file.
+#
+# Environment: MPIRUN (default "mpirun"), OMP_NUM_THREADS (default 1).
+
+PARAMS=${1:-../default.ini}
+RANKS=${2:-"1 2 4 8"}
+RESULTS=${3:-scaling_results.tsv}
+MPIRUN=${MPIRUN:-mpirun}
+export OMP_NUM_THREADS=${OMP_NUM_THREADS:-1}
+
+MITOS=../mitos
+WORKDIR=scaling_runs
+VERSION=$(git describe --always --dirty 2>/dev/null || echo unknown)
+DATE=$(date +%Y-%m-%dT%H:%M:%S)
+
+if [ ! -x "$MITOS" ]; then
+    echo "Error: $MITOS not found; run make first."
+    exit 1
+fi
+if [ ! -f "$PARAMS" ]; then
+    echo "Error: parameter file '$PARAMS' not found."
+    exit 1
+fi
+
+mkdir -p $WORKDIR
+
+# Copy a parameter file, multiplying the grid sizes and the particle numbers
+# by a factor (rounded to even numbers), and writing to the given directory
+scale_params() {
+    awk -v fac="$2" -v dir="$3" '
+        function even(x) { x = int(x + 0.5); return x + (x % 2); }
+        /^[ \t]*(GridSize|SmallGridSize|CubeRootNumber)[ \t]*=/ {
+            split($0, kv, "=");
+            split(kv[2], val, "#");
+            sub(/[ \t]+$/, "", kv[1]);
+            print kv[1] " = " even(val[1] * fac);
+            next;
+        }
+        /^[ \t]*BoxLen[ \t]*=/ {
+            split($0, kv, "=");
+            split(kv[2], val, "#");
+            sub(/[ \t]+$/, "", kv[1]);
+            print kv[1] " = " (val[1] * fac);
+            next;
+        }
+        /^[ \t]*(Directory|TimingsFilename)[ \t]*=/ { next; }
+        /^\[Output\]/ {
+            output = 1;
+            print;
+            print "Directory = " dir;
+            print "TimingsFilename = timings.json";
+            next;
+        }
+        { print; }
+        END {
+            if (!output) {
+                print "[Output]";
+                print "Directory = " dir;
+                print "TimingsFilename = timings.json";
+            }
+        }
+    ' "$1"
+}
+
+# Extract a field ("min", "avg", or "max") of an entry of the timings file
+timing() {
+    grep "\"$2\"" "$1" | head -n 1 | sed -e "s/.*\"$3\": \([-0-9.eE+]*\).*/\1/"
+}
+
+[ -f "$RESULTS" ] || printf "date\tversion\tmode\tranks\tgrid\tseconds\tspeedup\tefficiency\tpeak_rss_mb\n" > "$RESULTS"
+
+printf "%-8s %6s %6s %12s %9s %11s %12s\n" "mode" "ranks" "grid" "seconds" "speedup" "efficiency" "RSS [MB]"
+
+for MODE in strong weak; do
+    BASE_SECONDS=""
+    BASE_RANKS=""
+    for P in $RANKS; do
+        DIR=$WORKDIR/${MODE}_$P
+        mkdir -p $DIR
+
+        # Weak scaling keeps the number of cells and particles per rank fixed
+        if [ "$MODE" = "weak" ]; then
+            FAC=$(awk -v p="$P" 'BEGIN { print p ^ (1.0 / 3.0) }')
+        else
+            FAC=1
+        fi
+        scale_params "$PARAMS" "$FAC" "$DIR" > $DIR/params.ini
+        GRID=$(grep "^[ \t]*GridSize" $DIR/params.ini | head -n 1 | sed -e 's/.*= *//')
+
+        $MPIRUN -np $P $MITOS $DIR/params.ini > $DIR/log.txt 2>&1
+        if [ $? -ne 0 ] || [ ! -f $DIR/timings.json ]; then
+            echo "Error: run with $P ranks failed; see $DIR/log.txt."
+            continue
+        fi
+
+        SECONDS_MAX=$(timing $DIR/timings.json total_seconds max)
+        RSS_MAX=$(timing $DIR/timings.json peak_rss_mb max)
+        if [ -z "$BASE_SECONDS" ]; then
+            BASE_SECONDS=$SECONDS_MAX
+            BASE_RANKS=$P
+        fi
+
+        # Speedup relative to the first run; for weak scaling, the ideal
+        # speedup is 1 and the efficiency is the ratio of the times
+        if [ "$MODE" = "strong" ]; then
+            SPEEDUP=$(awk -v t0="$BASE_SECONDS" -v t="$SECONDS_MAX" 'BEGIN { printf "%.3f", t0 / t }')
+            EFFICIENCY=$(awk -v s="$SPEEDUP" -v p0="$BASE_RANKS" -v p="$P" 'BEGIN { printf "%.3f", s * p0 / p }')
+        else
+            SPEEDUP=$(awk -v t0="$BASE_SECONDS" -v t="$SECONDS_MAX" 'BEGIN { printf "%.3f", t0 / t }')
+            EFFICIENCY=$SPEEDUP
+        fi
+
+        printf "%-8s %6d %6d %12.3f %9.3f %11.3f %12.1f\n" $MODE $P $GRID $SECONDS_MAX $SPEEDUP $EFFICIENCY $RSS_MAX
+        printf "%s\t%s\t%s\t%d\t%d\t%s\t%s\t%s\t%s\n" $DATE $VERSION $MODE $P $GRID $SECONDS_MAX $SPEEDUP $EFFICIENCY $RSS_MAX >> "$RESULTS"
+    done
+done
+
+echo "Results appended to '$RESULTS'."
@@ -0,0 +1,148 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "../include/mitos.h"
+
+static inline void sucmsg(const char *msg) {
+    printf("%s%s%s\n\n", TXT_GREEN, msg, TXT_RESET);
+}
+
+/* Elapsed time in seconds since a given starting time */
+static inline double elapsed(const struct timeval *start) {
+    struct timeval stop;
+    gettimeofday(&stop, NULL);
+    return (stop.tv_sec - start->tv_sec) + (stop.tv_usec - start->tv_usec) / 1e6;
+}
+
+typedef double (*scalar_method)(const double *box, int N, double boxlen,
+                                double x, double y, double z);
+typedef void (*batch_method)(const double *box, int N, double boxlen, int n,
+                             const double *x, const double *y,
+                             const double *z, double *out);
+
+/* Compare the scalar and batched methods and report the throughput */
+static void bench_method(const char *name, scalar_method scalar,
+                         batch_method batch, const double *box, int N,
+                         double boxlen, int n, const double *x,
+                         const double *y, const double *z, double *out) {
+    struct timeval start;
+
+    /* Scalar method */
+    double scalar_sum = 0;
+    gettimeofday(&start, NULL);
+    for (int i=0; i<n; i++) {
+        scalar_sum += scalar(box, N, boxlen, x[i], y[i], z[i]);
+    }
+    double scalar_time = elapsed(&start);
+
+    /* Batched method */
+    gettimeofday(&start, NULL);
+    batch(box, N, boxlen, n, x, y, z, out);
+    double batch_time = elapsed(&start);
+
+    /* Check that the results agree */
+    double batch_sum = 0;
+    double max_err = 0;
+    for (int i=0; i<n; i++) {
+        double err = fabs(out[i] - scalar(box, N, boxlen, x[i], y[i], z[i]));
+        if (err > max_err) max_err = err;
+        batch_sum += out[i];
+    }
+
+    printf("%s scalar:\t %.3e particles/s (sum %e)\n", name, n / scalar_time, scalar_sum);
+    printf("%s batch:\t %.3e particles/s (max error %e)\n", name, n / batch_time, max_err);
+
+    assert(max_err < 1e-12);
+    assert(fabs(batch_sum - scalar_sum) < 1e-6 * n);
+}
+
+/* Compare the ghost slab version with the contiguous version, for particles
+ * in the local slice, allowing for small displacements */
+static void check_ghost_slab(const double *box, int N, double boxlen, int X0,
+                             int NX, int ghost_NX, int n, double *x,
+                             const double *y, const double *z, double *out,
+                             rng_state *seed) {
+    struct ghost_slab gs;
+    int err = alloc_ghost_slab(&gs, N, X0, NX, ghost_NX);
+    assert(err == 0);
+
+    for (int i=-ghost_NX; i<NX+ghost_NX; i++) {
+        for (int j=0; j<N; j++) {
+            for (int k=0; k<N; k++) {
+                gs.base[i * gs.stride_x + j * gs.stride_y + k] = box[row_major(X0 + i, j, k, N)];
+            }
+        }
+    }
+    fill_ghost_slab_padding(&gs);
+
+    for (int i=0; i<n; i++) {
+        x[i] = (X0 - 1.0 + (NX + 2.0) * sampleUniform(seed)) * boxlen / N;
+    }
+
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    gridTSC_dg_batch(&gs, boxlen, n, x, y, z, out);
+    double batch_time = elapsed(&start);
+
+    double max_err = 0;
+    for (int i=0; i<n; i++) {
+        double e = fabs(out[i] - gridTSC(box, N, boxlen, x[i], y[i], z[i]));
+        double e_scalar = fabs(gridCIC_dg(&gs, x[i], y[i], z[i], boxlen) - gridCIC(box, N, boxlen, x[i], y[i], z[i]));
+        if (e > max_err) max_err = e;
+        if (e_scalar > max_err) max_err = e_scalar;
+    }
+
+    printf("TSC_dg batch:\t %.3e particles/s (X0 = %d, NX = %d, max error %e)\n",
+           n / batch_time, X0, NX, max_err);
+    assert(max_err < 1e-12);
+
+    free_ghost_slab(&gs);
+}
+
+int main() {
+    /* A random grid */
+    const int N = 128;
+    const double boxlen = 100.0;
+    rng_state seed = rand_uint64_init(101);
+
+    double *box = malloc((long int) N * N * N * sizeof(double));
+    for (long int i=0; i<(long int) N * N * N; i++) {
+        box[i] = sampleNorm(&seed);
+    }
+
+    /* Random particle positions, including some outside the box. The number
+     * of particles is not a multiple of INTERP_BATCH to test the tails. */
+    const int n = 1000003;
+    double *x = malloc(n * sizeof(double));
+    double *y = malloc(n * sizeof(double));
+    double *z = malloc(n * sizeof(double));
+    double *out = malloc(n * sizeof(double));
+    for (int i=0; i<n; i++) {
+        x[i] = (1.2 * sampleUniform(&seed) - 0.1) * boxlen;
+        y[i] = (1.2 * sampleUniform(&seed) - 0.1) * boxlen;
+        z[i] = (1.2 * sampleUniform(&seed) - 0.1) * boxlen;
+    }
+
+    bench_method("CIC", gridCIC, gridCIC_batch, box, N, boxlen, n, x, y, z, out);
+    bench_method("TSC", gridTSC, gridTSC_batch, box, N, boxlen, n, x, y, z, out);
+    bench_method("PCS", gridPCS, gridPCS_batch, box, N, boxlen, n, x, y, z, out);
+
+    /* Now compare the ghost slab version with the contiguous version, for a
+     * slice of the box, a slice that covers most of the box together with its
+     * ghost rows, and the whole box on a single rank */
+    check_ghost_slab(box, N, boxlen, 96, 16, 4, n, x, y, z, out, &seed);
+    check_ghost_slab(box, N, boxlen, 20, 120, 6, n, x, y, z, out, &seed);
+    check_ghost_slab(box, N, boxlen, 0, N, 6, n, x, y, z, out, &seed);
+
+    /* Clean up */
+    free(box);
+    free(x);
+    free(y);
+    free(z);
+    free(out);
+
+    sucmsg("test_interp_batch:\t SUCCESS");
+}
@@ -0,0 +1,128 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <math.h>
+
+#include "../include/mitos.h"
+
+static inline void sucmsg(const char *msg) {
+    printf("%s%s%s\n\n", TXT_GREEN, msg, TXT_RESET);
+}
+
+/* The one-dimensional TSC weight at a distance d (in cells) */
+static double weightTSC(double d) {
+    d = fabs(d);
+    return d < 0.5 ? 0.75 - d * d : (d < 1.5 ? 0.5 * (1.5 - d) * (1.5 - d) : 0.);
+}
+
+/* The particles of a given rank, including some outside the box */
+static long long int genParticles(int rank, double boxlen, double **pos,
+                                  double **mass) {
+    const long long int num = 1000 + 37 * rank;
+    *pos = malloc(3 * num * sizeof(double));
+    *mass = malloc(num * sizeof(double));
+
+    rng_state seed = rand_uint64_init(100 + rank);
+    for (long long int i=0; i<num; i++) {
+        for (int j=0; j<3; j++) {
+            (*pos)[3 * i + j] = (1.4 * sampleUniform(&seed) - 0.2) * boxlen;
+        }
+        (*mass)[i] = 1.0 + sampleUniform(&seed);
+    }
+
+    return num;
+}
+
+/* Deposit the particles of all ranks on the distributed grid and compare
+ * with a serial deposition of the same particles on the full grid */
+static void check_deposit(int N, double boxlen) {
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    struct distributed_grid dg;
+    alloc_local_grid(&dg, N, boxlen, MPI_COMM_WORLD);
+    for (long int i=0; i<2 * dg.local_size; i++) {
+        dg.box[i] = 0.;
+    }
+
+    /* Deposit the local particles twice, to check that masses are added */
+    double *pos, *mass;
+    long long int num = genParticles(rank, boxlen, &pos, &mass);
+    for (int rep=0; rep<2; rep++) {
+        int err = massDepositTSC_dg(&dg, pos, mass, num);
+        assert(err == 0);
+    }
+    free(pos);
+    free(mass);
+
+    /* Serial deposition of the particles of all ranks */
+    const double cell_factor = N / boxlen;
+    const double cell_volume = pow(boxlen / N, 3);
+    double *ref = calloc((long int) N * N * N, sizeof(double));
+    double total_mass = 0.;
+    for (int r=0; r<size; r++) {
+        num = genParticles(r, boxlen, &pos, &mass);
+        for (long long int i=0; i<num; i++) {
+            double X = fwrap(pos[3 * i + 0], boxlen) * cell_factor;
+            double Y = fwrap(pos[3 * i + 1], boxlen) * cell_factor;
+            double Z = fwrap(pos[3 * i + 2], boxlen) * cell_factor;
+            int iX = floor(X), iY = floor(Y), iZ = floor(Z);
+            for (int x=-2; x<=2; x++) {
+                for (int y=-2; y<=2; y++) {
+                    for (int z=-2; z<=2; z++) {
+                        double w = weightTSC(X - iX - x) * weightTSC(Y - iY - y) * weightTSC(Z - iZ - z);
+                        ref[row_major(iX + x, iY + y, iZ + z, N)] += 2 * mass[i] / cell_volume * w;
+                    }
+                }
+            }
+            total_mass += 2 * mass[i];
+        }
+        free(pos);
+        free(mass);
+    }
+
+    /* Compare the local rows */
+    double max_err = 0.;
+    double local_mass = 0.;
+    for (int x=0; x<dg.NX; x++) {
+        for (int y=0; y<N; y++) {
+            for (int z=0; z<N; z++) {
+                double value = dg.box[((long int) x * N + y) * (N + 2) + z];
+                double err = fabs(value - ref[row_major(dg.X0 + x, y, z, N)]);
+                if (err > max_err) max_err = err;
+                local_mass += value * cell_volume;
+            }
+        }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &max_err, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &local_mass, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+    message(rank, "N = %d on %d ranks: max error %e, mass %f (expected %f)\n", N, size, max_err, local_mass, total_mass);
+
+    assert(max_err < 1e-9);
+    assert(fabs(local_mass - total_mass) < 1e-9 * total_mass);
+
+    free(ref);
+    free_local_grid(&dg);
+}
+
+int main() {
+    MPI_Init(NULL, NULL);
+    fftw_mpi_init();
+
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    /* Slices that are wider and narrower than the ghost rows, and (with
+     * three or more ranks) empty slices */
+    check_deposit(16, 10.0);
+    check_deposit(6, 10.0);
+    check_deposit(4, 3.0);
+
+    if (rank == 0) {
+        sucmsg("test_mass_deposit:\t SUCCESS");
+    }
+
+    MPI_Finalize();
+}
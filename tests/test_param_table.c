@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include "../include/mitos.h"
+
+static inline void sucmsg(const char *msg) {
+    printf("%s%s%s\n\n", TXT_GREEN, msg, TXT_RESET);
+}
+
+int main() {
+    /* A parameter file with the cases handled by minIni */
+    const char fname[] = "test_param_table.ini";
+    FILE *f = fopen(fname, "w");
+    assert(f != NULL);
+    fprintf(f, "Global = above the first section\n");
+    fprintf(f, "[Box]\n");
+    fprintf(f, "GridSize = 128   # a comment\n");
+    fprintf(f, "  BoxLen=256.5;another comment\r\n");
+    fprintf(f, "Hex = 0x1F\n");
+    fprintf(f, "Colon : 7\n");
+    fprintf(f, "GridSize = 64\n");
+    fprintf(f, "; Commented = 1\n");
+    fprintf(f, "[output]\n");
+    fprintf(f, "Directory = \"./a path; with # chars\"\n");
+    fprintf(f, "Quote = \"say \\\"hi\\\"\"\n");
+    fprintf(f, "Flag = yes\n");
+    fprintf(f, "Empty =\n");
+    fprintf(f, "[Box]\n");
+    fprintf(f, "Splits = 4\n");
+    fclose(f);
+
+    /* Parse the file into a table */
+    struct param_table pt;
+    int err = readParamTable(&pt, fname);
+    assert(err == 0);
+
+    /* Direct lookups */
+    assert(strcmp(paramTableLookup(&pt, "Box", "GridSize"), "128") == 0);
+    assert(strcmp(paramTableLookup(&pt, "box", "boxlen"), "256.5") == 0);
+    assert(strcmp(paramTableLookup(&pt, "Output", "Directory"), "./a path; with # chars") == 0);
+    assert(strcmp(paramTableLookup(&pt, NULL, "Global"), "above the first section") == 0);
+    assert(paramTableLookup(&pt, "Box", "Splits") == NULL);
+    assert(paramTableLookup(&pt, "Box", "Commented") == NULL);
+
+    /* The readers should give the same results with and without the table */
+    const char *sections[] = {"", "Box", "BOX", "Output", "Missing"};
+    const char *keys[] = {"Global", "GridSize", "BoxLen", "Hex", "Colon", "Splits",
+                          "Commented", "Directory", "Quote", "Flag", "Empty", "Missing"};
+    for (int i = 0; i < 5; i++) {
+        for (int j = 0; j < 12; j++) {
+            char with[DEFAULT_STRING_LENGTH], without[DEFAULT_STRING_LENGTH];
+            char short_with[4], short_without[4];
+
+            setParamTable(&pt);
+            int len = paramGets(sections[i], keys[j], "default", with, DEFAULT_STRING_LENGTH, fname);
+            paramGets(sections[i], keys[j], "default", short_with, 4, fname);
+            long int l = paramGetl(sections[i], keys[j], -1, fname);
+            double d = paramGetd(sections[i], keys[j], -1., fname);
+            int b = paramGetbool(sections[i], keys[j], -1, fname);
+
+            setParamTable(NULL);
+            assert(len == ini_gets(sections[i], keys[j], "default", without, DEFAULT_STRING_LENGTH, fname));
+            ini_gets(sections[i], keys[j], "default", short_without, 4, fname);
+            assert(strcmp(with, without) == 0);
+            assert(strcmp(short_with, short_without) == 0);
+            assert(l == ini_getl(sections[i], keys[j], -1, fname));
+            assert(d == ini_getd(sections[i], keys[j], -1., fname));
+            assert(b == ini_getbool(sections[i], keys[j], -1, fname));
+        }
+    }
+
+    /* Compare the parameters read with and without the table */
+    const char params_fname[] = "test_cosmology.ini";
+    struct params pars, pars_table;
+    readParams(&pars, params_fname);
+
+    struct param_table params_pt;
+    err = readParamTable(&params_pt, params_fname);
+    assert(err == 0);
+    setParamTable(&params_pt);
+    readParams(&pars_table, params_fname);
+
+    assert(pars.GridSize == pars_table.GridSize);
+    assert(pars.BoxLen == pars_table.BoxLen);
+    assert(pars.Homogeneous == pars_table.Homogeneous);
+    assert(strcmp(pars.Name, pars_table.Name) == 0);
+    assert(strcmp(pars.OutputDirectory, pars_table.OutputDirectory) == 0);
+
+    /* Clean up */
+    cleanParamTable(&params_pt);
+    cleanParamTable(&pt);
+    cleanParams(&pars);
+    cleanParams(&pars_table);
+    remove(fname);
+
+    sucmsg("test_param_table:\t SUCCESS");
+}
@@ -0,0 +1,139 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <hdf5.h>
+
+#include "../include/mitos.h"
+
+static inline void sucmsg(const char *msg) {
+    printf("%s%s%s\n\n", TXT_GREEN, msg, TXT_RESET);
+}
+
+int main() {
+    MPI_Init(NULL, NULL);
+
+    /* Compressed datasets, which HDF5 can only write collectively */
+    struct params pars;
+    memset(&pars, 0, sizeof(pars));
+    pars.CollectiveIO = 1;
+    pars.CompressionLevel = 4;
+    pars.Shuffle = 1;
+    setOutputFilters_MPI(&pars);
+
+    /* Some particles, written in two sub-chunks */
+    const long long int num = 100000;
+    const long long int first_num = 60000;
+    struct particle_data parts;
+    allocParticles(&parts, num);
+    for (long long int i=0; i<num; i++) {
+        for (int j=0; j<3; j++) {
+            parts.pos[3 * i + j] = 0.001 * i + j;
+            parts.vel[3 * i + j] = 0.5 * i - j;
+        }
+        parts.id[i] = 2 * i + 1;
+    }
+
+    /* Create the datasets as in the particle stage of mitos */
+    const char fname[] = "test_particle_output.hdf5";
+    hid_t h_file = createFile_MPI(MPI_COMM_WORLD, fname);
+    hid_t h_grp = H5Gcreate(h_file, "PartType1", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    assert(h_file >= 0 && h_grp >= 0);
+    int err = createParticleDatasets(h_grp, num, 1);
+    assert(err == 0);
+
+    /* Write the particles with the real (collective) write path */
+    hid_t h_xfer = createTransferList_MPI(&pars);
+    struct particle_data sub[2] = {
+        {first_num, parts.pos, parts.vel, parts.id},
+        {num - first_num, parts.pos + 3 * first_num, parts.vel + 3 * first_num,
+         parts.id + first_num}};
+    for (int s=0; s<2; s++) {
+        struct particle_write pw = {0};
+        pw.h_grp = h_grp;
+        pw.h_xfer = h_xfer;
+        pw.comm = MPI_COMM_WORLD;
+        pw.parts = &sub[s];
+        pw.first_row = (s == 0) ? 0 : first_num;
+        pw.mass = 2.5;
+        err = startParticleWrite_MPI(&pw, 0);
+        assert(err == 0);
+        err = finishParticleWrite_MPI(&pw);
+        assert(err == 0);
+    }
+
+    /* A write that needs a type conversion must be refused */
+    double seconds = 0;
+    long long int bytes = 0;
+    double *wrong = calloc(3 * num, sizeof(double));
+    hid_t h_data = H5Dopen(h_grp, "Velocities", H5P_DEFAULT);
+    err = writeRows_MPI(MPI_COMM_WORLD, h_data, H5T_NATIVE_DOUBLE, h_xfer, 0, num, wrong, &seconds, &bytes);
+    assert(err > 0);
+    H5Dclose(h_data);
+    free(wrong);
+
+    H5Pclose(h_xfer);
+    H5Gclose(h_grp);
+    H5Fclose(h_file);
+
+    /* Read everything back */
+    h_file = H5Fopen(fname, H5F_ACC_RDONLY, H5P_DEFAULT);
+    h_grp = H5Gopen(h_file, "PartType1", H5P_DEFAULT);
+    assert(h_file >= 0 && h_grp >= 0);
+
+    /* The datasets are compressed and have the types of the particle arrays */
+    const hid_t types[NUM_PARTICLE_DATASETS] = {
+        H5T_NATIVE_POS, H5T_NATIVE_FLOAT, H5T_NATIVE_LLONG, H5T_NATIVE_DOUBLE};
+    for (int i=0; i<NUM_PARTICLE_DATASETS; i++) {
+        h_data = H5Dopen(h_grp, particle_dataset_names[i], H5P_DEFAULT);
+        hid_t h_type = H5Dget_type(h_data);
+        hid_t h_prop = H5Dget_create_plist(h_data);
+        assert(H5Tequal(h_type, types[i]) > 0);
+        assert(H5Pget_nfilters(h_prop) == 2);
+        H5Pclose(h_prop);
+        H5Tclose(h_type);
+        H5Dclose(h_data);
+    }
+
+    pos_t *pos = malloc(3 * num * sizeof(pos_t));
+    float *vel = malloc(3 * num * sizeof(float));
+    long long int *id = malloc(num * sizeof(long long int));
+    double *mass = malloc(num * sizeof(double));
+
+    h_data = H5Dopen(h_grp, "Coordinates", H5P_DEFAULT);
+    H5Dread(h_data, H5T_NATIVE_POS, H5S_ALL, H5S_ALL, H5P_DEFAULT, pos);
+    H5Dclose(h_data);
+    h_data = H5Dopen(h_grp, "Velocities", H5P_DEFAULT);
+    H5Dread(h_data, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, vel);
+    H5Dclose(h_data);
+    h_data = H5Dopen(h_grp, "ParticleIDs", H5P_DEFAULT);
+    H5Dread(h_data, H5T_NATIVE_LLONG, H5S_ALL, H5S_ALL, H5P_DEFAULT, id);
+    H5Dclose(h_data);
+    h_data = H5Dopen(h_grp, "Masses", H5P_DEFAULT);
+    H5Dread(h_data, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, mass);
+    H5Dclose(h_data);
+
+    H5Gclose(h_grp);
+    H5Fclose(h_file);
+
+    for (long long int i=0; i<num; i++) {
+        for (int j=0; j<3; j++) {
+            assert(pos[3 * i + j] == parts.pos[3 * i + j]);
+            assert(vel[3 * i + j] == parts.vel[3 * i + j]);
+        }
+        assert(id[i] == parts.id[i]);
+        assert(mass[i] == 2.5);
+    }
+
+    /* Clean up */
+    cleanParticles(&parts);
+    free(pos);
+    free(vel);
+    free(id);
+    free(mass);
+    remove(fname);
+
+    MPI_Finalize();
+
+    sucmsg("test_particle_output:\t SUCCESS");
+}
@@ -0,0 +1,128 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <math.h>
+#include <hdf5.h>
+
+#include "../include/mitos.h"
+
+static inline void sucmsg(const char *msg) {
+    printf("%s%s%s\n\n", TXT_GREEN, msg, TXT_RESET);
+}
+
+int main() {
+    MPI_Init(NULL, NULL);
+
+    /* Positions are stored in double precision, unless compiled otherwise */
+#ifdef SINGLE_PRECISION_POSITIONS
+    assert(sizeof(pos_t) == sizeof(float));
+#else
+    assert(sizeof(pos_t) == sizeof(double));
+#endif
+    assert(H5Tget_size(H5T_NATIVE_POS) == sizeof(pos_t));
+
+    /* Particles near the far edge of a 1 Gpc box with 2048^3 particles, where
+     * single precision only resolves ~60 pc */
+    const double boxlen = 1000.0;
+    const double spacing = boxlen / 2048;
+    const long long int num = 1000;
+
+    struct particle_data parts;
+    allocParticles(&parts, num);
+    for (long long int i=0; i<num; i++) {
+        parts.pos[3 * i + 0] = boxlen - spacing + i * 1e-7;
+        parts.pos[3 * i + 1] = i * spacing + 1e-7;
+        parts.pos[3 * i + 2] = boxlen - 1e-7 * i;
+        parts.vel[3 * i + 0] = i;
+        parts.vel[3 * i + 1] = -i;
+        parts.vel[3 * i + 2] = 0.5 * i;
+        parts.id[i] = 1000 + i;
+    }
+
+    /* Create the datasets as in the particle stage of mitos */
+    const char fname[] = "test_positions.hdf5";
+    hid_t h_file = H5Fcreate(fname, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t h_grp = H5Gcreate(h_file, "PartType1", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    assert(h_file >= 0 && h_grp >= 0);
+    int err = createParticleDatasets(h_grp, num, 1);
+    assert(err == 0);
+
+    /* The coordinates are stored with the precision of pos_t */
+    hid_t h_coords = H5Dopen(h_grp, "Coordinates", H5P_DEFAULT);
+    hid_t h_type = H5Dget_type(h_coords);
+    assert(H5Tget_size(h_type) == sizeof(pos_t));
+    H5Tclose(h_type);
+    H5Dclose(h_coords);
+
+    /* Write the particles with the real write path */
+    struct particle_write pw = {0};
+    pw.h_grp = h_grp;
+    pw.h_xfer = H5P_DEFAULT;
+    pw.comm = MPI_COMM_WORLD;
+    pw.parts = &parts;
+    pw.first_row = 0;
+    pw.mass = 2.5;
+    err = startParticleWrite_MPI(&pw, 0);
+    assert(err == 0);
+    err = finishParticleWrite_MPI(&pw);
+    assert(err == 0);
+
+    /* Read everything back */
+    double *pos = malloc(3 * num * sizeof(double));
+    float *vel = malloc(3 * num * sizeof(float));
+    long long int *id = malloc(num * sizeof(long long int));
+    double *mass = malloc(num * sizeof(double));
+
+    hid_t h_data = H5Dopen(h_grp, "Coordinates", H5P_DEFAULT);
+    H5Dread(h_data, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, pos);
+    H5Dclose(h_data);
+    h_data = H5Dopen(h_grp, "Velocities", H5P_DEFAULT);
+    H5Dread(h_data, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, vel);
+    H5Dclose(h_data);
+    h_data = H5Dopen(h_grp, "ParticleIDs", H5P_DEFAULT);
+    H5Dread(h_data, H5T_NATIVE_LLONG, H5S_ALL, H5S_ALL, H5P_DEFAULT, id);
+    H5Dclose(h_data);
+    h_data = H5Dopen(h_grp, "Masses", H5P_DEFAULT);
+    H5Dread(h_data, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, mass);
+    H5Dclose(h_data);
+
+    H5Gclose(h_grp);
+    H5Fclose(h_file);
+
+    /* The stored positions should be exact. In double precision, this means
+     * that sub-parsec offsets near the edge of the box survive. */
+    double max_err = 0;
+    for (long long int i=0; i<num; i++) {
+        for (int j=0; j<3; j++) {
+            assert(pos[3 * i + j] == (double) parts.pos[3 * i + j]);
+            assert(vel[3 * i + j] == parts.vel[3 * i + j]);
+        }
+        assert(id[i] == parts.id[i]);
+        assert(mass[i] == 2.5);
+
+        double exact = boxlen - spacing + i * 1e-7;
+        double err_x = fabs(pos[3 * i + 0] - exact);
+        if (err_x > max_err) max_err = err_x;
+    }
+
+    printf("compiled with:\t\t %s positions\n", sizeof(pos_t) == sizeof(double) ? "double" : "float");
+    printf("truncation near edge:\t %e\n", max_err);
+
+#ifdef SINGLE_PRECISION_POSITIONS
+    assert(max_err > 1e-6);
+#else
+    assert(max_err < 1e-12 * boxlen);
+#endif
+
+    /* Clean up */
+    cleanParticles(&parts);
+    free(pos);
+    free(vel);
+    free(id);
+    free(mass);
+    remove(fname);
+
+    MPI_Finalize();
+
+    sucmsg("test_positions:\t SUCCESS");
+}
@@ -0,0 +1,120 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "../include/mitos.h"
+
+static inline void sucmsg(const char *msg) {
+    printf("%s%s%s\n\n", TXT_GREEN, msg, TXT_RESET);
+}
+
+/* Elapsed time in seconds since a given starting time */
+static inline double elapsed(const struct timeval *start) {
+    struct timeval stop;
+    gettimeofday(&stop, NULL);
+    return (stop.tv_sec - start->tv_sec) + (stop.tv_usec - start->tv_usec) / 1e6;
+}
+
+/* Compare the inverse cdf table sampler with the Hermite interval sampler
+ * and with the numerically integrated cdf of the given pdf */
+static void test_distribution(const char *name, pdf f, double T) {
+    const double xl = THERMAL_MIN_MOMENTUM * T;
+    const double xr = THERMAL_MAX_MOMENTUM * T;
+    double params[2] = {T, 0.};
+
+    struct timeval start;
+
+    /* Initialize both samplers */
+    struct sampler s;
+    gettimeofday(&start, NULL);
+    int err = initSampler(&s, f, xl, xr, params);
+    double hermite_init = elapsed(&start);
+    assert(err == 0);
+
+    struct table_sampler ts;
+    gettimeofday(&start, NULL);
+    err = initTableSampler(&ts, f, xl, xr, params);
+    double table_init = elapsed(&start);
+    assert(err == 0);
+
+    /* Draw samples from both */
+    const int N = 2000000;
+    double *a = malloc(N * sizeof(double));
+    double *b = malloc(N * sizeof(double));
+
+    rng_state seed = rand_uint64_init(101);
+    gettimeofday(&start, NULL);
+    for (int i=0; i<N; i++) {
+        a[i] = samplerCustom(&s, &seed);
+    }
+    double hermite_time = elapsed(&start);
+
+    gettimeofday(&start, NULL);
+    for (int i=0; i<N; i++) {
+        b[i] = sampleTable(&ts, &seed);
+    }
+    double table_time = elapsed(&start);
+
+    /* Compare the first two moments */
+    double a_sum = 0, a2_sum = 0, b_sum = 0, b2_sum = 0;
+    for (int i=0; i<N; i++) {
+        a_sum += a[i];
+        a2_sum += a[i] * a[i];
+        b_sum += b[i];
+        b2_sum += b[i] * b[i];
+    }
+    double a_mean = a_sum / N, b_mean = b_sum / N;
+    double a_sdev = sqrt(a2_sum / N - a_mean * a_mean);
+    double b_sdev = sqrt(b2_sum / N - b_mean * b_mean);
+
+    /* Compare binned cdfs with the numerical cdf (Kolmogorov-Smirnov) */
+    const int bins = 200;
+    int *a_counts = calloc(bins, sizeof(int));
+    int *b_counts = calloc(bins, sizeof(int));
+    for (int i=0; i<N; i++) {
+        int ia = (int) ((a[i] - xl) / (xr - xl) * bins);
+        int ib = (int) ((b[i] - xl) / (xr - xl) * bins);
+        assert(ib >= 0 && ib <= bins);
+        if (ia >= 0 && ia < bins) a_counts[ia]++;
+        if (ib < bins) b_counts[ib]++;
+    }
+
+    double norm = numericalCDF(xl, xr, 100000, f, params);
+    double a_cdf = 0, b_cdf = 0, a_KS = 0, b_KS = 0;
+    for (int j=0; j<bins; j++) {
+        double x = xl + (j + 1) * (xr - xl) / bins;
+        double F = numericalCDF(xl, x, 10000, f, params) / norm;
+        a_cdf += (double) a_counts[j] / N;
+        b_cdf += (double) b_counts[j] / N;
+        if (fabs(a_cdf - F) > a_KS) a_KS = fabs(a_cdf - F);
+        if (fabs(b_cdf - F) > b_KS) b_KS = fabs(b_cdf - F);
+    }
+
+    printf("%s hermite:\t [mean, sdev, KS] = [%f, %f, %e] (init %.3f s, %.3e samples/s)\n",
+           name, a_mean / T, a_sdev / T, a_KS, hermite_init, N / hermite_time);
+    printf("%s table:\t [mean, sdev, KS] = [%f, %f, %e] (init %.3f s, %.3e samples/s)\n",
+           name, b_mean / T, b_sdev / T, b_KS, table_init, N / table_time);
+
+    /* The KS statistic should be consistent with sampling noise */
+    assert(b_KS < 2.0 / sqrt(N));
+    assert(fabs(b_mean - a_mean) / a_mean < 2e-3);
+    assert(fabs(b_sdev - a_sdev) / a_sdev < 2e-3);
+
+    /* Clean up */
+    free(a);
+    free(b);
+    free(a_counts);
+    free(b_counts);
+    cleanSampler(&s);
+    cleanTableSampler(&ts);
+}
+
+int main() {
+    /* Fermi-Dirac and Bose-Einstein at an arbitrary temperature */
+    test_distribution("FD", fd_pdf, 1.68e-4);
+    test_distribution("BE", be_pdf, 1.68e-4);
+
+    sucmsg("test_sampler:\t SUCCESS");
+}
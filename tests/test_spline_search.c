@@ -0,0 +1,201 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "../include/mitos.h"
+
+static inline void sucmsg(const char *msg) {
+    printf("%s%s%s\n\n", TXT_GREEN, msg, TXT_RESET);
+}
+
+/* Elapsed time in seconds since a given starting time */
+static inline double elapsed(const struct timeval *start) {
+    struct timeval stop;
+    gettimeofday(&stop, NULL);
+    return (stop.tv_sec - start->tv_sec) + (stop.tv_usec - start->tv_usec) / 1e6;
+}
+
+/* Reference bilinear interpolation using linear scans over both vectors */
+static double interp_linear_scan(const struct perturb_data *ptdat, double k,
+                                 double log_tau, int index_src) {
+    int k_size = ptdat->k_size;
+    int tau_size = ptdat->tau_size;
+
+    if (log_tau < ptdat->log_tau[0]) log_tau = ptdat->log_tau[0];
+    if (log_tau > ptdat->log_tau[tau_size - 1]) log_tau = ptdat->log_tau[tau_size - 1];
+    if (k < ptdat->k[0]) k = ptdat->k[0];
+    if (k > ptdat->k[k_size - 1]) k = ptdat->k[k_size - 1];
+
+    int i = 0, j = 0;
+    while (i < tau_size - 2 && ptdat->log_tau[i + 1] <= log_tau) i++;
+    while (j < k_size - 2 && ptdat->k[j + 1] <= k) j++;
+
+    double u_tau = (log_tau - ptdat->log_tau[i]) / (ptdat->log_tau[i + 1] - ptdat->log_tau[i]);
+    double u_k = (k - ptdat->k[j]) / (ptdat->k[j + 1] - ptdat->k[j]);
+
+    double *arr = ptdat->delta + index_src * k_size * tau_size;
+    double T11 = arr[k_size * i + j];
+    double T21 = arr[k_size * i + j + 1];
+    double T12 = arr[k_size * (i + 1) + j];
+    double T22 = arr[k_size * (i + 1) + j + 1];
+
+    return (1 - u_tau) * ((1 - u_k) * T11 + u_k * T21)
+               + u_tau * ((1 - u_k) * T12 + u_k * T22);
+}
+
+int main() {
+    /* A synthetic table with the layout of a CLASS perturbation file: a
+     * non-uniform logarithmic k-vector and a time vector that is denser at
+     * early times */
+    const int k_size = 3000;
+    const int tau_size = 1500;
+    const int n_functions = 4;
+
+    struct perturb_data ptdat;
+    ptdat.k_size = k_size;
+    ptdat.tau_size = tau_size;
+    ptdat.n_functions = n_functions;
+    ptdat.k = malloc(k_size * sizeof(double));
+    ptdat.log_tau = malloc(tau_size * sizeof(double));
+    ptdat.redshift = malloc(tau_size * sizeof(double));
+    ptdat.delta = malloc((long int) k_size * tau_size * n_functions * sizeof(double));
+
+    for (int i=0; i<k_size; i++) {
+        double x = (double) i / (k_size - 1);
+        ptdat.k[i] = 1e-5 * pow(1e6, x + 0.05 * sin(M_PI * x));
+    }
+    for (int i=0; i<tau_size; i++) {
+        double x = (double) i / (tau_size - 1);
+        ptdat.log_tau[i] = log(0.1) + log(1.5e4) * sqrt(x);
+        ptdat.redshift[i] = 1e6 * exp(-14 * sqrt(x)) - 0.5;
+    }
+    for (int f=0; f<n_functions; f++) {
+        for (int i=0; i<tau_size; i++) {
+            for (int j=0; j<k_size; j++) {
+                double T = cos((f + 1) * log(ptdat.k[j])) * ptdat.log_tau[i];
+                ptdat.delta[(long int) f * k_size * tau_size + (long int) k_size * i + j] = T;
+            }
+        }
+    }
+
+    /* Initialize the spline */
+    struct timeval start;
+    struct perturb_spline spline;
+    gettimeofday(&start, NULL);
+    int err = initPerturbSpline(&spline, DEFAULT_K_ACC_TABLE_SIZE, &ptdat);
+    double init_time = elapsed(&start);
+    assert(err == 0);
+
+    /* Compare with the linear scans at random points, including some
+     * points outside the table */
+    rng_state seed = rand_uint64_init(101);
+    const int n = 200000;
+    struct perturb_spline_cursor cursor = {0, 0};
+    double max_err = 0;
+    for (int i=0; i<n; i++) {
+        double k = ptdat.k[0] * pow(ptdat.k[k_size - 1] / ptdat.k[0], 1.2 * sampleUniform(&seed) - 0.1);
+        double log_tau = ptdat.log_tau[0] + (ptdat.log_tau[tau_size - 1] - ptdat.log_tau[0]) * (1.2 * sampleUniform(&seed) - 0.1);
+        int f = i % n_functions;
+
+        double ref = interp_linear_scan(&ptdat, k, log_tau, f);
+        double a = perturbSplineInterp0(&spline, k, log_tau, f);
+        double b = perturbSplineInterpCursor(&spline, &cursor, k, log_tau, f);
+
+        if (fabs(a - ref) > max_err) max_err = fabs(a - ref);
+        if (fabs(b - ref) > max_err) max_err = fabs(b - ref);
+    }
+
+    /* Lookups exactly at the nodes */
+    for (int i=0; i<tau_size; i++) {
+        for (int j=0; j<k_size; j+=37) {
+            double ref = ptdat.delta[(long int) k_size * i + j];
+            double a = perturbSplineInterp0(&spline, ptdat.k[j], ptdat.log_tau[i], 0);
+            if (fabs(a - ref) > max_err) max_err = fabs(a - ref);
+        }
+    }
+
+    /* The redshift lookup should invert the redshift interpolation */
+    double max_err_z = 0;
+    for (int i=0; i<n; i++) {
+        double log_tau = ptdat.log_tau[0] + (ptdat.log_tau[tau_size - 1] - ptdat.log_tau[0]) * sampleUniform(&seed);
+        double z = perturbRedshiftAtLogTau(&spline, log_tau);
+        double e = fabs(perturbLogTauAtRedshift(&spline, z) - log_tau);
+        if (e > max_err_z) max_err_z = e;
+    }
+
+    printf("k_acc_table init:\t %.3e s (%d cells, %d wavenumbers)\n", init_time, DEFAULT_K_ACC_TABLE_SIZE, k_size);
+    printf("max error:\t\t %e (redshift inversion %e)\n", max_err, max_err_z);
+
+    assert(max_err < 1e-10);
+    assert(max_err_z < 1e-8);
+
+    /* Benchmark the access pattern of the Firebolt source callbacks: four
+     * functions on a fixed logarithmic k-grid at each of many time steps */
+    const int firebolt_k_size = 1000;
+    const int steps = 500;
+    const double k_min = 1e-4, k_max = 10.0;
+
+    double *firebolt_k = malloc(firebolt_k_size * sizeof(double));
+    for (int i=0; i<firebolt_k_size; i++) {
+        firebolt_k[i] = k_min * pow(k_max / k_min, (double) i / (firebolt_k_size - 1));
+    }
+
+    double sum_scan = 0, sum_search = 0, sum_cursor = 0;
+
+    gettimeofday(&start, NULL);
+    for (int s=0; s<steps; s+=10) {
+        double log_tau = ptdat.log_tau[0] + (ptdat.log_tau[tau_size - 1] - ptdat.log_tau[0]) * s / steps;
+        for (int i=0; i<firebolt_k_size; i++) {
+            double k = firebolt_k[i];
+            for (int f=0; f<n_functions; f++) {
+                sum_scan += interp_linear_scan(&ptdat, k, log_tau, f);
+            }
+        }
+    }
+    double scan_time = elapsed(&start) * 10;
+
+    gettimeofday(&start, NULL);
+    for (int s=0; s<steps; s++) {
+        double log_tau = ptdat.log_tau[0] + (ptdat.log_tau[tau_size - 1] - ptdat.log_tau[0]) * s / steps;
+        for (int i=0; i<firebolt_k_size; i++) {
+            double k = firebolt_k[i];
+            for (int f=0; f<n_functions; f++) {
+                sum_search += perturbSplineInterp0(&spline, k, log_tau, f);
+            }
+        }
+    }
+    double search_time = elapsed(&start);
+
+    gettimeofday(&start, NULL);
+    for (int s=0; s<steps; s++) {
+        double log_tau = ptdat.log_tau[0] + (ptdat.log_tau[tau_size - 1] - ptdat.log_tau[0]) * s / steps;
+        for (int i=0; i<firebolt_k_size; i++) {
+            double k = firebolt_k[i];
+            for (int f=0; f<n_functions; f++) {
+                sum_cursor += perturbSplineInterpCursor(&spline, &cursor, k, log_tau, f);
+            }
+        }
+    }
+    double cursor_time = elapsed(&start);
+
+    long long int calls = (long long int) steps * firebolt_k_size * n_functions;
+    printf("callbacks (scan):\t %.3e calls/s (estimated from every 10th step)\n", calls / scan_time);
+    printf("callbacks (search):\t %.3e calls/s\n", calls / search_time);
+    printf("callbacks (cursor):\t %.3e calls/s\n", calls / cursor_time);
+
+    printf("checksums:\t\t %e %e %e\n", sum_scan * 10, sum_search, sum_cursor);
+
+    assert(fabs(sum_search - sum_cursor) < 1e-8 * fabs(sum_search) + 1e-8);
+
+    /* Clean up */
+    cleanPerturbSpline(&spline);
+    free(ptdat.k);
+    free(ptdat.log_tau);
+    free(ptdat.redshift);
+    free(ptdat.delta);
+    free(firebolt_k);
+
+    sucmsg("test_spline_search:\t SUCCESS");
+}